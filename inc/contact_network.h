@@ -0,0 +1,102 @@
+/*
+ *  contact_network.h
+ *  --> accumulates the interactions between ants into time windows of fixed length and writes, for each window,
+ *		the weighted edges of the contact network: the number of frames (or the time in seconds) in which each pair of ants interacted.
+ *		Only the pairs that interacted are kept in memory, the full per-frame interaction file is not needed.
+ *		With durations, a frame lasts until the next frame but at most the median interval of the recent frames (a gap in the
+ *		recording is not counted as contact) and never beyond the end of its window.
+ *		Output: outfile lists the windows (Window,Start,Stop,File,Pairs,Weight), the edges of window n are written to outfile_n
+ *		(Tag1,Tag2,Weight, one line per pair that interacted, in the order of the tags file).
+ *
+ *  Copyright UNIL. All rights reserved.
+ *
+ */
+
+#ifndef __contact_network__
+#define __contact_network__
+
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <stdint.h>
+#include "trackcvt.h"
+#include "exception.h"
+#include "interaction_file.h"
+
+using namespace std;
+
+
+//==========================================================
+/// Time-binned weighted contact network
+class ContactNetwork{
+
+	public:
+		/**\brief Constructor
+		 * \param window Length of the time windows in seconds, the first window starts with the first frame
+		 * \param durations True to weight the contacts by their duration in seconds, false to count the frames with contact
+		 */
+		ContactNetwork(const double window, const bool durations);
+		~ContactNetwork();
+
+		/**\brief Creates the list of windows
+		 * \param filename Name of the list of windows, the edges are written to filename_n
+		 * \param tags Indexes in tag_list of the ants of the network, in the order of the edges
+		 */
+		void open(const string& filename, const vector <int>& tags);
+
+		/**\brief Starts a new frame, must be called for every frame (also those without interactions) before its interactions are added
+		 * \param frame Frame number
+		 * \param time Time of the frame
+		 */
+		void next_frame(const uint32_t frame, const double time);
+
+		/**\brief Adds an interaction of the current frame
+		 * \param r Interaction
+		 */
+		void write(const interaction_record& r);
+
+		/**\brief Writes the last window and closes the list of windows
+		 */
+		void close();
+
+		/**\brief Returns the number of windows written
+		 * \return Number of windows
+		 */
+		int get_window_count() const;
+
+	private:
+		/**\brief Adds the duration of the last frame to the pairs that interacted in it, limited to the end of its window
+		 * \param dt Duration of the frame in seconds
+		 */
+		void add_durations(double dt);
+
+		/**\brief Returns the nominal interval between frames: the median of the recent intervals
+		 * \return Interval in seconds, -1 if no interval is known yet
+		 */
+		double nominal_dt() const;
+
+		/**\brief Writes the edges of the current window and clears the weights
+		 */
+		void write_window();
+
+		double window;							///< length of the windows in seconds
+		bool durations;							///< weights are durations instead of frame counts
+		vector <int> index;						///< index in tag_list of each tag
+		vector <int> tags;						///< indexes in tag_list of the ants of the network
+		vector <int> position;					///< position in tags of each index of tag_list (-1 if the ant is not in the network)
+		unordered_map <uint32_t, double> weights;	///< weight of each pair of the current window (index idx1 * tag_count + idx2, with idx1 < idx2)
+		vector <uint32_t> last_pairs;			///< pairs that interacted in the last frame
+		double start;							///< time of the first frame
+		double last_time;						///< time of the last frame
+		vector <double> recent_dt;				///< intervals between the recent frames (circular buffer)
+		int next_dt;							///< position of the next interval in recent_dt
+		int current;							///< number of the current window
+		bool started;							///< true once a frame was given
+		ofstream g;								///< list of windows
+		string name;							///< name of the list of windows
+		int windows;							///< number of windows written
+};
+
+#endif //__contact_network__
@@ -0,0 +1,146 @@
+/*
+ *  csv_file.h
+ *  --> reads delimited text files of numbers (CSV) line by line and field by field, without copying the lines:
+ *		the file is mapped into memory and the numbers are converted in place.
+ *		Malformed fields are reported with the name of the file and the number of the line.
+ *
+ *  Copyright UNIL. All rights reserved.
+ *
+ */
+
+#ifndef __csv_file__
+#define __csv_file__
+
+#include <cstdlib>
+#include <string>
+#include <stdint.h>
+#include "exception.h"
+
+using namespace std;
+
+
+//==========================================================
+/// Reader of delimited text files
+class CsvReader{
+
+	public:
+		CsvReader();
+		~CsvReader();
+
+		/**\brief Opens a file and maps it into memory
+		 * \param filename Name of the file to read
+		 * \param delimiter Character separating the fields of a line
+		 */
+		void open(const string& filename, const char delimiter = ',');
+
+		/**\brief Moves to the next line of the file, the fields are then read from its beginning
+		 * \return True if a line was found, false at the end of the file
+		 */
+		bool next_line();
+
+		/**\brief Tests whether all lines of the file were read
+		 * \return True if there is no line left
+		 */
+		bool eof() const;
+
+		/**\brief Tests whether the current line is empty (apart from a carriage return)
+		 * \return True if the line is empty
+		 */
+		bool is_empty() const;
+
+		/**\brief Tests whether all fields of the current line were read
+		 * \return True if the end of the line is reached
+		 */
+		bool at_end() const;
+
+		/**\brief Returns the next character of the current line without reading it
+		 * \return Next character, 0 at the end of the line
+		 */
+		char peek() const;
+
+		/**\brief Reads the next field as a real number
+		 * \return Value of the field
+		 */
+		double read_double();
+
+		/**\brief Reads the next field as a real number if it is one, the field is left unread otherwise
+		 * \param v Value of the field
+		 * \return True if the field is a number
+		 */
+		bool try_double(double& v);
+
+		/**\brief Reads the next field as an integer
+		 * \return Value of the field
+		 */
+		long read_long();
+
+		/**\brief Reads the next field as an integer
+		 * \return Value of the field
+		 */
+		int read_int();
+
+		/**\brief Reads the next field as a non-negative integer
+		 * \return Value of the field
+		 */
+		unsigned int read_uint();
+
+		/**\brief Reads the first character of the next field (leading spaces are skipped) and skips the rest of the field
+		 * \return Character, 0 if the field is empty
+		 */
+		char read_char();
+
+		/**\brief Reads the rest of the current line, from the next field on
+		 * \return Rest of the line
+		 */
+		string read_rest();
+
+		/**\brief Returns the current line, without its end of line
+		 * \return Line
+		 */
+		string get_line() const;
+
+		/**\brief Returns the number of the current line (the first line is 1)
+		 * \return Number of the line
+		 */
+		unsigned long get_line_number() const;
+
+		/**\brief Throws a DATA_ERROR exception locating the current line
+		 * \param message Description of the error
+		 */
+		void error(const string& message) const;
+
+		/**\brief Unmaps and closes the file
+		 */
+		void close();
+
+	private:
+		/**\brief Moves to the beginning of the next field: skips the delimiter that ends the previous field and the spaces
+		 */
+		void start_field();
+
+		/**\brief Checks that a number ends at the end of its field
+		 * \param q Position after the number
+		 */
+		void end_field(const char* q);
+
+		/**\brief Reads the next field as an integer
+		 * \param min Smallest allowed value
+		 * \param max Largest allowed value
+		 * \return Value of the field
+		 */
+		long long read_integer(const long long min, const long long max);
+
+		string name;				///< name of the file
+		char delimiter;				///< field delimiter
+		int fd;						///< file descriptor
+		const char* data;			///< content of the file
+		size_t size;				///< size of the file in bytes
+		const char* next;			///< beginning of the next line
+		const char* begin;			///< beginning of the current line
+		const char* end;			///< end of the current line (before "\r\n" or "\n")
+		const char* p;				///< position of the next field in the current line
+		bool first;					///< true if no field of the current line was read yet
+		unsigned long line;			///< number of the current line
+};
+
+#endif //__csv_file__
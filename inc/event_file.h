@@ -0,0 +1,33 @@
+/*
+ *  event_file.h
+ *  --> functions on the event files written by the filter programs (one line per event, sorted by start frame):
+ *		Tag1,Tag2,Startframe,Stopframe,Starttime,Stoptime,Box,Xcoor1,Ycoor1,Angle1,Xcoor2,Ycorr2,Angle2,Direction,Detections
+ *
+ *  Copyright UNIL. All rights reserved.
+ *
+ */
+
+#ifndef __event_file__
+#define __event_file__
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "trackcvt.h"
+#include "exception.h"
+
+using namespace std;
+
+const string EVENT_HEADER = "#Tag1,Tag2,Startframe,Stopframe,Starttime,Stoptime,Box,Xcoor1,Ycoor1,Angle1,Xcoor2,Ycorr2,Angle2,Direction,Detections";	///< header of the event files
+
+/**\fn uint64_t merge_event_files(const vector <string>& inputs, const string& output)
+ * \brief Merges event files sorted by start frame, each containing all events of its pairs of ants (e.g. the events of the shards of an interaction file),
+ *        into one event file sorted by start frame. Events with the same start frame are ordered by pair (order of tag_list), as in a single run of the filter.
+ * \param inputs Names of the event files to merge
+ * \param output Name of the file to create
+ * \return Number of events written
+ */
+uint64_t merge_event_files(const vector <string>& inputs, const string& output);
+
+#endif //__event_file__
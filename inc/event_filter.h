@@ -0,0 +1,228 @@
+/*
+ *  event_filter.h
+ *  --> merges the interactions of each pair of ants detected in subsequent frames into interaction events,
+ *		with the rules of filter_interactions_cut_immobile (time threshold F_TH, distance threshold X_TH,
+ *		maximal duration F_MAX counted from the last frame in which one of the ants was awake, awakeness distance X_min).
+ *		EventFilter does the same work online: interactions are given frame by frame, finished events are written
+ *		as soon as no interaction that is still to come can precede them in the sorted output.
+ *		Only the open event of each pair is kept in memory, with running sums instead of the list of its interactions.
+ *
+ *  Copyright UNIL. All rights reserved.
+ *
+ */
+
+#ifndef __event_filter__
+#define __event_filter__
+
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <queue>
+#include <set>
+#include <stdint.h>
+#include "trackcvt.h"
+#include "exception.h"
+#include "interaction_file.h"
+#include "event_file.h"
+#include "event_summary.h"
+
+using namespace std;
+
+/// structure of an interaction
+struct interaction_data{
+  double time_start;
+  double time_stop;
+  uint32_t frame_start;		// frame of interaction
+  //==== NS code start =====
+  uint32_t frame_ref_awakeness;		// frame used for calculating asleep duration
+  //==== NS code end =====
+  uint32_t frame_stop;		// frame of end of interaction (filled only during filtering)
+  uint16_t box;
+  //coor ant 1
+  uint16_t x1;
+  uint16_t y1;
+  int16_t a1;
+  //==== NS code start =====
+  bool awake1;
+  //==== NS code end =====
+  // coor ant 2
+  uint16_t x2;
+  uint16_t y2;
+  int16_t a2;
+  //==== NS code start =====
+  bool awake2;
+  //==== NS code end =====
+  int det;//number of frames in which the interaction was detected
+  int direction; // direction of interaction (1: ant1 interacts, 2: ant2 interacts, 3:both ants interact);
+  //==== NS code start =====
+  char from;//point of interacting ant: A antenna, M mandibles, G gaster tip
+  char to;//region of touched ant: F front, B back
+  //==== NS code end =====
+};
+
+struct event{
+  uint16_t tag1;
+  uint16_t tag2;
+  interaction_data d;
+  char s;		// state of interaction: long, blinking
+};
+
+/**\fn bool average_position(interaction_data& tmp, const vector <interaction_data>& inter, bool length, int F_MAX)
+ * \brief Calculates the average position, orientation and direction of the interactions of an event
+ * \param tmp Event in which the averages are stored
+ * \param inter Interactions of the event
+ * \param length True if the event was truncated at F_MAX
+ * \param F_MAX Duration of the event in frames
+ * \return False if the average position is outside of the image
+ */
+bool average_position(interaction_data& tmp, const vector <interaction_data>& inter, bool length, int F_MAX);
+
+/**\fn void write_event(ostream& g, const event& e)
+ * \brief Writes an event as a line of an event file
+ * \param g Output stream
+ * \param e Event to write
+ */
+void write_event(ostream& g, const event& e);
+
+
+//==========================================================
+/// Online version of filter_interactions_cut_immobile
+class EventFilter{
+
+	public:
+		/**\brief Constructor
+		 * \param F_TH Maximal number of frames between 2 interactions of the same event
+		 * \param F_MAX Maximal duration of an event in frames
+		 * \param X_TH Maximal variation in x and y coordinates between 2 interactions of the same event
+		 * \param X_min Minimal variation in x and y coordinates for an ant to be awake
+		 */
+		EventFilter(const int F_TH, const int F_MAX, const int X_TH, const int X_min);
+		~EventFilter();
+
+		/**\brief Creates the event file and writes its header
+		 * \param filename Name of the file to create
+		 */
+		void open(const string& filename);
+
+		/**\brief Adds an interaction. Interactions must be given in increasing frame order.
+		 * \param r Interaction
+		 */
+		void write(const interaction_record& r);
+
+		/**\brief Adds the written events to statistics
+		 * \param s Statistics (NULL if none)
+		 */
+		void set_summary(EventSummary* s);
+
+		/**\brief Closes all open events, writes the remaining events and closes the file
+		 */
+		void close();
+
+		/**\brief Returns the number of pairs of ants that interacted in a single frame
+		 * \return Number of pairs
+		 */
+		int get_single_count() const;
+
+		/**\brief Returns the number of events written
+		 * \return Number of events
+		 */
+		uint64_t get_event_count() const;
+
+	private:
+		/// running sums of the positions, angles and directions of the interactions of an open event, from which average_position is computed
+		struct event_sums{
+			double x1, y1, x2, y2;				///< sums of the coordinates
+			double c1, s1, c2, s2;				///< sums of the cosines and sines of the angles
+			double d;							///< sum of the directions
+			int n;								///< number of interactions (0 if the last interaction was not merged)
+		};
+
+		/// state of a pair of ants: the current (last) interaction, which contains the open event if several interactions were merged
+		struct pair_state{
+			interaction_data cur;				///< last interaction, or open event
+			event_sums sums;					///< sums over the interactions of the open event
+			uint32_t count;						///< number of interactions of the pair
+			uint32_t ordinal;					///< number of events of the pair closed so far
+			bool open;							///< true if cur is valid
+		};
+
+		/// key used to sort the events: start frame, pair, then order of the events of the pair
+		struct event_key{
+			uint32_t frame;
+			uint32_t pair;
+			uint32_t ordinal;
+			bool operator< (const event_key& k) const{
+				return frame < k.frame || (frame == k.frame && (pair < k.pair || (pair == k.pair && ordinal < k.ordinal)));
+			}
+		};
+
+		/// finished event waiting to be written
+		struct pending_event{
+			event_key key;
+			event e;
+			bool operator< (const pending_event& p) const{
+				return p.key < key;		// reversed, for a min-heap
+			}
+		};
+
+		/**\brief Tests whether an interaction in the given frame can belong to the open event (rule F_TH)
+		 * \param temp1 Open event or last interaction
+		 * \param frame Frame of the new interaction
+		 * \return True if the interaction is close enough in time
+		 */
+		bool is_close(const interaction_data& temp1, const uint32_t frame) const;
+
+		/**\brief Merges a new interaction into the state of a pair, or closes the open event
+		 * \param p Index of the pair
+		 * \param temp2 New interaction
+		 */
+		void add(const uint32_t p, interaction_data& temp2);
+
+		/**\brief Adds an interaction to the sums of an open event
+		 * \param sums Sums of the event
+		 * \param d Interaction
+		 */
+		static void accumulate(event_sums& sums, const interaction_data& d);
+
+		/**\brief Sets the average position, orientation and direction of an event from its sums, like average_position
+		 * \param tmp Event in which the averages are stored
+		 * \param sums Sums of the event
+		 * \return False if the average position is outside of the image
+		 */
+		static bool average_sums(interaction_data& tmp, const event_sums& sums);
+
+		/**\brief Finishes the open event of a pair and stores it until it can be written
+		 * \param p Index of the pair
+		 */
+		void finish(const uint32_t p);
+
+		/**\brief Closes the events that no future interaction can extend
+		 * \param frame Current frame
+		 */
+		void expire(const uint32_t frame);
+
+		/**\brief Writes the stored events that precede all open events
+		 */
+		void flush();
+
+		int F_TH;
+		int F_MAX;
+		int X_TH;
+		int X_min;
+
+		vector <int> index;					///< index in tag_list of each tag
+		vector <pair_state> pairs;			///< state of each pair (index idx1 * tag_count + idx2, with idx1 < idx2)
+		vector <uint32_t> open_pairs;		///< pairs with an open state
+		set <event_key> open_keys;			///< keys of the open states
+		priority_queue <pending_event> done;	///< finished events, not written yet
+		uint32_t current;					///< frame of the last interaction
+		bool started;						///< true once an interaction was given
+		ofstream g;							///< output stream
+		string name;						///< name of the output file
+		uint64_t events;					///< number of events written
+		EventSummary* summary;				///< statistics on the written events (NULL if none)
+		int singles;						///< number of pairs with a single interaction
+};
+
+#endif //__event_filter__
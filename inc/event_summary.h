@@ -0,0 +1,79 @@
+/*
+ *  event_summary.h
+ *  --> accumulates statistics on the events while the filter programs write them, so that the event file does not need to be read again:
+ *		distribution of the durations of the events (Histogram with groups [2^k, 2^(k+1)) frames, running sums and exact counts per duration),
+ *		number of events and frames in events of each ant and of each pair of ants, number of events starting in each hour.
+ *		The memory does not depend on the number of events.
+ *		Output (sections starting with a '#' line):
+ *		Events,Frames,Mean,Stdev,Median (durations in frames) / Min,Max,Events (histogram) / Ant,Events,Frames,Partners / Ant1,Ant2,Events,Frames / Hour,Events,Frames
+ *
+ *  Copyright UNIL. All rights reserved.
+ *
+ */
+
+#ifndef __event_summary__
+#define __event_summary__
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <map>
+#include <stdint.h>
+#include "trackcvt.h"
+#include "exception.h"
+#include "histogram.h"
+
+using namespace std;
+
+
+//==========================================================
+/// Statistics on the events of a filtered interaction file
+class EventSummary{
+
+	public:
+		EventSummary();
+		~EventSummary();
+
+		/**\brief Adds an event
+		 * \param tag1 Tag of ant 1
+		 * \param tag2 Tag of ant 2
+		 * \param frame_start First frame of the event
+		 * \param frame_stop Last frame of the event
+		 * \param time_start Time of the first frame, in seconds
+		 */
+		void add(const uint16_t tag1, const uint16_t tag2, const uint32_t frame_start, const uint32_t frame_stop, const double time_start);
+
+		/**\brief Writes the summary
+		 * \param filename Name of the file to create
+		 */
+		void write(const string& filename);
+
+		/**\brief Returns the number of events added
+		 * \return Number of events
+		 */
+		uint64_t get_event_count() const;
+
+	private:
+		/// number of events and of frames in events
+		struct totals{
+			uint64_t events;
+			uint64_t frames;
+		};
+
+		/**\brief Finds the median of the durations
+		 * \return Median in frames, the mean of the 2 middle durations for an even number of events
+		 */
+		double find_median() const;
+
+		vector <int> index;					///< index in tag_list of each tag
+		vector <totals> ants;				///< totals of each ant (index in tag_list)
+		vector <totals> pairs;				///< totals of each pair (index idx1 * tag_count + idx2, with idx1 < idx2)
+		map <long long, totals> hours;		///< totals of the events starting in each hour (time_start / 3600)
+		Histogram durations;				///< distribution of the durations in frames
+		double duration_sum;				///< sum of the durations in frames
+		double duration_sum_square;			///< sum of the squared durations
+		map <uint32_t, uint64_t> duration_counts;	///< number of events of each duration in frames, for the median
+		totals all;							///< totals of all events
+};
+
+#endif //__event_summary__
@@ -0,0 +1,198 @@
+/*
+ *  interaction_file.h
+ *  --> reads and writes the lists of interactions produced by the interaction programs and read by the filter programs.
+ *		Two formats are supported:
+ *		1. a binary format: a header (interaction_header) followed by fixed size records (interaction_record).
+ *		   Each record keeps the time of its frame: files sorted by pair, merged or split into shards are not in frame order,
+ *		   so the time could only be recovered through a table of all frames held by every reader and writer.
+ *		   A record takes about half the size of a CSV line.
+ *		2. the CSV text format: Time,Frame,Box,Ant1,Ant2,Xcoor1,Ycoor1,Angle1,Xcoor2,Ycoor2,Angle2[,Direction[,From,To]]
+ *		The reader recognizes the format of a file automatically from its first bytes.
+ *
+ *  Copyright UNIL. All rights reserved.
+ *
+ */
+
+#ifndef __interaction_file__
+#define __interaction_file__
+
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "exception.h"
+#include "csv_file.h"
+
+using namespace std;
+
+const char INTERACTION_MAGIC[8] = {'A','T','R','K','I','N','T','\0'};	///< first 8 bytes of a binary interaction file
+const uint32_t INTERACTION_VERSION = 1;		///< version of the binary format, to increment when interaction_record changes
+
+// flags of the header, describing which optional columns are meaningful (and are written in CSV)
+const uint32_t INTERACTION_DIRECTION = 1;	///< records contain the direction of the interaction
+const uint32_t INTERACTION_FROM_TO = 2;		///< records contain the body parts involved in the interaction (from, to)
+
+/// header of a binary interaction file (32 bytes)
+struct interaction_header{
+	char magic[8];				///< INTERACTION_MAGIC
+	uint32_t version;			///< INTERACTION_VERSION
+	uint32_t record_size;		///< sizeof(interaction_record)
+	uint32_t flags;				///< combination of INTERACTION_DIRECTION and INTERACTION_FROM_TO
+	uint32_t padding;
+	uint64_t count;				///< number of records in the file
+};
+
+/// one interaction between 2 ants in one frame (32 bytes)
+struct interaction_record{
+	double time;			///< time of the frame
+	uint32_t frame;			///< frame number
+	uint16_t tag1;			///< tag of ant 1
+	uint16_t tag2;			///< tag of ant 2
+	int16_t x1;				///< coordinates and angle (centidegrees) of ant 1
+	int16_t y1;
+	int16_t a1;
+	int16_t x2;				///< coordinates and angle (centidegrees) of ant 2
+	int16_t y2;
+	int16_t a2;
+	uint8_t box;			///< box in which the interaction happened
+	int8_t direction;		///< 1: ant1 interacts, -1: ant2 interacts, 0: both ants interact
+	char from;				///< body part of the interacting ant (0 if unknown)
+	char to;				///< region of the touched ant (0 if unknown)
+};
+
+/**\fn inline int pair_shard(const uint16_t tag1, const uint16_t tag2, const int shards)
+ * \brief Chooses the shard of a pair of ants when the interactions are split into several files: all interactions of a pair go to the same shard
+ * \param tag1 Tag of ant 1
+ * \param tag2 Tag of ant 2
+ * \param shards Number of shards
+ * \return Index of the shard, between 0 and shards-1 (the same for (tag1, tag2) and (tag2, tag1))
+ */
+inline int pair_shard(const uint16_t tag1, const uint16_t tag2, const int shards){
+	uint32_t lo = (tag1 < tag2) ? tag1 : tag2;
+	uint32_t hi = (tag1 < tag2) ? tag2 : tag1;
+	uint32_t h = ((lo << 16) | hi) * 2654435761u;	// multiplicative hashing
+	return (h >> 16) % shards;
+}
+
+
+//==========================================================
+/// Writes interactions to a binary or a CSV file through a buffer
+class InteractionWriter{
+
+	public:
+		InteractionWriter();
+		~InteractionWriter();
+
+		/**\brief Creates the output file and writes its header
+		 * \param filename Name of the file to create
+		 * \param binary True to write the binary format, false to write CSV
+		 * \param flags Optional columns of the records (INTERACTION_DIRECTION, INTERACTION_FROM_TO)
+		 */
+		void open(const string& filename, const bool binary, const uint32_t flags);
+
+		/**\brief Sets the size of the output buffer (1 MB by default), before open
+		 * \param bytes Size in bytes
+		 */
+		void set_buffer_size(const size_t bytes);
+
+		/**\brief Adds an interaction to the file
+		 * \param r Interaction to write
+		 */
+		void write(const interaction_record& r);
+
+		/**\brief Writes the buffered interactions, updates the number of records in the header and closes the file.
+		 * Must be called to detect the write errors: the destructor closes the file without throwing
+		 */
+		void close();
+
+		/**\brief Returns the number of interactions written so far
+		 * \return Number of interactions
+		 */
+		uint64_t get_count() const;
+
+	private:
+		/**\brief Writes the content of the buffer to the file
+		 */
+		void flush();
+
+		ofstream f;					///< output stream
+		string name;				///< name of the file
+		bool binary;				///< true if the file is in binary format
+		uint32_t flags;				///< optional columns
+		uint64_t count;				///< number of records written
+		vector <char> buffer;		///< output buffer
+		size_t buffer_size;			///< size of the output buffer in bytes
+		size_t used;				///< number of bytes used in buffer
+};
+
+
+//==========================================================
+/// Reads interactions from a binary or a CSV file
+class InteractionReader{
+
+	public:
+		InteractionReader();
+		~InteractionReader();
+
+		/**\brief Opens an interaction file and recognizes its format
+		 * \param filename Name of the file to read
+		 */
+		void open(const string& filename);
+
+		/**\brief Sets the size of the input buffer of binary files (1 MB by default), before open
+		 * \param bytes Size in bytes
+		 */
+		void set_buffer_size(const size_t bytes);
+
+		/**\brief Reads the next interaction of the file
+		 * \param r Record into which the interaction is read
+		 * \return True if an interaction was read, false at the end of the file
+		 */
+		bool read(interaction_record& r);
+
+		/**\brief Closes the file
+		 */
+		void close();
+
+		/**\brief Tests whether the file is in the binary format
+		 * \return True for a binary file, false for a CSV file
+		 */
+		bool is_binary() const;
+
+		/**\brief Returns the optional columns of the file (for CSV files, deduced from the first line)
+		 * \return Combination of INTERACTION_DIRECTION and INTERACTION_FROM_TO
+		 */
+		uint32_t get_flags() const;
+
+		/**\brief Returns the number of interactions of a binary file, known when it is opened
+		 * \return Number of interactions, 0 for a CSV file
+		 */
+		uint64_t get_count() const;
+
+	private:
+		/**\brief Fills the buffer with the next bytes of the file
+		 * \return True if bytes were read
+		 */
+		bool fill();
+
+		/**\brief Parses the current CSV line into a record
+		 * \param r Record to fill
+		 * \return True if the line contains an interaction, false if it is a header or an empty line
+		 */
+		bool parse_line(interaction_record& r);
+
+		ifstream f;					///< input stream of binary files
+		CsvReader csv;				///< reader of CSV files
+		string name;				///< name of the file
+		bool binary;				///< true if the file is in binary format
+		uint32_t flags;				///< optional columns
+		uint64_t count;				///< number of binary records in the file
+		uint64_t remaining;			///< number of binary records still to read
+		vector <char> buffer;		///< input buffer for binary records
+		size_t buffer_size;			///< size of the input buffer in bytes
+		size_t pos;					///< position of the next record in buffer
+		size_t filled;				///< number of bytes in buffer
+};
+
+#endif //__interaction_file__
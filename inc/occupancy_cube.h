@@ -0,0 +1,142 @@
+#ifndef OCCUPANCY_CUBE_H
+#define OCCUPANCY_CUBE_H
+
+/*
+ *  occupancy_cube.h
+ *  Space-time occupancy cube of a box: for each heatmap (colony, group or ant) and each fixed time bin, the number of
+ *  detections in each cell of the heatmap grid since the start of the cube (cumulative sums). The heatmap of any interval
+ *  whose limits are on the bins is the difference of two slices, without reading the dat file again.
+ *
+ *  Copyright UNIL. All rights reserved.
+ *
+ */
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "trackcvt.h"
+
+using namespace std;
+
+const int HEATMAP_REDUCTION = 5;	///< pixels of the image per cell of the heatmaps
+const int HEATMAP_X = IMAGE_WIDTH / HEATMAP_REDUCTION;
+const int HEATMAP_Y = IMAGE_HEIGHT / HEATMAP_REDUCTION;
+const int HEATMAP_SIZE = HEATMAP_X * HEATMAP_Y;
+
+const char CUBE_MAGIC[8] = {'A','T','R','K','C','U','B','\0'};	///< first 8 bytes of a cube file
+const uint32_t CUBE_VERSION = 1;		///< version of the cube format
+
+const char CUBE_COLONY = 'c';		///< type of the heatmap of all ants
+const char CUBE_GROUP = 'g';		///< type of the heatmap of a group of the tags file
+const char CUBE_ANT = 'a';			///< type of the heatmap of an ant
+
+/// header of a cube file (48 bytes), followed by the descriptions of the layers and by the slices
+struct cube_header{
+	char magic[8];			///< CUBE_MAGIC
+	uint32_t version;		///< CUBE_VERSION
+	uint32_t box;			///< box of the detections
+	uint32_t width;			///< HEATMAP_X
+	uint32_t height;		///< HEATMAP_Y
+	uint32_t layers;		///< number of heatmaps
+	uint32_t bins;			///< number of time bins, there are bins + 1 slices
+	double start;			///< unix time of the start of the first bin
+	double bin;				///< duration of a bin in seconds
+};
+
+/// description of a layer (heatmap) of a cube (32 bytes)
+struct cube_layer{
+	char type;				///< CUBE_COLONY, CUBE_GROUP or CUBE_ANT
+	char name[31];			///< group or tag ID, 0-terminated (empty for the colony)
+};
+
+//==========================================================
+/// Occupancy cube file. Slice k of a layer holds, for each cell (row by row), the detections with a time before
+/// start + k * bin, stored as uint32; slice 0 is empty. The slices are ordered by time, then by layer.
+class OccupancyCube{
+
+public:
+  OccupancyCube();
+  ~OccupancyCube();
+
+  /**\brief Creates a cube file of empty slices, the file must not exist. The cube can only be opened once finish is called
+   * \param filename Name of the file
+   * \param box Box of the detections
+   * \param start Unix time of the start of the first bin
+   * \param bin Duration of a bin in seconds
+   * \param bins Number of bins
+   * \param layers Heatmaps of the cube
+   */
+  void create(const string& filename, int box, double start, double bin, int bins, const vector <cube_layer>& layers);
+
+  /// Writes the magic number of the header once all the slices are written
+  void finish();
+
+  /**\brief Opens an existing cube file to read the slices
+   * \param filename Name of the file
+   */
+  void open(const string& filename);
+
+  /// Closes the file
+  void close();
+
+  /**\brief Reads a slice of a layer
+   * \param k Index of the slice (0 to bins)
+   * \param layer Index of the layer
+   * \param cells HEATMAP_SIZE counts
+   */
+  void read_slice(int k, int layer, uint32_t* cells) const;
+
+  /**\brief Writes a slice of a layer, several threads can write different slices at the same time
+   * \param k Index of the slice (0 to bins)
+   * \param layer Index of the layer
+   * \param cells HEATMAP_SIZE counts
+   */
+  void write_slice(int k, int layer, const uint32_t* cells) const;
+
+  /**\brief Gets the index of the slice of a time, which must be on the limit of a bin of the cube
+   * \param time Unix time
+   * \return Index of the slice, -1 if the time is not on a limit of a bin of the cube
+   */
+  int get_slice(double time) const;
+
+  /**\brief Computes the heatmap of an interval as the difference of two slices
+   * \param layer Index of the layer
+   * \param from Slice of the start of the interval
+   * \param to Slice of the end of the interval (excluded)
+   * \param heatmap HEATMAP_SIZE counts
+   * \return True if there is data in the heatmap
+   */
+  bool get_heatmap(int layer, int from, int to, int* heatmap) const;
+
+  /**\brief Finds a layer
+   * \param type CUBE_COLONY, CUBE_GROUP or CUBE_ANT
+   * \param name Group or tag ID (empty for the colony)
+   * \return Index of the layer, -1 if the cube has no such layer
+   */
+  int find_layer(char type, const string& name) const;
+
+  int get_box() const {return header.box;}
+  double get_start() const {return header.start;}
+  double get_bin() const {return header.bin;}
+  int get_bins() const {return header.bins;}
+  /// Unix time of the end of the last bin
+  double get_end() const {return header.start + header.bin * header.bins;}
+  int get_layer_count() const {return layers.size();}
+  const cube_layer& get_layer(int i) const {return layers[i];}
+
+private:
+  // a cube owns its file descriptor, it cannot be copied
+  OccupancyCube(const OccupancyCube&);
+  OccupancyCube& operator= (const OccupancyCube&);
+
+  /// Position of a slice of a layer in the file
+  uint64_t slice_offset(int k, int layer) const;
+
+  int fd;								///< file descriptor, -1 if closed
+  string filename;
+  cube_header header;
+  vector <cube_layer> layers;
+  uint64_t data_offset;					///< position of the first slice
+};
+
+#endif //OCCUPANCY_CUBE_H
@@ -0,0 +1,254 @@
+/*
+ *  pair_table.h
+ *  --> stores records (e.g. interactions) by pair of ants, for the pairs that have records only:
+ *		the pairs are found with an open-addressing hash table keyed on the pair (smallest index first),
+ *		and the records are kept in one contiguous array, grouped by pair in place once all records were added.
+ *		Each record is stored once, whatever the order of the 2 ants in it.
+ *
+ *  Copyright UNIL. All rights reserved.
+ *
+ */
+
+#ifndef __pair_table__
+#define __pair_table__
+
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+#include <utility>
+#include "exception.h"
+
+using namespace std;
+
+/// records of one pair of ants, in the order in which they were added
+template <typename T>
+struct pair_records{
+	T* data;		///< first record
+	size_t n;		///< number of records
+	T& operator[] (const size_t i) const{
+		return data[i];
+	}
+	size_t size() const{
+		return n;
+	}
+	bool empty() const{
+		return n == 0;
+	}
+};
+
+
+//==========================================================
+/// Sparse table of records by pair of ants
+template <typename T>
+class PairTable{
+
+	public:
+		PairTable(){
+			slots.assign(1024, 0);
+			bits = 10;
+			built = false;
+		}
+
+		/**\brief Adds a record to a pair. Records cannot be added after build()
+		 * \param idx1 Index of the first ant (e.g. in tag_list), below 65536
+		 * \param idx2 Index of the second ant
+		 * \param r Record
+		 */
+		void add(const int idx1, const int idx2, const T& r){
+			if (built){
+				throw Exception(INTERNAL_ERROR, "Record added to a pair table after it was built.");
+			}
+			uint32_t h = find_slot(make_key(idx1, idx2));
+			uint32_t p;
+			if (slots[h] == 0){
+				keys.push_back(make_key(idx1, idx2));
+				counts.push_back(0);
+				p = keys.size() - 1;
+				slots[h] = p + 1;
+				// the table is kept at most half full
+				if (2 * keys.size() > slots.size()){
+					grow();
+				}
+			}else{
+				p = slots[h] - 1;
+			}
+			counts[p]++;
+			arena.push_back(r);
+			owner.push_back(p);
+		}
+
+		/**\brief Reserves the memory of the records, before they are added
+		 * \param n Number of records
+		 */
+		void reserve(const size_t n){
+			arena.reserve(n);
+			owner.reserve(n);
+		}
+
+		/**\brief Groups the records by pair, the pairs are then sorted by their first, then second index
+		 */
+		void build(){
+			if (arena.size() > UINT32_MAX){
+				throw Exception(INTERNAL_ERROR, "Too many records in a pair table.");
+			}
+			// order of the pairs
+			vector <uint32_t> order (keys.size());
+			for (uint32_t i(0); i < order.size(); i++){
+				order[i] = i;
+			}
+			sort(order.begin(), order.end(), key_order(keys));
+			vector <uint32_t> rank (keys.size());
+			offsets.assign(keys.size() + 1, 0);
+			vector <uint32_t> sorted_keys (keys.size());
+			for (uint32_t i(0); i < order.size(); i++){
+				rank[order[i]] = i;
+				sorted_keys[i] = keys[order[i]];
+				offsets[i + 1] = offsets[i] + counts[order[i]];
+			}
+
+			// position of each record once grouped (records of a pair in the order they were added), kept in owner
+			vector <size_t> next (offsets.begin(), offsets.end() - 1);
+			for (size_t i(0); i < owner.size(); i++){
+				owner[i] = next[rank[owner[i]]]++;
+			}
+			vector <size_t>().swap(next);
+
+			// the records are moved to their position in place, following the cycles of the permutation
+			for (size_t i(0); i < arena.size(); i++){
+				while (owner[i] != i){
+					uint32_t j = owner[i];
+					swap(arena[i], arena[j]);
+					swap(owner[i], owner[j]);
+				}
+			}
+			vector <uint32_t>().swap(owner);
+			vector <uint32_t>().swap(counts);
+			keys.swap(sorted_keys);
+			for (uint32_t h(0); h < slots.size(); h++){
+				if (slots[h] != 0){
+					slots[h] = rank[slots[h] - 1] + 1;
+				}
+			}
+			built = true;
+		}
+
+		/**\brief Returns the number of pairs that have records
+		 * \return Number of pairs
+		 */
+		size_t pair_count() const{
+			return keys.size();
+		}
+
+		/**\brief Returns the index of the first ant (smallest index) of a pair
+		 * \param p Number of the pair, between 0 and pair_count() - 1
+		 * \return Index of the ant
+		 */
+		int first(const size_t p) const{
+			return keys[p] >> 16;
+		}
+
+		/**\brief Returns the index of the second ant (largest index) of a pair
+		 * \param p Number of the pair
+		 * \return Index of the ant
+		 */
+		int second(const size_t p) const{
+			return keys[p] & 0xFFFF;
+		}
+
+		/**\brief Returns the records of a pair, the table must be built
+		 * \param p Number of the pair
+		 * \return Records of the pair
+		 */
+		pair_records <T> operator[] (const size_t p){
+			pair_records <T> r = {&arena[0] + offsets[p], offsets[p + 1] - offsets[p]};
+			return r;
+		}
+
+		/**\brief Looks up the records of a pair of ants, the table must be built
+		 * \param idx1 Index of the first ant
+		 * \param idx2 Index of the second ant
+		 * \return Records of the pair (none if the ants have no record)
+		 */
+		pair_records <T> find(const int idx1, const int idx2){
+			uint32_t h = find_slot(make_key(idx1, idx2));
+			if (slots[h] == 0){
+				pair_records <T> r = {NULL, 0};
+				return r;
+			}
+			return (*this)[slots[h] - 1];
+		}
+
+		/**\brief Returns the number of records
+		 * \return Number of records
+		 */
+		size_t size() const{
+			return arena.size();
+		}
+
+		/**\brief Removes all records and frees the memory
+		 */
+		void clear(){
+			vector <uint32_t> (1024, 0).swap(slots);
+			bits = 10;
+			vector <uint32_t>().swap(keys);
+			vector <uint32_t>().swap(counts);
+			vector <uint32_t>().swap(owner);
+			vector <size_t>().swap(offsets);
+			vector <T>().swap(arena);
+			built = false;
+		}
+
+	private:
+		/// compares the pairs by key
+		struct key_order{
+			const vector <uint32_t>& keys;
+			key_order(const vector <uint32_t>& k): keys(k){}
+			bool operator() (const uint32_t a, const uint32_t b) const{
+				return keys[a] < keys[b];
+			}
+		};
+
+		/**\brief Key of a pair: smallest index in the high 16 bits, largest index in the low 16 bits
+		 * \param idx1 Index of the first ant
+		 * \param idx2 Index of the second ant
+		 * \return Key
+		 */
+		static uint32_t make_key(const int idx1, const int idx2){
+			return (idx1 < idx2) ? ((uint32_t) idx1 << 16 | idx2) : ((uint32_t) idx2 << 16 | idx1);
+		}
+
+		/**\brief Finds the slot of a key, or the empty slot where it would be inserted (linear probing)
+		 * \param key Key of the pair
+		 * \return Index of the slot
+		 */
+		uint32_t find_slot(const uint32_t key) const{
+			uint32_t mask = slots.size() - 1;
+			uint32_t h = (key * 2654435761u) >> (32 - bits);
+			while (slots[h] != 0 && keys[slots[h] - 1] != key){
+				h = (h + 1) & mask;
+			}
+			return h;
+		}
+
+		/**\brief Doubles the number of slots and inserts the pairs again
+		 */
+		void grow(){
+			bits++;
+			slots.assign(1 << bits, 0);
+			for (uint32_t p(0); p < keys.size(); p++){
+				slots[find_slot(keys[p])] = p + 1;
+			}
+		}
+
+		vector <uint32_t> slots;		///< number of the pair + 1 in each slot of the hash table, 0 for an empty slot
+		int bits;						///< log2 of the number of slots
+		vector <uint32_t> keys;			///< key of each pair (first index << 16 | second index)
+		vector <uint32_t> counts;		///< number of records of each pair, until build()
+		vector <uint32_t> owner;		///< pair of each record, until build()
+		vector <size_t> offsets;		///< first record of each pair in arena, after build()
+		vector <T> arena;				///< records, grouped by pair after build()
+		bool built;						///< true once build() was called
+};
+
+#endif //__pair_table__
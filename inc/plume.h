@@ -12,7 +12,8 @@
 
 #include <string>
 #include <iostream>
-#include <map>
+#include <vector>
+#include <stdint.h>
 #include "trackcvt.h"
 #include "utils.h"
 
@@ -20,7 +21,77 @@ using namespace std;
 
 const int NUMBER_LINES_COLOR = 6;
 
-typedef map <position,double, position_compare> lut_type;
+const int REDUCED_W = 608;		///< width of the plume bitmap (image width / 5)
+const int REDUCED_H = 912;		///< height of the plume bitmap (image height / 5)
+const int REDUCED_SIZE = REDUCED_W * REDUCED_H;
+
+const char LUT_MAGIC[8] = {'A','T','R','K','L','U','T','\0'};	///< first 8 bytes of a binary LUT file
+const uint32_t LUT_VERSION = 1;		///< version of the binary LUT format
+
+/// header of a binary LUT file (128 bytes), followed by REDUCED_SIZE floats (row by row) that can be mapped into memory
+struct lut_header{
+	char magic[8];				///< LUT_MAGIC
+	uint32_t version;			///< LUT_VERSION
+	uint32_t code;				///< code of the zone
+	uint32_t width;				///< REDUCED_W
+	uint32_t height;			///< REDUCED_H
+	int32_t firstframe;			///< first frame of validity of the plume file
+	int32_t lastframe;			///< last frame of validity of the plume file
+	uint64_t zone_hash;			///< hash of the cells of the zone in the bitmap (Plume::zone_hash)
+	char zone[88];				///< name of the zone, 0-terminated
+};
+
+//==========================================================
+/// Distances from each cell of the plume bitmap to a zone, in image pixels, stored densely (row by row).
+/// The values are either owned or mapped from a binary LUT file.
+class ZoneLUT{
+
+public:
+  ZoneLUT();
+  ~ZoneLUT();
+
+  /// Gets the distance of a cell of the bitmap
+  /// \param x Column of the cell (image x / 5)
+  /// \param y Row of the cell (image y / 5)
+  float operator() (const int x, const int y) const{
+    return data[x + y * REDUCED_W];
+  }
+
+  /// Gets the distance of a position in the image
+  /// \param p Position in image coordinates
+  float get_distance(const position& p) const{
+    int x = min(p.x / 5, REDUCED_W - 1);
+    int y = min(p.y / 5, REDUCED_H - 1);
+    return data[x + y * REDUCED_W];
+  }
+
+  /// Gets the REDUCED_SIZE distances, row by row
+  const float* get_data() const;
+
+  /// Replaces the distances by owned values
+  /// \param values REDUCED_SIZE distances, row by row
+  void assign(const vector <float>& values);
+
+  /// Maps the distances of a binary LUT file
+  /// \param fd Descriptor of the file
+  /// \param size Size of the file
+  /// \param offset Position of the distances in the file
+  void map_file(const int fd, const size_t size, const size_t offset);
+
+  /// Releases the distances
+  void clear();
+
+private:
+  ZoneLUT(const ZoneLUT&);
+  ZoneLUT& operator= (const ZoneLUT&);
+
+  vector <float> values;	///< owned distances
+  const float* data;		///< distances (owned or mapped)
+  void* mapping;			///< mapped file, NULL if the distances are owned
+  size_t mapping_size;		///< size of the mapped file
+};
+
+typedef ZoneLUT lut_type;
 
 class Plume{
 
@@ -57,8 +128,10 @@ public:
 	//========================================================================
 	/**\fn void init_LUT(int code)
 	 * \brief Inits the look-up table with distances between the brood and any position in the image.
+	 *        The LUT has one entry per cell of the bitmap (image coordinates divided by 5): the exact Euclidean distance in image pixels
+	 *        to the nearest cell of the zone, computed with a linear time distance transform.
 	 * \param code Code of the zone to which the distance will be calculated
-	 * \return True if the code is valid and the LUT has been initialized, false if not
+	 * \return True if the code is valid and the LUT has been initialized, false if not (also if the zone is empty)
 	 */
 	bool init_LUT(const int code);
 
@@ -112,9 +185,24 @@ public:
 	int exists(string codename);
   
   //========================================================================
+  /// Computes a hash (FNV-1a) of the cells of a zone in the bitmap, stored in the LUT files to detect LUTs of another bitmap
+  /// \param code Code of the zone
+  /// \return Hash of the zone
+  uint64_t zone_hash(const int code);
+
+  //========================================================================
+  /// Tests whether a file is a binary LUT of a zone that is up to date: same code, name and cells of the zone, covering the validity of the plume file
+  /// \param filename Name of the LUT file
+  /// \param code Code of the zone
+  /// \return True if the file does not need to be built again, false otherwise (also if it does not exist)
+  bool LUT_file_matches(const string filename, const int code);
+
+  //========================================================================
+  /// Loads a LUT: binary files (LUT_MAGIC) are mapped into memory, files in the former text header format ("# ZoneLUT" followed by doubles) are read
   bool load_LUT(const string filename, const int code);
   bool load_LUT(const string filename, const string zonename);
   
+  /// Saves a LUT in the binary format
   bool save_LUT(const string filename, const int code);
   bool save_LUT(const string filename, const string zonename);
   
@@ -169,4 +257,77 @@ private:
 	bool LUT_state[NUMBER_LINES_COLOR]; ///< are the LUTs valid?
 };
 
+
+const int LUT_BUILT = 1;		///< the LUT was built and saved
+const int LUT_SKIPPED = 2;		///< the LUT file was already up to date
+const int LUT_EMPTY = 3;		///< the zone has no cell, there is no LUT
+
+/// LUT of a zone of a plume file to build and save
+struct lut_task{
+	Plume* plume;			///< plume file, its bitmap is only read
+	int code;				///< code of the zone
+	string filename;		///< name of the LUT file
+	int status;				///< result: LUT_BUILT, LUT_SKIPPED or LUT_EMPTY
+};
+
+/**\fn void build_LUT_files(vector <lut_task>& tasks, const int threads)
+ * \brief Builds and saves the LUTs of several zones and plume files, the tasks are distributed dynamically between the threads.
+ *        A LUT is not built again if its file is up to date (Plume::LUT_file_matches). Each LUT is released once it is saved.
+ * \param tasks LUTs to build, their status is set
+ * \param threads Number of threads
+ */
+void build_LUT_files(vector <lut_task>& tasks, const int threads);
+
+
+//==========================================================
+/// Plume files of the successive periods of an experiment (e.g. before and after the nest was rearranged), sorted by first frame:
+/// a scan of the frames switches to the plume file (bitmap and LUTs) valid at each frame.
+class PlumeSchedule{
+
+public:
+  PlumeSchedule();
+  ~PlumeSchedule();
+
+  //========================================================================
+  /**\fn void read(const string& plumefiles)
+   * \brief Reads the plume files of a list
+   * \param plumefiles Names of the plume files separated by commas, in any order. Their validities cannot overlap (PARAMETER_ERROR)
+   */
+  void read(const string& plumefiles);
+
+  /// Gets the number of plume files
+  int size() const;
+
+  /// Gets a plume file, by increasing first frame
+  /// \param i Index of the plume file
+  Plume& operator[] (const int i);
+
+  /// Gets the name of a plume file
+  /// \param i Index of the plume file
+  const string& get_filename(const int i) const;
+
+  /// Gets the first frame of validity of the first plume file
+  int get_firstframe() const;
+  /// Gets the last frame of validity of the last plume file
+  int get_lastframe() const;
+
+  //========================================================================
+  /**\fn int find(const int frame, int& cursor) const
+   * \brief Finds the plume file valid at a frame. Scans of increasing frames find it in constant time
+   * \param frame Frame
+   * \param cursor Index of the plume file found for the previous frame of the scan, -1 at the start of the scan. Each scan (thread) has its own cursor
+   * \return Index of the plume file, -1 if no plume file is valid at the frame
+   */
+  int find(const int frame, int& cursor) const;
+
+private:
+  PlumeSchedule(const PlumeSchedule&);
+  PlumeSchedule& operator= (const PlumeSchedule&);
+
+  vector <Plume*> plumes;		///< plume files, by increasing first frame
+  vector <string> filenames;	///< names of the plume files
+  vector <int> firstframes;	///< first frame of validity of each plume file
+  vector <int> lastframes;	///< last frame of validity of each plume file
+};
+
 #endif // PLUME_H
@@ -27,6 +27,7 @@
 #include "exception.h"
 #include "tags3.h"
 #include "utils.h"
+#include "csv_file.h"
 
 
 
@@ -156,13 +157,13 @@ inline double round2(double x);
 bool find_index(int tag, int& idx);
 
 //==========================================================
-/**\fn bool parse_line(string& s, line& temp)
- * \brief Parses a line from the csv input file, stores information in line structure 
- * \param s String containing a line (information from 1 frame) from the csv input file
+/**\fn bool parse_line(CsvReader& f, line& temp)
+ * \brief Parses the current line of the csv input file, stores information in line structure 
+ * \param f Reader of the csv input file, positioned on a line (information from 1 frame)
  * \param temo Line structure to store the information from a frame temporally
  * \return True if the reading of the line was a success, false otherwise
  */
-bool parse_line(string& s, line& temp);
+bool parse_line(CsvReader& f, line& temp);
 
 //==========================================================
 /**\fn double dist(const position& p1, const position& p2)
@@ -184,12 +185,12 @@ void convert(double& a);
 //==========================================================
 /**\fn void convert(double& a)
  * \brief Reads a line from the csv input, extracts frame number, timestamp, nb segments and nb tags detected
- * \param f Input stream
+ * \param f Reader of the csv input
  * \param current Timestamp containing frame number and UNIX timestamp
  * \param segments Number of segments analyzed in image
  * \return True if reading was successful 
  */
-bool read_line(ifstream& f, frameline& my_frame, map<int,bool>& frames,list <timestamp>& frames_read, timestamp& my_current);
+bool read_line(CsvReader& f, frameline& my_frame, map<int,bool>& frames,list <timestamp>& frames_read, timestamp& my_current);
 
 //==========================================================
 /**\fn void update_filelist_limits(vector <info>& filelist, const timestamp& current, int& lastframe, int& firstframe, bool& first)
@@ -30,6 +30,19 @@
 using namespace std;
 
 const double DOUBLE_MAX = 1.79769e+308;  /// biggest number possible in double
+const int CENTIDEGREES = 36000;  /// number of centidegrees in a full turn (tag_pos::a is in centidegrees)
+
+/// sine and cosine of an angle
+struct trig_value{
+	double s;
+	double c;
+};
+
+const int TRIG_MIN = -18000;  /// smallest angle of trig_table in centidegrees
+const int TRIG_MAX = 27000;  /// largest angle of trig_table in centidegrees (rotations by 90-a reach 270deg)
+
+/// sine and cosine of the angles TRIG_MIN to TRIG_MAX centidegrees (index 0 is TRIG_MIN), filled when the library is loaded
+alignas(64) extern trig_value trig_table[TRIG_MAX - TRIG_MIN + 1];
 
 struct position{
 	int x;
@@ -47,7 +60,7 @@ public:
 	 * \param b Position of brood with key value 2
 	 * \return True if the key value 1 is smaller than the key value 2
 	 */
-	bool operator() (const position& a, const position& b);
+	bool operator() (const position& a, const position& b) const;
 };
 
 //========================================================================
@@ -100,12 +113,61 @@ int angledifference(int a1, int a2);
 float limit_angle(float a);
 
 
-/**\fn double average_direction(vector <double> angles)
+/**\fn double average_direction(const vector <double>& angles)
  * \brief calculate the average angle (direction) in degrees betweem -180deg and 180deg
  * \param angles Vector containing angles with directions
  * \return Average direction
  */
-double average_direction(vector <double> angles);
+double average_direction(const vector <double>& angles);
+
+
+/**\fn inline const trig_value& trig_centidegree(int a)
+ * \brief Looks up the sine and cosine of an angle in trig_table
+ * \param a Angle in centidegrees (any value, angles outside of the table are brought back to -180deg..180deg)
+ * \return Sine and cosine of the angle, equal to sin(a/100.0 * M_PI/180) and cos(a/100.0 * M_PI/180) for a between TRIG_MIN and TRIG_MAX
+ */
+inline const trig_value& trig_centidegree(int a){
+	if (a < TRIG_MIN || a > TRIG_MAX){
+		a = (a - TRIG_MIN) % CENTIDEGREES;
+		if (a < 0){
+			a += CENTIDEGREES;
+		}
+		a += TRIG_MIN;
+	}
+	return trig_table[a - TRIG_MIN];
+}
+
+/**\fn inline double sin_centidegree(int a)
+ * \brief Sine of an angle in centidegrees, from trig_table
+ * \param a Angle in centidegrees
+ * \return Sine of the angle
+ */
+inline double sin_centidegree(int a){
+	return trig_centidegree(a).s;
+}
+
+/**\fn inline double cos_centidegree(int a)
+ * \brief Cosine of an angle in centidegrees, from trig_table
+ * \param a Angle in centidegrees
+ * \return Cosine of the angle
+ */
+inline double cos_centidegree(int a){
+	return trig_centidegree(a).c;
+}
+
+/**\fn inline trig_value trig_degree(double a)
+ * \brief Sine and cosine of an angle in degrees, read from trig_table when the angle is a whole number of centidegrees
+ * \param a Angle in degrees
+ * \return Sine and cosine of the angle
+ */
+inline trig_value trig_degree(double a){
+	double c = floor(a * 100 + 0.5);
+	if (fabs(a * 100 - c) < 1e-6){
+		return trig_centidegree((int) c);
+	}
+	trig_value t = {sin(a * M_PI / 180), cos(a * M_PI / 180)};
+	return t;
+}
 
 
 
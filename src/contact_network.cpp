@@ -0,0 +1,186 @@
+/*
+ *  contact_network.cpp
+ *
+ *  Copyright UNIL. All rights reserved.
+ *
+ */
+
+#include <iostream>
+#include <cmath>
+#include <algorithm>
+#include "contact_network.h"
+#include "utils.h"
+
+const int RECENT_FRAMES = 31;	///< number of intervals between frames of which the median is the nominal interval
+
+
+//==================== ContactNetwork ========================================
+ContactNetwork::ContactNetwork(const double w, const bool d){
+	window = w;
+	durations = d;
+	index.assign(65536, -1);
+	for (int i(0); i < tag_count; i++){
+		index[tag_list[i]] = i;
+	}
+	start = 0;
+	last_time = 0;
+	next_dt = 0;
+	current = 0;
+	started = false;
+	windows = 0;
+}
+
+ContactNetwork::~ContactNetwork(){
+}
+
+//============================================================================
+void ContactNetwork::open(const string& filename, const vector <int>& t){
+	name = filename;
+	tags = t;
+	position.assign(tag_count, -1);
+	for (int i(0); i < tags.size(); i++){
+		position[tags[i]] = i;
+	}
+	g.open(filename.c_str());
+	if (!g.is_open()){
+		throw Exception(CANNOT_OPEN_FILE, filename);
+	}
+	g<<"Window,Start,Stop,File,Pairs,Weight\n";
+}
+
+//============================================================================
+void ContactNetwork::next_frame(const uint32_t frame, const double time){
+	if (!started){
+		start = time;
+		started = true;
+	}else{
+		if (time < last_time){
+			throw Exception(DATA_ERROR, "Frames are not in time order (frame " + to_string(frame) + ").");
+		}
+		double dt = time - last_time;
+		double nominal = nominal_dt();
+		add_durations(nominal < 0 ? dt : min(dt, nominal));
+		if (recent_dt.size() < RECENT_FRAMES){
+			recent_dt.push_back(dt);
+		}else{
+			recent_dt[next_dt] = dt;
+			next_dt = (next_dt + 1) % RECENT_FRAMES;
+		}
+	}
+	last_pairs.clear();
+	last_time = time;
+
+	// writes the windows that are over, including empty ones, so that window n always starts at start + (n-1) * window
+	int w = (int) floor((time - start) / window);
+	while (current < w){
+		write_window();
+		current++;
+	}
+}
+
+//============================================================================
+void ContactNetwork::write(const interaction_record& r){
+	if (!started){
+		throw Exception(DATA_ERROR, "Interaction given before its frame.");
+	}
+	int idx1 = index[r.tag1];
+	int idx2 = index[r.tag2];
+	if (idx1 == -1){
+		throw Exception(TAG_NOT_FOUND, to_string(r.tag1));
+	}
+	if (idx2 == -1){
+		throw Exception(TAG_NOT_FOUND, to_string(r.tag2));
+	}
+	uint32_t p = (idx1 < idx2) ? idx1 * tag_count + idx2 : idx2 * tag_count + idx1;
+	if (durations){
+		// the duration of the frame is only known when the next frame starts
+		last_pairs.push_back(p);
+		weights[p];
+	}else{
+		weights[p] += 1;
+	}
+}
+
+//============================================================================
+void ContactNetwork::add_durations(double dt){
+	// the frame belongs to the current window, its duration is not carried into the next one
+	dt = min(dt, start + (current + 1) * window - last_time);
+	for (int i(0); i < last_pairs.size(); i++){
+		weights[last_pairs[i]] += dt;
+	}
+}
+
+//============================================================================
+double ContactNetwork::nominal_dt() const{
+	if (recent_dt.empty()){
+		return -1;
+	}
+	vector <double> sorted (recent_dt);
+	nth_element(sorted.begin(), sorted.begin() + sorted.size() / 2, sorted.end());
+	return sorted[sorted.size() / 2];
+}
+
+//============================================================================
+void ContactNetwork::write_window(){
+	string file = name + "_" + to_string(current + 1);
+	ifstream h;
+	h.open(file.c_str());
+	if (h.is_open()){
+		h.close();
+		throw Exception(OUTPUT_EXISTS, file);
+	}
+	ofstream m;
+	m.open(file.c_str());
+	if (!m.is_open()){
+		throw Exception(CANNOT_OPEN_FILE, file);
+	}
+
+	// edges of the pairs that interacted, in the order of the ants
+	vector <pair <pair <int, int>, double> > edges;
+	edges.reserve(weights.size());
+	double total (0);
+	for (unordered_map <uint32_t, double>::const_iterator it = weights.begin(); it != weights.end(); it++){
+		int r = position[it->first / tag_count];
+		int c = position[it->first % tag_count];
+		if (r == -1 || c == -1){
+			throw Exception(TAG_NOT_FOUND, to_string(tag_list[r == -1 ? it->first / tag_count : it->first % tag_count]));
+		}
+		edges.push_back(make_pair(make_pair(min(r, c), max(r, c)), it->second));
+		total += it->second;
+	}
+	sort(edges.begin(), edges.end());
+
+	m.precision(12);
+	m<<"Tag1,Tag2,Weight\n";
+	for (int i(0); i < edges.size(); i++){
+		m<<tag_list[tags[edges[i].first.first]]<<","<<tag_list[tags[edges[i].first.second]]<<","<<edges[i].second<<"\n";
+	}
+	m.close();
+	if (m.fail()){
+		throw Exception(CANNOT_WRITE_FILE, file);
+	}
+
+	g.precision(12);
+	g<<current + 1<<","<<start + current * window<<","<<start + (current + 1) * window<<","<<file<<","<<weights.size()<<","<<total<<"\n";
+	if (g.fail()){
+		throw Exception(CANNOT_WRITE_FILE, name);
+	}
+	weights.clear();
+	windows++;
+}
+
+//============================================================================
+void ContactNetwork::close(){
+	if (started){
+		// the last frame is given the nominal interval between frames
+		add_durations(max(nominal_dt(), 0.0));
+		last_pairs.clear();
+		write_window();
+	}
+	g.close();
+}
+
+//============================================================================
+int ContactNetwork::get_window_count() const{
+	return windows;
+}
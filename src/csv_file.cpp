@@ -0,0 +1,255 @@
+/*
+ *  csv_file.cpp
+ *
+ *  Copyright UNIL. All rights reserved.
+ *
+ */
+
+#include <cstring>
+#include <climits>
+#include <charconv>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "csv_file.h"
+#include "utils.h"
+
+
+//==================== CsvReader =============================================
+CsvReader::CsvReader(){
+	delimiter = ',';
+	fd = -1;
+	data = NULL;
+	size = 0;
+	next = NULL;
+	begin = NULL;
+	end = NULL;
+	p = NULL;
+	first = true;
+	line = 0;
+}
+
+CsvReader::~CsvReader(){
+	close();
+}
+
+//============================================================================
+void CsvReader::open(const string& filename, const char d){
+	close();
+	name = filename;
+	delimiter = d;
+	fd = ::open(filename.c_str(), O_RDONLY);
+	if (fd == -1){
+		throw Exception(CANNOT_OPEN_FILE, filename);
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0){
+		close();
+		throw Exception(CANNOT_READ_FILE, filename);
+	}
+	size = st.st_size;
+	// an empty file cannot be mapped, it has no line
+	if (size > 0){
+		void* m = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (m == MAP_FAILED){
+			close();
+			throw Exception(CANNOT_READ_FILE, filename);
+		}
+		madvise(m, size, MADV_SEQUENTIAL);
+		data = (const char*) m;
+	}
+	next = data;
+	begin = end = p = data;
+	first = true;
+	line = 0;
+}
+
+//============================================================================
+bool CsvReader::next_line(){
+	if (eof()){
+		return false;
+	}
+	begin = next;
+	const char* stop = data + size;
+	const char* nl = (const char*) memchr(begin, '\n', stop - begin);
+	if (nl == NULL){
+		end = stop;
+		next = stop;
+	}else{
+		end = nl;
+		next = nl + 1;
+	}
+	if (end > begin && *(end - 1) == '\r'){
+		end--;
+	}
+	p = begin;
+	first = true;
+	line++;
+	return true;
+}
+
+//============================================================================
+bool CsvReader::eof() const{
+	return next == NULL || next >= data + size;
+}
+
+//============================================================================
+bool CsvReader::is_empty() const{
+	return begin == end;
+}
+
+//============================================================================
+bool CsvReader::at_end() const{
+	return p >= end;
+}
+
+//============================================================================
+char CsvReader::peek() const{
+	return (p < end) ? *p : 0;
+}
+
+//============================================================================
+void CsvReader::start_field(){
+	if (!first){
+		if (p >= end){
+			error("missing column");
+		}
+		if (*p != delimiter){
+			error("unexpected character '" + string(1, *p) + "'");
+		}
+		p++;
+	}
+	first = false;
+	while (p < end && (*p == ' ' || *p == '\t')){
+		p++;
+	}
+}
+
+//============================================================================
+void CsvReader::end_field(const char* q){
+	p = q;
+	while (p < end && (*p == ' ' || *p == '\t')){
+		p++;
+	}
+	if (p < end && *p != delimiter){
+		error("invalid number");
+	}
+}
+
+//============================================================================
+double CsvReader::read_double(){
+	start_field();
+	double v;
+	from_chars_result r = from_chars(p, end, v);
+	if (r.ec == errc::invalid_argument){
+		error((p >= end || *p == delimiter) ? "missing value" : "invalid number");
+	}
+	if (r.ec == errc::result_out_of_range){
+		error("number out of range");
+	}
+	end_field(r.ptr);
+	return v;
+}
+
+//============================================================================
+bool CsvReader::try_double(double& v){
+	const char* q = p;
+	if (!first){
+		if (p >= end || *p != delimiter){
+			return false;
+		}
+		q++;
+	}
+	while (q < end && (*q == ' ' || *q == '\t')){
+		q++;
+	}
+	from_chars_result r = from_chars(q, end, v);
+	if (r.ec != errc()){
+		return false;
+	}
+	first = false;
+	end_field(r.ptr);
+	return true;
+}
+
+//============================================================================
+long long CsvReader::read_integer(const long long min, const long long max){
+	start_field();
+	long long v;
+	from_chars_result r = from_chars(p, end, v);
+	if (r.ec == errc::invalid_argument){
+		error((p >= end || *p == delimiter) ? "missing value" : "invalid number");
+	}
+	if (r.ec == errc::result_out_of_range || v < min || v > max){
+		error("number out of range");
+	}
+	end_field(r.ptr);
+	return v;
+}
+
+//============================================================================
+long CsvReader::read_long(){
+	return read_integer(LONG_MIN, LONG_MAX);
+}
+
+//============================================================================
+int CsvReader::read_int(){
+	return read_integer(INT_MIN, INT_MAX);
+}
+
+//============================================================================
+unsigned int CsvReader::read_uint(){
+	return read_integer(0, UINT_MAX);
+}
+
+//============================================================================
+char CsvReader::read_char(){
+	start_field();
+	char c = (p < end) ? *p : 0;
+	while (p < end && *p != delimiter){
+		p++;
+	}
+	return c;
+}
+
+//============================================================================
+string CsvReader::read_rest(){
+	if (!first && p < end && *p == delimiter){
+		p++;
+	}
+	first = false;
+	string s (p, end - p);
+	p = end;
+	return s;
+}
+
+//============================================================================
+string CsvReader::get_line() const{
+	return string(begin, end - begin);
+}
+
+//============================================================================
+unsigned long CsvReader::get_line_number() const{
+	return line;
+}
+
+//============================================================================
+void CsvReader::error(const string& message) const{
+	throw Exception(DATA_ERROR, name + ", line " + to_string(line) + ": " + message + " in \"" + get_line() + "\"");
+}
+
+//============================================================================
+void CsvReader::close(){
+	if (data != NULL){
+		munmap((void*) data, size);
+		data = NULL;
+	}
+	if (fd != -1){
+		::close(fd);
+		fd = -1;
+	}
+	size = 0;
+	next = begin = end = p = NULL;
+	line = 0;
+}
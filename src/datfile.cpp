@@ -39,9 +39,16 @@ bool DatFile::exists(string nomfichier){
 
 bool DatFile::copy(string source_filename, string dest_filename) {
 	ifstream src(source_filename.c_str(), ios::binary);
+	if (!src.is_open()){
+		return false;
+	}
 	ofstream dst(dest_filename.c_str(), ios::binary);
+	if (!dst.is_open()){
+		return false;
+	}
 	dst << src.rdbuf();
-	return true;
+	dst.close();
+	return !dst.fail() && !src.bad();
 }
 
 //============================================================================================
@@ -0,0 +1,96 @@
+/*
+ *  event_file.cpp
+ *
+ *  Copyright UNIL. All rights reserved.
+ *
+ */
+
+#include <cstdio>
+#include <fstream>
+#include <queue>
+#include "event_file.h"
+#include "utils.h"
+
+// ==============================================================================
+/// next event of one of the merged files
+struct merge_head{
+  uint32_t frame;		// start frame
+  uint32_t pair;		// index of the pair
+  int file;				// index of the file
+  bool operator< (const merge_head& h) const{	// reversed, for a min-heap
+    return h.frame < frame || (h.frame == frame && (h.pair < pair || (h.pair == pair && h.file < file)));
+  }
+};
+
+// reads the next event line of a file and extracts its sort key, returns false at the end of the file
+static bool read_event_line(ifstream& f, string& line, merge_head& h, const vector <int>& index, const string& name){
+  while (getline(f, line)){
+    if (line.empty() || line[0] == '#'){
+      continue;
+    }
+    unsigned int tag1, tag2, frame;
+    if (sscanf(line.c_str(), "%u,%u,%u", &tag1, &tag2, &frame) != 3){
+      throw Exception(DATA_ERROR, name + ": invalid event line " + line);
+    }
+    if (tag1 >= index.size() || index[tag1] == -1){
+      throw Exception(TAG_NOT_FOUND, to_string(tag1));
+    }
+    if (tag2 >= index.size() || index[tag2] == -1){
+      throw Exception(TAG_NOT_FOUND, to_string(tag2));
+    }
+    h.frame = frame;
+    h.pair = index[tag1] * tag_count + index[tag2];
+    return true;
+  }
+  return false;
+}
+
+// ==============================================================================
+uint64_t merge_event_files(const vector <string>& inputs, const string& output){
+  vector <int> index (65536, -1);
+  for (int i(0); i < tag_count; i++){
+    index[tag_list[i]] = i;
+  }
+  ofstream g;
+  g.open(output.c_str());
+  if (!g.is_open()){
+    throw Exception(CANNOT_OPEN_FILE, output);
+  }
+  g<<EVENT_HEADER<<"\n";
+
+  // k-way merge: only the next event of each file is in memory, lines are copied unchanged
+  vector <ifstream> f (inputs.size());
+  vector <string> lines (inputs.size());
+  priority_queue <merge_head> heads;
+  for (int i(0); i < inputs.size(); i++){
+    f[i].open(inputs[i].c_str());
+    if (!f[i].is_open()){
+      throw Exception(CANNOT_OPEN_FILE, inputs[i]);
+    }
+    merge_head h;
+    h.file = i;
+    if (read_event_line(f[i], lines[i], h, index, inputs[i])){
+      heads.push(h);
+    }
+  }
+  uint64_t count (0);
+  while (!heads.empty()){
+    merge_head h = heads.top();
+    heads.pop();
+    g<<lines[h.file]<<"\n";
+    count++;
+    merge_head next;
+    next.file = h.file;
+    if (read_event_line(f[h.file], lines[h.file], next, index, inputs[h.file])){
+      if (next.frame < h.frame){
+        throw Exception(DATA_ERROR, inputs[h.file] + ": events are not sorted by start frame.");
+      }
+      heads.push(next);
+    }
+  }
+  g.close();
+  if (g.fail()){
+    throw Exception(CANNOT_WRITE_FILE, output);
+  }
+  return count;
+}
@@ -0,0 +1,394 @@
+/*
+ *  event_filter.cpp
+ *
+ *  The rules are those of filter_interactions_cut_immobile (Danielle Mersch, modified by Nathalie Stroeymeyt),
+ *  applied to one new interaction at a time instead of the whole list of interactions of a pair.
+ *
+ *  Copyright UNIL. All rights reserved.
+ *
+ */
+
+#include <iostream>
+#include <sstream>
+#include <cstring>
+#include <cmath>
+#include "event_filter.h"
+#include "utils.h"
+
+// ==============================================================================
+// takes a vector of data (position and orientation of 2 ants) and calculates the average position and orientation and direction
+bool average_position(interaction_data& tmp, const vector <interaction_data>& inter, bool length, int F_MAX){
+  int ctr (0);
+  double x1 (0), y1 (0), x2(0), y2(0), d(0);
+  vector <double> a1;
+  vector <double> a2;
+  if (inter.size() < F_MAX){
+    length = false;
+  }
+  if (!length){ // if interaction length shorter than F_MAX, use all positions
+
+    for (int j(0); j < inter.size(); j++){
+      x1 += inter.at(j).x1;
+      x2 += inter.at(j).x2;
+      y1 += inter.at(j).y1;
+      y2 += inter.at(j).y2;
+      a1.push_back((double)inter.at(j).a1/100);
+      a2.push_back((double)inter.at(j).a2/100);
+      d += inter.at(j).direction;
+      ctr++;
+
+    }
+  }else{ // if interaction length longer than F_MAX, only use position in the first F_MAX frames
+    // determine how many positions are known and how many have to be read
+    int known = inter.size();
+    int j = 0;
+    int limit = inter.at(j).frame_start + F_MAX;
+    do{
+      x1 += inter.at(j).x1;
+      x2 += inter.at(j).x2;
+      y1 += inter.at(j).y1;
+      y2 += inter.at(j).y2;
+      a1.push_back((double)inter.at(j).a1/100);
+      a2.push_back((double)inter.at(j).a2/100);
+      d += inter.at(j).direction;
+      ctr++;
+      j++;
+    }while(j < known && inter.at(j).frame_stop < limit);
+  }
+  tmp.x1 = x1/ctr;
+  tmp.y1 = y1/ctr;
+  tmp.x2 = x2/ctr;
+  tmp.y2 = y2/ctr;
+  tmp.a1 = average_direction(a1) * 180/M_PI *100;
+  tmp.a2 = average_direction(a2) * 180/M_PI *100;
+  tmp.direction = d;
+  tmp.det = ctr;
+
+  if (tmp.x1 > IMAGE_WIDTH || tmp.x2 > IMAGE_WIDTH || tmp.y1 > IMAGE_HEIGHT || tmp.y2 > IMAGE_HEIGHT){
+    cout<<"Problem with average position. "<<endl;
+    cout<<"ctr: "<<ctr<<endl;
+    cout<<"inter.size: "<<inter.size()<<endl;
+    cout<<"length: "<<length<<endl;
+    return false;
+  }
+  return true;
+}
+
+// ==============================================================================
+void write_event(ostream& g, const event& e){
+  g<<e.tag1<<","<<e.tag2<<","<<e.d.frame_start<<","<<e.d.frame_stop<<",";
+  g.precision(12);
+  g<<e.d.time_start<<",";
+  g.precision(12);
+  g<<e.d.time_stop<<","<<e.d.box<<",";
+  g<<e.d.x1<<","<<e.d.y1<<","<<e.d.a1<<",";
+  g<<e.d.x2<<","<<e.d.y2<<","<<e.d.a2<<",";
+  g<<e.d.direction<<","<<e.d.det;
+  g<<"\n";
+}
+
+
+//==================== EventFilter ===========================================
+EventFilter::EventFilter(const int f_th, const int f_max, const int x_th, const int x_min){
+	F_TH = f_th;
+	F_MAX = f_max;
+	X_TH = x_th;
+	X_min = x_min;
+	index.assign(65536, -1);
+	for (int i(0); i < tag_count; i++){
+		index[tag_list[i]] = i;
+	}
+	pairs.resize(tag_count * tag_count);
+	for (int i(0); i < pairs.size(); i++){
+		memset(&pairs[i].sums, 0, sizeof(pairs[i].sums));
+		pairs[i].count = 0;
+		pairs[i].ordinal = 0;
+		pairs[i].open = false;
+	}
+	current = 0;
+	started = false;
+	events = 0;
+	singles = 0;
+	summary = NULL;
+}
+
+EventFilter::~EventFilter(){
+}
+
+//============================================================================
+void EventFilter::open(const string& filename){
+	name = filename;
+	g.open(filename.c_str());
+	if (!g.is_open()){
+		throw Exception(CANNOT_OPEN_FILE, filename);
+	}
+	g<<EVENT_HEADER<<"\n";
+}
+
+//============================================================================
+void EventFilter::write(const interaction_record& r){
+	if (started && r.frame < current){
+		stringstream ss;
+		ss<<"Interactions are not in frame order (frame "<<r.frame<<" after frame "<<current<<").";
+		throw Exception(DATA_ERROR, ss.str());
+	}
+
+	// close the events that cannot be extended anymore before adding interactions of a new frame
+	if (!started || r.frame != current){
+		expire(r.frame);
+		flush();
+		current = r.frame;
+		started = true;
+	}
+
+	int idx1 = index[r.tag1];
+	int idx2 = index[r.tag2];
+	if (idx1 == -1){
+		throw Exception(TAG_NOT_FOUND, to_string(r.tag1));
+	}
+	if (idx2 == -1){
+		throw Exception(TAG_NOT_FOUND, to_string(r.tag2));
+	}
+	// the pair is identified by the smallest index first, the coordinates stay those of the record
+	uint32_t p = (idx1 < idx2) ? idx1 * tag_count + idx2 : idx2 * tag_count + idx1;
+
+	interaction_data temp;
+	memset(&temp, 0, sizeof(temp));
+	temp.time_start = r.time;
+	temp.frame_start = r.frame;
+	temp.frame_stop = 0;
+	temp.box = r.box;
+	temp.x1 = r.x1;
+	temp.y1 = r.y1;
+	temp.a1 = r.a1;
+	temp.x2 = r.x2;
+	temp.y2 = r.y2;
+	temp.a2 = r.a2;
+	temp.awake1 = 0;
+	temp.awake2 = 0;
+	temp.direction = r.direction;
+	temp.from = r.from;
+	temp.to = r.to;
+	temp.det = 1;
+	temp.frame_ref_awakeness = temp.frame_start;
+	add(p, temp);
+}
+
+//============================================================================
+bool EventFilter::is_close(const interaction_data& temp1, const uint32_t frame) const{
+	// if it is the first interaction of the event (frame_stop == 0) check distance between start frames, otherwise check distance between stop of first and start of second
+	return (temp1.frame_stop == 0 && frame - temp1.frame_start < F_TH ) || frame - temp1.frame_stop < F_TH;
+}
+
+//============================================================================
+void EventFilter::add(const uint32_t p, interaction_data& temp2){
+	pair_state& s = pairs[p];
+	s.count++;
+	if (!s.open){
+		s.cur = temp2;
+		s.open = true;
+		event_key k = {s.cur.frame_start, p, s.ordinal};
+		open_keys.insert(k);
+		open_pairs.push_back(p);
+		return;
+	}
+
+	// s.cur plays the role of interaction i and next the one of interaction i+1 in filter_interactions_cut_immobile
+	interaction_data temp1 = s.cur;
+	interaction_data next = temp2;
+	bool same_event (false);
+
+	// if 2 subsequent interactions are temporally close (nb of frames between them < F_TH), test if same event
+	if (is_close(temp1, temp2.frame_start)){
+		// check positions and angles of interacting ants,
+		// if positions are close, interactions are part of same event
+		if ((temp2.x1 - temp1.x1 < X_TH) && (temp2.y1 - temp1.y1 < X_TH) && (temp2.x2 - temp1.x2 < X_TH) && (temp2.y2 - temp1.y2 < X_TH)){
+			//==== NS code start =====
+			// check if awakeness: if ant awake update awake flags and frame_ref_awakeness
+			if ( ( (temp2.x1 - temp1.x1) > X_min) || ( (temp2.y1 - temp1.y1) > X_min) ) {
+				next.awake1=1;
+				temp2.awake1=1;
+			}
+			if ( ( (temp2.x2 - temp1.x2) > X_min) || ( (temp2.y2 - temp1.y2) > X_min) ) {
+				next.awake2=1;
+				temp2.awake2=1;
+			}
+			if (next.awake1||next.awake2){
+				next.frame_ref_awakeness = next.frame_start;
+				temp2.frame_ref_awakeness = next.frame_start;
+			}else{
+				next.frame_ref_awakeness = s.cur.frame_ref_awakeness;
+				temp2.frame_ref_awakeness = s.cur.frame_ref_awakeness;
+			}
+			// same event if both ants asleep; or if ant awake and time since last awakeness below F_MAX
+			if ( (!temp2.awake1 && !temp2.awake2 ) || ( ( temp2.awake1||temp2.awake2 ) && (( temp2.frame_start-temp1.frame_ref_awakeness) < F_MAX ))){
+				same_event = true;
+			}else{
+				// restore frame awakeness
+				next.frame_ref_awakeness = next.frame_start;
+			}
+			//==== NS code end =====
+		}
+	}
+
+	if (same_event){
+		// the event is carried by the last interaction
+		next.frame_start = temp1.frame_start;
+		next.frame_stop = temp2.frame_start;
+		next.time_start = temp1.time_start;
+		next.time_stop = temp2.time_start;
+		if (temp1.frame_stop == 0){
+			accumulate(s.sums, temp1);
+		}
+		accumulate(s.sums, temp2);
+		s.cur = next;
+	}else{
+		// interactions are part of distinct events
+		// (the pair stays in open_pairs)
+		finish(p);
+		s.cur = next;
+		s.open = true;
+		event_key k = {s.cur.frame_start, p, s.ordinal};
+		open_keys.insert(k);
+	}
+}
+
+//============================================================================
+void EventFilter::accumulate(event_sums& sums, const interaction_data& d){
+	sums.x1 += d.x1;
+	sums.y1 += d.y1;
+	sums.x2 += d.x2;
+	sums.y2 += d.y2;
+	const trig_value& t1 = trig_centidegree(d.a1);
+	const trig_value& t2 = trig_centidegree(d.a2);
+	sums.c1 += t1.c;
+	sums.s1 += t1.s;
+	sums.c2 += t2.c;
+	sums.s2 += t2.s;
+	sums.d += d.direction;
+	sums.n++;
+}
+
+//============================================================================
+bool EventFilter::average_sums(interaction_data& tmp, const event_sums& sums){
+	// the interactions of an event all have frame_stop == 0, so that average_position uses all of them, also for events cut at F_MAX:
+	// the sums are added in the same order and give the same averages
+	tmp.x1 = sums.x1/sums.n;
+	tmp.y1 = sums.y1/sums.n;
+	tmp.x2 = sums.x2/sums.n;
+	tmp.y2 = sums.y2/sums.n;
+	tmp.a1 = atan2(sums.s1, sums.c1) * 180/M_PI *100;
+	tmp.a2 = atan2(sums.s2, sums.c2) * 180/M_PI *100;
+	tmp.direction = sums.d;
+	tmp.det = sums.n;
+
+	if (tmp.x1 > IMAGE_WIDTH || tmp.x2 > IMAGE_WIDTH || tmp.y1 > IMAGE_HEIGHT || tmp.y2 > IMAGE_HEIGHT){
+		cout<<"Problem with average position. "<<endl;
+		cout<<"ctr: "<<sums.n<<endl;
+		return false;
+	}
+	return true;
+}
+
+//============================================================================
+void EventFilter::finish(const uint32_t p){
+	pair_state& s = pairs[p];
+	event_key k = {s.cur.frame_start, p, s.ordinal};
+	open_keys.erase(k);
+	s.open = false;
+
+	// if the event was only 1 frame long set stop frame to start frame
+	if (s.cur.frame_stop == 0){
+		s.cur.frame_stop = s.cur.frame_start;
+		s.cur.time_stop = s.cur.time_start;
+		s.cur.det = 1;
+	}
+	// check if the event is of reasonable duration (less than F_MAX frames), if not cut it at F_MAX
+	if (s.cur.frame_stop - s.cur.frame_ref_awakeness + 1 > F_MAX){
+		s.cur.frame_stop = s.cur.frame_ref_awakeness + F_MAX -1;
+		s.cur.time_stop = s.cur.time_start + ( (s.cur.frame_stop - s.cur.frame_start + 1) /2);
+	}
+	// if the event had several interactions, then calculate average positions of ants
+	if (s.sums.n > 0){
+		if (!average_sums(s.cur, s.sums)){
+			throw Exception(DATA_ERROR, "Average position of event outside of the image.");
+		}
+		memset(&s.sums, 0, sizeof(s.sums));
+	}
+
+	pending_event e;
+	e.key = k;
+	e.e.tag1 = tag_list[p / tag_count];
+	e.e.tag2 = tag_list[p % tag_count];
+	e.e.d = s.cur;
+	e.e.s = 0;
+	done.push(e);
+	s.ordinal++;
+}
+
+//============================================================================
+void EventFilter::expire(const uint32_t frame){
+	// an open event can only be extended by an interaction that is close in time, and interactions come in frame order
+	int i (0);
+	while (i < open_pairs.size()){
+		uint32_t p = open_pairs[i];
+		if (!pairs[p].open){
+			open_pairs[i] = open_pairs.back();
+			open_pairs.pop_back();
+		}else if (!is_close(pairs[p].cur, frame)){
+			finish(p);
+			open_pairs[i] = open_pairs.back();
+			open_pairs.pop_back();
+		}else{
+			i++;
+		}
+	}
+}
+
+//============================================================================
+void EventFilter::flush(){
+	while (!done.empty() && (open_keys.empty() || done.top().key < *open_keys.begin())){
+		const event& e = done.top().e;
+		write_event(g, e);
+		if (summary != NULL){
+			summary->add(e.tag1, e.tag2, e.d.frame_start, e.d.frame_stop, e.d.time_start);
+		}
+		events++;
+		done.pop();
+	}
+	if (g.fail()){
+		throw Exception(CANNOT_WRITE_FILE, name);
+	}
+}
+
+//============================================================================
+void EventFilter::set_summary(EventSummary* s){
+	summary = s;
+}
+
+//============================================================================
+void EventFilter::close(){
+	for (int i(0); i < open_pairs.size(); i++){
+		if (pairs[open_pairs[i]].open){
+			finish(open_pairs[i]);
+		}
+	}
+	open_pairs.clear();
+	flush();
+	for (int i(0); i < pairs.size(); i++){
+		if (pairs[i].count == 1){
+			singles++;
+		}
+	}
+	g.close();
+}
+
+//============================================================================
+int EventFilter::get_single_count() const{
+	return singles;
+}
+
+//============================================================================
+uint64_t EventFilter::get_event_count() const{
+	return events;
+}
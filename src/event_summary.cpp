@@ -0,0 +1,164 @@
+/*
+ *  event_summary.cpp
+ *
+ *  Copyright UNIL. All rights reserved.
+ *
+ */
+
+#include <cmath>
+#include <fstream>
+#include "event_summary.h"
+
+const int DURATION_GROUPS = 32;		///< number of groups of the histogram of durations: [1,2), [2,4), ... [2^31, 2^32) frames
+
+
+//==================== EventSummary ==========================================
+EventSummary::EventSummary(){
+	index.assign(65536, -1);
+	for (int i(0); i < tag_count; i++){
+		index[tag_list[i]] = i;
+	}
+	totals zero = {0, 0};
+	ants.assign(tag_count, zero);
+	pairs.assign(tag_count * tag_count, zero);
+	all = zero;
+	duration_sum = 0;
+	duration_sum_square = 0;
+	for (int k(0); k < DURATION_GROUPS; k++){
+		durations.add_group(ldexp(1.0, k), ldexp(1.0, k + 1));
+	}
+}
+
+EventSummary::~EventSummary(){
+}
+
+//============================================================================
+void EventSummary::add(const uint16_t tag1, const uint16_t tag2, const uint32_t frame_start, const uint32_t frame_stop, const double time_start){
+	int idx1 = index[tag1];
+	int idx2 = index[tag2];
+	if (idx1 == -1){
+		throw Exception(TAG_NOT_FOUND, to_string(tag1));
+	}
+	if (idx2 == -1){
+		throw Exception(TAG_NOT_FOUND, to_string(tag2));
+	}
+	if (idx1 > idx2){
+		swap(idx1, idx2);
+	}
+	uint64_t frames = frame_stop - frame_start + 1;
+
+	all.events++;
+	all.frames += frames;
+	ants[idx1].events++;
+	ants[idx1].frames += frames;
+	ants[idx2].events++;
+	ants[idx2].frames += frames;
+	totals& p = pairs[idx1 * tag_count + idx2];
+	p.events++;
+	p.frames += frames;
+	totals& h = hours[(long long) floor(time_start / 3600)];
+	h.events++;
+	h.frames += frames;
+
+	durations.add_data(frames);
+	duration_sum += frames;
+	duration_sum_square += (double) frames * frames;
+	duration_counts[frames]++;
+}
+
+//============================================================================
+void EventSummary::write(const string& filename){
+	ofstream g;
+	g.open(filename.c_str());
+	if (!g.is_open()){
+		throw Exception(CANNOT_OPEN_FILE, filename);
+	}
+	g.precision(12);
+
+	g<<"#Events,Frames,Mean,Stdev,Median\n";
+	// population standard deviation, as Stats computes it
+	double mean (0);
+	double stdev (0);
+	if (all.events > 0){
+		mean = duration_sum / all.events;
+		if (mean != 0){
+			stdev = sqrt(1 / (double) all.events * (duration_sum_square - all.events * mean * mean));
+		}
+	}
+	g<<all.events<<","<<all.frames<<","<<mean<<","<<stdev<<","<<find_median()<<"\n";
+
+	g<<"#Min,Max,Events\n";
+	for (unsigned int k(0); k < durations.get_group_count(); k++){
+		group d = durations.get_group(k);
+		if (d.ctr > 0){
+			g<<d.min<<","<<d.max<<","<<d.ctr<<"\n";
+		}
+	}
+
+	// number of ants with which each ant had events
+	vector <int> partners (tag_count, 0);
+	for (int i(0); i < tag_count; i++){
+		for (int j(i + 1); j < tag_count; j++){
+			if (pairs[i * tag_count + j].events > 0){
+				partners[i]++;
+				partners[j]++;
+			}
+		}
+	}
+	g<<"#Ant,Events,Frames,Partners\n";
+	for (int i(0); i < tag_count; i++){
+		if (ants[i].events > 0){
+			g<<tag_list[i]<<","<<ants[i].events<<","<<ants[i].frames<<","<<partners[i]<<"\n";
+		}
+	}
+
+	g<<"#Ant1,Ant2,Events,Frames\n";
+	for (int i(0); i < tag_count; i++){
+		for (int j(i + 1); j < tag_count; j++){
+			const totals& p = pairs[i * tag_count + j];
+			if (p.events > 0){
+				g<<tag_list[i]<<","<<tag_list[j]<<","<<p.events<<","<<p.frames<<"\n";
+			}
+		}
+	}
+
+	// hours are written as the time of their beginning, the events are counted in the hour in which they start
+	g<<"#Hour,Events,Frames\n";
+	for (map <long long, totals>::iterator it (hours.begin()); it != hours.end(); it++){
+		g<<it->first * 3600<<","<<it->second.events<<","<<it->second.frames<<"\n";
+	}
+
+	g.close();
+	if (g.fail()){
+		throw Exception(CANNOT_WRITE_FILE, filename);
+	}
+}
+
+//============================================================================
+double EventSummary::find_median() const{
+	if (all.events == 0){
+		return 0;
+	}
+	// durations at ranks (n - 1) / 2 and n / 2 of the sorted durations
+	uint64_t lo = (all.events - 1) / 2;
+	uint64_t hi = all.events / 2;
+	double median (0);
+	uint64_t seen (0);
+	for (map <uint32_t, uint64_t>::const_iterator it (duration_counts.begin()); it != duration_counts.end(); it++){
+		uint64_t next = seen + it->second;
+		if (lo >= seen && lo < next){
+			median += it->first;
+		}
+		if (hi >= seen && hi < next){
+			median += it->first;
+			break;
+		}
+		seen = next;
+	}
+	return median / 2;
+}
+
+//============================================================================
+uint64_t EventSummary::get_event_count() const{
+	return all.events;
+}
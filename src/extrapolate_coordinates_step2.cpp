@@ -12,12 +12,14 @@
 #include <fstream>
 #include <map>
 #include <cstdlib>
+#include <cstring>
 #include <getopt.h>
 
 #include "datfile.h"
 #include "tags3.h"
 #include "exception.h"
 #include "trackcvt.h"
+#include "csv_file.h"
 
 
 
@@ -67,11 +69,8 @@ try{
 	datin.open((string) argv[1], 0);
 
 	// opens text file
-	ifstream f;
+	CsvReader f;
 	f.open(argv[2]);
-	if(!f.is_open()){
-		throw(CANNOT_OPEN_FILE, (string) argv[2]);
-	}
 
 	// test whether output datfile exists already, and creates output file
 	DatFile datout;
@@ -86,9 +85,7 @@ try{
 
 	// read input text file
 	cout<<"reading frames to correct from input file ..."<<endl;
-	while(!f.eof()){
-		string s;
-		istringstream ss;
+	while(f.next_line()){
 		/*int frame (0);
 		int tag (-1);
 		int id (-1);
@@ -96,28 +93,23 @@ try{
 		int y(-1);
 		int a(-1);*/
     unsigned int frame = 0;
+    int tag = 0;
     int boxid = 0;
-		// read data from input
-		getline(f,s);
-		if (!s.empty()){
-			if (s[0]=='#'){
-				getline(f,s);
-			}
+		// read data from input: frame,tag,box,x_coor,y_coor,angle (lines starting with # are comments)
+		if (!f.is_empty() && f.peek() != '#'){
       tag_pos temp_tag;
-			//cout<<"line read: "<<s<<endl;
-			ss.str(s);
-			ss>>frame;
-			ss.ignore(1, ',');
-			ss>>temp_tag.id;
-			//cout<<"Tag "<<tag<<endl;
-			ss.ignore(1,',');
-			ss>>boxid;
-			ss.ignore(1,',');
-			ss>>temp_tag.x;
-			ss.ignore(1,',');
-			ss>>temp_tag.y;
-			ss.ignore(1,',');
-			ss>>temp_tag.a;
+      memset(&temp_tag, 0, sizeof(temp_tag));
+			frame = f.read_uint();
+			tag = f.read_int();
+			int idx;
+			if (!find_index(tag, idx)){
+				f.error("Unknown tag " + to_string(tag));
+			}
+			boxid = f.read_int();
+			temp_tag.id = boxid;
+			temp_tag.x = f.read_int();
+			temp_tag.y = f.read_int();
+			temp_tag.a = f.read_int();
       datout.write_tag(frame, temp_tag);
 			// create new tag_table and initialize with -1
 			//tag_table* temp = new tag_table[1];
@@ -179,5 +171,6 @@ try{
 
 	return 0;
 }catch (Exception e) {
+	return 1;
 }
 }
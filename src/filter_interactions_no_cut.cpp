@@ -21,11 +21,19 @@
 #include <algorithm>
 #include <cstdlib>
 #include <getopt.h>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <exception>
 
 #include "trackcvt.h"
 #include "exception.h"
 #include "tags3.h"
 #include "utils.h"
+#include "interaction_file.h"
+#include "event_file.h"
+#include "pair_table.h"
+#include "event_summary.h"
 
 using namespace std;
 
@@ -40,7 +48,7 @@ using namespace std;
 const int F_MIN = 0; /// minmal duration in frames of interaction, if shorter than this it is not included in the filtered file
 
 /// structure of an interaction
-struct data{
+struct interaction_data{
   double time_start;
   double time_stop;
   uint32_t frame_start;		// frame of interaction
@@ -63,25 +71,14 @@ struct data{
 struct event{
   uint16_t tag1;
   uint16_t tag2;
-  data d;
+  interaction_data d;
   char s;		// state of interaction: long, blinking
 };
 
-typedef vector <data> interactions;
+typedef pair_records <interaction_data> interactions;
 typedef vector <vector <int> > matrice;
 
-// convert a tag in the corresponding index of the tag_list table
-bool find_idx(const int tag, int& idx){
-  int i(0);
-  do{
-    if (tag == tag_list[i]){
-      idx = i;
-      return true;
-    }
-    i++;
-  }while(idx == -1 && i<tag_count);
-  return false;
-}
+const size_t PAIR_CHUNK = 64; /// number of pairs of ants given at once to a filtering thread
 
 // function to compare elements of vector 
 bool cmp(const event& a, const event& b){
@@ -89,95 +86,75 @@ bool cmp(const event& a, const event& b){
 }
 
 // ==============================================================================
-/** void read_interaction_file(char* filename, vector <vector <interactions> >& i_table)
- * * * * \brief Opens input file with list of interactions (expected format is frame,box,IDant1,IDant2,x1,y1,a1,x2,y2,a2)
- * * * *		reads them into a 3 dimensional vector
+/** void read_interaction_file(string filename, PairTable <interaction_data>& i_table)
+ * * * * \brief Opens input file with list of interactions (binary interaction file, or CSV with time,frame,box,IDant1,IDant2,x1,y1,a1,x2,y2,a2[,direction,from,to])
+ * * * *		reads them into a table of interactions by pair of ants
  * * * * \param filename Name of the input file to read
  * * * * \param i_table Table of interactions to fill
  * * * */
- void read_interaction_file(string filename, vector <vector <interactions> >& i_table){
+ void read_interaction_file(string filename, PairTable <interaction_data>& i_table){
    
-   ifstream f;
-   f.open(filename.c_str());
-   if (!f.is_open()){
-     throw Exception(CANNOT_OPEN_FILE, (string) filename);
+   // index in tag_list of each tag
+   vector <int> index (65536, -1);
+   for (int i(0); i < tag_count; i++){
+     index[tag_list[i]] = i;
    }
    
-   while (!f.eof()){
-     string s;
-     getline(f,s);
-     stringstream ss;
-     ss.str(s);
-     //cout<<"read: "<<s<<endl;
-     data temp;
+   InteractionReader f;
+   f.open(filename);
+   i_table.reserve(f.get_count());
+   
+   interaction_record r;
+   while (f.read(r)){
+     interaction_data temp;
      memset(&temp, 0, sizeof(temp));
      temp.frame_stop = 0;
-     ss>>temp.time_start;
-     if (!ss.fail()){
-       ss.ignore(1,',');
-       ss>>temp.frame_start;
-       ss.ignore(1,',');
-       ss>>temp.box;
-       ss.ignore(1,',');
-       int tag1;
-       ss>>tag1;
-       ss.ignore(1,',');
-       int tag2;
-       ss>>tag2;
-       ss.ignore(1,',');
-       ss>>temp.x1;
-       ss.ignore(1,',');
-       ss>>temp.y1;
-       ss.ignore(1,',');
-       ss>>temp.a1;
-       ss.ignore(1,',');
-       ss>>temp.x2;
-       ss.ignore(1,',');
-       ss>>temp.y2;
-       ss.ignore(1,',');
-       ss>>temp.a2;
-       ss.ignore(1,',');
-       ss>>temp.direction;
-       ss.ignore(1,',');
-       ss>>temp.from;
-       ss.ignore(1,',');
-       ss>>temp.to;
-       temp.det = 1;
-       
-       if (temp.x2 == 0){
-         cout<<"--->error:"<<endl;
-         cout<<"temp: "<<temp.x1<<","<<temp.y1<<" & "<<temp.x2<<","<<temp.y2<<endl;
-         cout<<"read: "<<s<<endl;
-         return;
-       }
-       
-       // find index of each tag
-       int idx1 (-1); 
-       int idx2 (-1);
-       if (!find_idx(tag1, idx1)){
-         stringstream ss;
-         ss<<tag1;
-         string info = ss.str();
-         throw Exception(TAG_NOT_FOUND, info);
-       }
-       if (!find_idx(tag2, idx2)){
-         stringstream ss;
-         ss<<tag2;
-         string info = ss.str();
-         throw Exception(TAG_NOT_FOUND, info);
-       }
-       
-       // add interaction to list (matrix is symmetric)
-       i_table[idx1][idx2].push_back(temp);
-       i_table[idx2][idx1].push_back(temp);
+     temp.time_start = r.time;
+     temp.frame_start = r.frame;
+     temp.box = r.box;
+     temp.x1 = r.x1;
+     temp.y1 = r.y1;
+     temp.a1 = r.a1;
+     temp.x2 = r.x2;
+     temp.y2 = r.y2;
+     temp.a2 = r.a2;
+     temp.direction = r.direction;
+     temp.from = r.from;
+     temp.to = r.to;
+     temp.det = 1;
+     
+     if (temp.x2 == 0){
+       stringstream ss;
+       ss<<"Invalid interaction in frame "<<r.frame<<", tags "<<r.tag1<<","<<r.tag2<<": "<<temp.x1<<","<<temp.y1<<" & "<<temp.x2<<","<<temp.y2;
+       throw Exception(DATA_ERROR, ss.str());
      }
+     
+     // find index of each tag
+     int idx1 = index[r.tag1];
+     int idx2 = index[r.tag2];
+     if (idx1 == -1){
+       stringstream ss;
+       ss<<r.tag1;
+       string info = ss.str();
+       throw Exception(TAG_NOT_FOUND, info);
+     }
+     if (idx2 == -1){
+       stringstream ss;
+       ss<<r.tag2;
+       string info = ss.str();
+       throw Exception(TAG_NOT_FOUND, info);
+     }
+     
+     // add interaction to its pair (stored once for both orders of the ants)
+     i_table.add(idx1, idx2, temp);
    }	
    f.close();
+   i_table.build();
  }
  
  // ==============================================================================
  // takes a vector of data (position and orientation of 2 ants) and calculates the average position and orientation and direction
- bool average_position(data& tmp, const vector <data>& inter, bool length, int F_MAX){
+ bool average_position(interaction_data& tmp, const vector <interaction_data>& inter, bool length, int F_MAX){
    int ctr (0);
    double x1 (0), y1 (0), x2(0), y2(0), d(0);
    vector <double> a1;
@@ -238,6 +215,373 @@ bool cmp(const event& a, const event& b){
  
  // ==============================================================================
  
+// ==============================================================================
+/**\fn int filter_pair(PairTable <interaction_data>& i_table, size_t p, vector <event>& event_table, TagsFile& tgs, int F_TH, int F_MAX, int X_TH)
+ * \brief Merges the interactions of a pair of ants of i_table into events
+ * \param i_table Table of interactions
+ * \param p Number of the pair in i_table
+ * \param event_table Table to which the events are added, in the order of the pairs
+ * \param tgs Tags file
+ * \param F_TH Maximal number of frames between 2 interactions of the same event
+ * \param F_MAX Maximal duration of an event in frames
+ * \param X_TH Maximal variation in x and y coordinates between 2 interactions of the same event
+ * \return 1 if the ants interacted only once, 0 otherwise
+ */
+ int filter_pair(PairTable <interaction_data>& i_table, size_t p, vector <event>& event_table, TagsFile& tgs, int F_TH, int F_MAX, int X_TH){
+   int missed (0); // number of frames without interaction in the current event
+   int singleinteraction (0); // number of ant pairs that had a single 1 frame interaction
+   
+   int t1 = i_table.first(p);
+   int t2 = i_table.second(p);
+   interactions i_pair = i_table[p];
+   
+   // check whether there are interactions for a given pair of ants
+   if (!i_pair.empty()){
+     //cout<<"====> tags"<<tag_list[t1]<<" and "<<tag_list[t2]<<endl;
+     
+     // if there is more than one interaction between the 2 ants, check whether several interactions are part of same interaction event
+     if (i_pair.size() > 1){
+       
+       /*
+       for (int a(0); a < i_pair.size(); a++){
+       cout<<i_pair[a].frame_start<<" - "<<i_pair[a].frame_stop<<endl;
+       }*/
+       
+       vector <interaction_data> inter;
+       for (int i(0); i<i_pair.size()-1; i++){
+         
+         //if (i==100)return 1;
+         // read element and compare with next one
+         interaction_data temp1 = i_pair[i];
+         interaction_data temp2 = i_pair[i+1];
+         //cout<<"reading:"<<endl;
+         //cout<<i_pair[i].frame_start<<" - "<<i_pair[i].frame_stop<<endl;
+         //cout<<i_pair[i+1].frame_start<<" - "<<i_pair[i+1].frame_stop<<endl;
+         
+         // if 2 subsequent interactions are temporally close (nb of frames between them < F_TH), test if same event
+         // if it is the first interaction of the event (frame_stop == 0) check distance between start frames, otherwise check distance between stop of first and start of second
+         if ((temp1.frame_stop == 0 && temp2.frame_start - temp1.frame_start < F_TH ) || temp2.frame_start - temp1.frame_stop < F_TH){
+           
+           // check positions and angles of interacting ants,
+           // if positions are close, interactions are part of same event
+           if ((temp2.x1 - temp1.x1 < X_TH) && (temp2.y1 - temp1.y1 < X_TH) && (temp2.x2 - temp1.x2 < X_TH) && (temp2.y2 - temp1.y2 < X_TH)){
+             
+             // use first 2 interactions of an event: set start frame of first interaction (the one read into temp1) to zero to mark as read and, and set start frame of second interaction of the pair to start frame of first interaction 
+             if (temp1.frame_stop == 0){
+               //cout<<"first event"<<temp1.frame_start<<endl;
+               //cout<<"second event"<<temp2.frame_start<<endl;
+               // test if there are frames missing between the subsequent interactions detected, if so count how many
+               missed+= temp2.frame_start - temp1.frame_start;
+               // update the start and stop frame in the list of the pair
+               int tmp = temp2.frame_start;
+               i_pair[i+1].frame_start = temp1.frame_start;
+               i_pair[i+1].frame_stop = tmp;
+               i_pair[i].frame_start = 0;
+               // update also time
+               double tmp2 = temp2.time_start;
+               i_pair[i+1].time_start = temp1.time_start;
+               i_pair[i+1].time_stop = tmp2;
+               
+               //cout<<"add to inter 1: "<<temp2.x1<<","<<temp2.y1<<endl;
+               inter.push_back(temp1);
+               //inter.push_back(temp2);
+               
+               // third or further interaction of event
+             }else{
+               // test if there are frames missing between the subsequent interactions detected, if so count how many
+               missed+= temp2.frame_start - temp1.frame_stop;
+               i_pair[i+1].frame_stop = temp2.frame_start;
+               i_pair[i+1].frame_start = temp1.frame_start;
+               i_pair[i].frame_start = 0;
+               // update also time
+               i_pair[i+1].time_stop = temp2.time_start;
+               i_pair[i+1].time_start = temp1.time_start;
+             }
+             
+             //add interaction to table for coordinate calculations
+             inter.push_back(temp2);
+             
+             
+             // if temp2 is last interaction of event and this is the last event for this ant pair
+             if (i+1 == i_pair.size()-1){
+               
+               //cout<<"last interaction "<< i_pair[i+1].frame_start<<" - "<<i_pair[i+1].frame_stop<<endl;
+               // calculate duration of event, if long test calculate quality
+               int duration = i_pair[i+1].frame_stop - i_pair[i+1].frame_start + 1;
+               
+               // check if previous event is of reasonable duration (less than F_MAX frames), if not cut it at F_MAX
+               bool length (false);
+               if (i_pair[i+1].frame_stop - i_pair[i+1].frame_start + 1 > F_MAX){
+                 i_pair[i+1].frame_stop = i_pair[i+1].frame_start + F_MAX;
+                 // update time
+                 i_pair[i+1].time_stop = i_pair[i+1].time_start + (F_MAX/2);
+                 length = true;
+               }
+               
+               // calculate average position and angle
+               //cout<<"Calculate average for interactions between tags "<<tag_list[t1]<<" and "<<tag_list[t2]<<endl;
+               if (! average_position( i_pair[i+1], inter, length,F_MAX)){
+                 throw Exception(DATA_ERROR, "Average position of event outside of the image.");
+               }
+               
+               // add event
+               event e;
+               e.tag1 = tag_list[t1];
+               e.tag2 = tag_list[t2];
+               e.d = i_pair[i+1];
+               event_table.push_back(e);
+             }
+             
+             // interactions are part of distinct events
+           }else{
+             
+             // if previous event was only 1 frame long set stop frame to start frame
+             if (i_pair[i].frame_stop == 0){
+               i_pair[i].frame_stop = i_pair[i].frame_start;
+               // update time
+               i_pair[i].time_stop = i_pair[i].time_start;
+               i_pair[i].det = 1;
+             }
+             
+             // calculate duration of event, if it is long -> calculate quality
+             int duration = i_pair[i].frame_stop - i_pair[i].frame_start + 1;
+             
+             // check if previous event is of reasonable duration (less than F_MAX frames), if not cut it at F_MAX
+             bool length (false);
+             if (i_pair[i].frame_stop - i_pair[i].frame_start + 1 > F_MAX){
+               i_pair[i].frame_stop = i_pair[i].frame_start + F_MAX;
+               // update time
+               i_pair[i].time_stop = i_pair[i].time_start + (F_MAX/2);
+               length = true;
+             }
+             
+             // if the previous event had several interactions, then calculate average positions of ants
+             if (!inter.empty()){
+               //cout<<"calling average position2. length = "<<length<<endl;
+               //cout<<"2. Calculate average for interactions between tags "<<tag_list[t1]<<" and "<<tag_list[t2]<<endl;
+               if (! average_position(i_pair[i], inter, length, F_MAX)){
+                 throw Exception(DATA_ERROR, "Average position of event outside of the image.");
+               }
+             }else{                   // if the previous event had a single interaction, still fill in the AB etc information
+             }
+             
+             // add event to table
+             event e;
+             e.tag1 = tag_list[t1];
+             e.tag2 = tag_list[t2];
+             e.d = i_pair[i];
+             event_table.push_back(e);
+             inter.clear();
+             missed= 0; // reset counter for missed interactions
+             
+             // if temp2 is last interaction for this ant pair, add it as well to event_table
+             if (i+1 == i_pair.size()-1){
+               i_pair[i+1].frame_stop = i_pair[i+1].frame_start;
+               // update time
+               i_pair[i+1].time_stop = i_pair[i+1].time_start;
+               event e;
+               e.tag1 = tag_list[t1];
+               e.tag2 = tag_list[t2];
+               e.d = i_pair[i+1];
+               event_table.push_back(e);
+             }
+           }
+           
+           
+           // 2 subsequent interaction are NOT temporally close --> distinct events
+         }else{
+           if (i_pair[i].frame_stop == 0){
+             i_pair[i].frame_stop = i_pair[i].frame_start;
+             // update time
+             i_pair[i].time_stop = i_pair[i].time_start;
+           }
+           //cout<<"new event: "<<temp1.frame_start<<" - "<<temp1.frame_stop<<endl;
+           
+           // calculate duration of event, if long test calculate quality
+           int duration = i_pair[i].frame_stop - i_pair[i].frame_start + 1;
+           bool length (false);
+           // check if previous event is of reasonable duration (less than F_MAX frames), if not cut it at F_MAX
+           if (i_pair[i].frame_stop - i_pair[i].frame_start + 1 > F_MAX){
+             i_pair[i].frame_stop = i_pair[i].frame_start + F_MAX;
+             //update time
+             i_pair[i].time_stop = i_pair[i].time_start + (F_MAX/2);
+             length = true;
+           }
+           
+           // if the previous event had several interactions, then calculate average positions of ants
+           if (!inter.empty()){
+             //cout<<"calling average position3. length = "<<length<<endl;
+             //cout<<"3. Calculate average for interactions between tags "<<tag_list[t1]<<" and "<<tag_list[t2]<<endl;
+             
+             if (!average_position(i_pair[i], inter, length, F_MAX)){
+               throw Exception(DATA_ERROR, "Average position of event outside of the image.");
+             }
+           }else{                   // if the previous event had a single interaction, still fill in the AB etc information
+           }
+           
+           event e;
+           e.tag1 = tag_list[t1];
+           e.tag2 = tag_list[t2];
+           e.d = i_pair[i];
+           event_table.push_back(e);
+           
+           // if temp2 is last interaction for this ant pair, add it as well to event_table
+           if (i+1 == i_pair.size()-1){
+             i_pair[i+1].frame_stop = i_pair[i+1].frame_start;
+             // update time
+             i_pair[i+1].time_stop = i_pair[i+1].time_start;
+             event e;
+             e.tag1 = tag_list[t1];
+             e.tag2 = tag_list[t2];
+             e.d = i_pair[i+1];
+             event_table.push_back(e);
+           }							
+           
+           inter.clear();
+           missed= 0;  // reset counter for missed interactions
+         }
+       } // end for i_table
+       
+     }else{  // only 1 interaction between these 2 ants
+     if (tgs.get_state(t1) && tgs.get_state(t2)){
+       //cout<<"only one interaction of 1 frame between ants "<<tag_list[t1]<<" and "<<tag_list[t2]<<endl;
+     }
+     event e;
+     e.tag1 = tag_list[t1];
+     e.tag2 = tag_list[t2];
+     e.d = i_pair[0];
+     e.d.frame_stop = e.d.frame_start;
+     e.d.time_stop = e.d.time_start;
+     event_table.push_back(e);
+     singleinteraction++;
+     }
+   }// end if i_table
+   else{
+     if (tgs.get_state(t1) && tgs.get_state(t2)){
+       //cout<<"no interactions for tags : "<<tag_list[t1]<<" and "<<tag_list[t2]<<endl;
+     }
+   }
+   return singleinteraction;
+ }
+ 
+// ==============================================================================
+/**\fn void filter_chunks(PairTable <interaction_data>& i_table, vector <vector <event> >& chunks, vector <int>& singles, TagsFile& tgs, atomic <size_t>& next, exception_ptr& error, mutex& m, int F_TH, int F_MAX, int X_TH)
+ * \brief Work of a filtering thread: takes the next chunk of pairs of i_table that is not taken yet until all pairs are filtered
+ * \param i_table Table of interactions
+ * \param chunks Events of each chunk of PAIR_CHUNK pairs
+ * \param singles Number of pairs of ants that interacted only once, for each chunk
+ * \param tgs Tags file
+ * \param next Next chunk to filter, shared by the threads
+ * \param error First error of the threads
+ * \param m Mutex protecting error
+ * \param F_TH, F_MAX, X_TH Parameters of filter_pair
+ */
+ void filter_chunks(PairTable <interaction_data>& i_table, vector <vector <event> >& chunks, vector <int>& singles, TagsFile& tgs, atomic <size_t>& next, exception_ptr& error, mutex& m, int F_TH, int F_MAX, int X_TH){
+   size_t c;
+   while ((c = next++) < chunks.size()){
+     try{
+       size_t last = min((c+1) * PAIR_CHUNK, i_table.pair_count());
+       for (size_t p (c * PAIR_CHUNK); p < last; p++){
+         singles[c] += filter_pair(i_table, p, chunks[c], tgs, F_TH, F_MAX, X_TH);
+       }
+     }catch(...){
+       lock_guard <mutex> lock (m);
+       if (!error){
+         error = current_exception();
+       }
+       next = chunks.size();
+     }
+   }
+ }
+
+// ==============================================================================
+/**\fn int filter_pairs(PairTable <interaction_data>& i_table, vector <event>& event_table, TagsFile& tgs, int F_TH, int F_MAX, int X_TH, int threads)
+ * \brief Merges the interactions of each pair of ants of i_table into events
+ * \param i_table Table of interactions
+ * \param event_table Table to which the events are added, in the order of the pairs
+ * \param tgs Tags file
+ * \param F_TH Maximal number of frames between 2 interactions of the same event
+ * \param F_MAX Maximal duration of an event in frames
+ * \param X_TH Maximal variation in x and y coordinates between 2 interactions of the same event
+ * \param threads Number of threads, the chunks of pairs of i_table are distributed dynamically between them
+ * \return Number of pairs of ants that interacted only once
+ */
+ int filter_pairs(PairTable <interaction_data>& i_table, vector <event>& event_table, TagsFile& tgs, int F_TH, int F_MAX, int X_TH, int threads){
+   int singleinteraction (0); // number of ant pairs that had a single 1 frame interaction
+   if (threads <= 1){
+     for (size_t p (0); p < i_table.pair_count(); p++){
+       singleinteraction += filter_pair(i_table, p, event_table, tgs, F_TH, F_MAX, X_TH);
+     }
+     return singleinteraction;
+   }
+   
+   // the pairs are independent, the events of each chunk of pairs are kept apart and appended in the order of the pairs,
+   // so that event_table is the same as in a serial run
+   vector <vector <event> > chunks ((i_table.pair_count() + PAIR_CHUNK - 1) / PAIR_CHUNK);
+   vector <int> singles (chunks.size(), 0);
+   atomic <size_t> next (0);
+   exception_ptr error;
+   mutex m;
+   vector <thread> pool;
+   for (int i(0); i < threads; i++){
+     pool.push_back(thread(filter_chunks, ref(i_table), ref(chunks), ref(singles), ref(tgs), ref(next), ref(error), ref(m), F_TH, F_MAX, X_TH));
+   }
+   for (int i(0); i < pool.size(); i++){
+     pool[i].join();
+   }
+   if (error){
+     rethrow_exception(error);
+   }
+   for (size_t c (0); c < chunks.size(); c++){
+     event_table.insert(event_table.end(), chunks[c].begin(), chunks[c].end());
+     singleinteraction += singles[c];
+   }
+   return singleinteraction;
+ }
+
+// ==============================================================================
+/**\fn void write_events(const string& output, vector <event>& event_table, EventSummary* summary)
+ * \brief Sorts the events by start frame and writes them to a file
+ * \param output Name of the file to create
+ * \param event_table Events
+ * \param summary Statistics to which the written events are added (NULL if none)
+ */
+ void write_events(const string& output, vector <event>& event_table, EventSummary* summary){
+   // sorting the events
+   cout<<"sorting the events temporally ..."<<endl;
+   sort(event_table.begin(), event_table.end(), cmp);
+   
+   
+   // writing outfile
+   ofstream g;
+   g.open(output.c_str());
+   if (!g.is_open()){
+     throw Exception(CANNOT_OPEN_FILE, output);
+   }
+   g<<EVENT_HEADER<<endl;
+   
+   cout<<"writing sorted events to file..."<<endl;
+   for (int i(0); i< event_table.size(); i++){
+     if ((event_table[i].d.frame_stop - event_table[i].d.frame_start +1)  > F_MIN){
+       if (summary != NULL){
+         summary->add(event_table[i].tag1, event_table[i].tag2, event_table[i].d.frame_start, event_table[i].d.frame_stop, event_table[i].d.time_start);
+       }
+       g<<event_table[i].tag1<<","<<event_table[i].tag2<<","<<event_table[i].d.frame_start<<","<<event_table[i].d.frame_stop<<",";
+       g.precision(12);
+       g<<event_table[i].d.time_start<<",";
+       g.precision(12);
+       g<<event_table[i].d.time_stop<<","<<event_table[i].d.box<<",";
+       g<<event_table[i].d.x1<<","<<event_table[i].d.y1<<","<<event_table[i].d.a1<<",";
+       g<<event_table[i].d.x2<<","<<event_table[i].d.y2<<","<<event_table[i].d.a2<<",";
+       g<<event_table[i].d.direction<<","<<event_table[i].d.det;
+        //g<<i_table[idx1][idx2].push_back(temp);
+       g<<endl;
+     }
+   }
+   
+   g.close();
+ }
+ 
  
  //								MAIN
  // ==============================================================================
@@ -255,9 +599,12 @@ bool cmp(const event& a, const event& b){
      int F_TH = -1; // threshold for temporary close interaction, they are tested whether they are part of the same event 
      int F_MAX = 0; /// maximal duration in frames of interaction, if longer than is considered to be
      int X_TH = -1; // maximal variation in x and y coordinate that is accepted for interactions belonging to the same event
+     int shards = 0; // number of shards of the input (written by interaction -k), 0 for a single input file
+     int threads = 1; // number of threads filtering the pairs of ants
+     string summary_file = ""; // file of statistics on the events, empty if they are not computed
      
      // extract options
-     while((option = getopt(argc, argv, ":i:o:t:m:d:")) !=-1){
+     while((option = getopt(argc, argv, ":i:o:t:m:d:k:j:c:")) !=-1){
        switch(option){
          case 'i':
          input = (string)optarg;
@@ -274,6 +621,21 @@ bool cmp(const event& a, const event& b){
          case 'd':
          X_TH = atoi(optarg);
          break;
+         case 'k':
+         shards = atoi(optarg);
+         if (shards < 1){
+           throw Exception(PARAMETER_ERROR, "The number of shards (option -k) must be positive.");
+         }
+         break;
+         case 'c':
+         summary_file = (string)optarg;
+         break;
+         case 'j':
+         threads = atoi(optarg);
+         if (threads < 1){
+           throw Exception(PARAMETER_ERROR, "The number of threads (option -j) must be positive.");
+         }
+         break;
          case '?':
          {
            string info = "-" + string(1, optopt);
@@ -288,7 +650,10 @@ bool cmp(const event& a, const event& b){
      }
      
      if (argc < 6){
-       string info = (string)argv[0] + " -i input.txt -o output.txt -t timethreshold(frames)  -m max_duration(frames) -d distance_threshold(pixels) input.tags";
+       string info = (string)argv[0] + " -i input.txt -o output.txt -t timethreshold(frames)  -m max_duration(frames) -d distance_threshold(pixels) [-k shards] [-j threads] [-c summary.txt] input.tags\n"
+         + "  -k  the input is split by pair into input.txt_1 to input.txt_k (interaction -k), the shards are filtered one after the other\n"
+         + "  -j  number of threads filtering the pairs of ants\n"
+         + "  -c  also write statistics on the written events to summary.txt: distribution of the durations, totals of each ant, of each pair and of each hour";
        throw Exception(USE, info);
      }
      
@@ -331,296 +696,75 @@ bool cmp(const event& a, const event& b){
        throw Exception (OUTPUT_EXISTS, output);
      }
      
-     // create table with interactions and inilialize with empty vectors of type data
-     vector <vector <interactions> > i_table;
-     i_table.resize(tag_count);
-     for (int i(0); i < tag_count; i++) {
-       i_table[i].resize(tag_count);
-     }
-     
-     // read data from file and store in i_table
-     cout<<"reading data from input..."<<endl;
-     read_interaction_file(input, i_table);
-     // display interactions for all ant pairs
-     for (int i(0); i < tag_count-1; i++){
-       for (int j(i+1); j < tag_count; j++){
-         if (tgs.get_state(i) && tgs.get_state(j) && i_table[i][j].size() == 0){
-           //cout<<"["<<tag_list[i]<<"]["<<tag_list[j]<<"] = "<<i_table[i][j].size()<<endl;
-         }
+     if (summary_file != ""){
+       f.open(summary_file.c_str());
+       if (f.is_open()){
+         f.close();
+         throw Exception (OUTPUT_EXISTS, summary_file);
        }
      }
+     // statistics computed while the events are written
+     EventSummary stats;
+     EventSummary* summary = (summary_file == "") ? NULL : &stats;
      
      vector <event> event_table;
-     int missed[tag_count][tag_count];
-     memset(&missed, 0, sizeof(missed));
      int singleinteraction (0); // number of ant pairs that had a single 1 frame interaction
      
-     // verify interactions in i_table
-     cout<<"filtering interactions..."<<endl;
-     for (int t1 (0); t1<tag_count-1; t1++){
-       for(int t2 (t1+1); t2 < tag_count; t2++){
-         
-         // check whether there are interactions for a given pair of ants
-         if (!i_table[t1][t2].empty()){
-           //cout<<"====> tags"<<tag_list[t1]<<" and "<<tag_list[t2]<<endl;
-           
-           // if there is more than one interaction between the 2 ants, check whether several interactions are part of same interaction event
-           if (i_table[t1][t2].size() > 1){
-             
-             /*
-             for (int a(0); a < i_table[t1][t2].size(); a++){
-             cout<<i_table[t1][t2][a].frame_start<<" - "<<i_table[t1][t2][a].frame_stop<<endl;
-             }*/
-             
-             vector <data> inter;
-             for (int i(0); i<i_table[t1][t2].size()-1; i++){
-               
-               //if (i==100)return 1;
-               // read element and compare with next one
-               data temp1 = i_table[t1][t2][i];
-               data temp2 = i_table[t1][t2][i+1];
-               //cout<<"reading:"<<endl;
-               //cout<<i_table[t1][t2][i].frame_start<<" - "<<i_table[t1][t2][i].frame_stop<<endl;
-               //cout<<i_table[t1][t2][i+1].frame_start<<" - "<<i_table[t1][t2][i+1].frame_stop<<endl;
-               
-               // if 2 subsequent interactions are temporally close (nb of frames between them < F_TH), test if same event
-               // if it is the first interaction of the event (frame_stop == 0) check distance between start frames, otherwise check distance between stop of first and start of second
-               if ((temp1.frame_stop == 0 && temp2.frame_start - temp1.frame_start < F_TH ) || temp2.frame_start - temp1.frame_stop < F_TH){
-                 
-                 // check positions and angles of interacting ants,
-                 // if positions are close, interactions are part of same event
-                 if ((temp2.x1 - temp1.x1 < X_TH) && (temp2.y1 - temp1.y1 < X_TH) && (temp2.x2 - temp1.x2 < X_TH) && (temp2.y2 - temp1.y2 < X_TH)){
-                   
-                   // use first 2 interactions of an event: set start frame of first interaction (the one read into temp1) to zero to mark as read and, and set start frame of second interaction in i_table to start frame of first interaction 
-                   if (temp1.frame_stop == 0){
-                     //cout<<"first event"<<temp1.frame_start<<endl;
-                     //cout<<"second event"<<temp2.frame_start<<endl;
-                     // test if there are frames missing between the subsequent interactions detected, if so count how many
-                     missed [t1][t2]+= temp2.frame_start - temp1.frame_start;
-                     // update the start and stop frame in the list i_table
-                     int tmp = temp2.frame_start;
-                     i_table[t1][t2][i+1].frame_start = temp1.frame_start;
-                     i_table[t1][t2][i+1].frame_stop = tmp;
-                     i_table[t1][t2][i].frame_start = 0;
-                     // update also time
-                     double tmp2 = temp2.time_start;
-                     i_table[t1][t2][i+1].time_start = temp1.time_start;
-                     i_table[t1][t2][i+1].time_stop = tmp2;
-                     
-                     //cout<<"add to inter 1: "<<temp2.x1<<","<<temp2.y1<<endl;
-                     inter.push_back(temp1);
-                     //inter.push_back(temp2);
-                     
-                     // third or further interaction of event
-                   }else{
-                     // test if there are frames missing between the subsequent interactions detected, if so count how many
-                     missed [t1][t2]+= temp2.frame_start - temp1.frame_stop;
-                     i_table[t1][t2][i+1].frame_stop = temp2.frame_start;
-                     i_table[t1][t2][i+1].frame_start = temp1.frame_start;
-                     i_table[t1][t2][i].frame_start = 0;
-                     // update also time
-                     i_table[t1][t2][i+1].time_stop = temp2.time_start;
-                     i_table[t1][t2][i+1].time_start = temp1.time_start;
-                   }
-                   
-                   //add interaction to table for coordinate calculations
-                   inter.push_back(temp2);
-                   
-                   
-                   // if temp2 is last interaction of event and this is the last event for this ant pair
-                   if (i+1 == i_table[t1][t2].size()-1){
-                     
-                     //cout<<"last interaction "<< i_table[t1][t2][i+1].frame_start<<" - "<<i_table[t1][t2][i+1].frame_stop<<endl;
-                     // calculate duration of event, if long test calculate quality
-                     int duration = i_table[t1][t2][i+1].frame_stop - i_table[t1][t2][i+1].frame_start + 1;
-                     
-                     // check if previous event is of reasonable duration (less than F_MAX frames), if not cut it at F_MAX
-                     bool length (false);
-                     if (i_table[t1][t2][i+1].frame_stop - i_table[t1][t2][i+1].frame_start + 1 > F_MAX){
-                       i_table[t1][t2][i+1].frame_stop = i_table[t1][t2][i+1].frame_start + F_MAX;
-                       // update time
-                       i_table[t1][t2][i+1].time_stop = i_table[t1][t2][i+1].time_start + (F_MAX/2);
-                       length = true;
-                     }
-                     
-                     // calculate average position and angle
-                     //cout<<"Calculate average for interactions between tags "<<tag_list[t1]<<" and "<<tag_list[t2]<<endl;
-                     if (! average_position( i_table[t1][t2][i+1], inter, length,F_MAX)){
-                       return 1;
-                     }
-                     
-                     // add event
-                     event e;
-                     e.tag1 = tag_list[t1];
-                     e.tag2 = tag_list[t2];
-                     e.d = i_table[t1][t2][i+1];
-                     event_table.push_back(e);
-                   }
-                   
-                   // interactions are part of distinct events
-                 }else{
-                   
-                   // if previous event was only 1 frame long set stop frame to start frame
-                   if (i_table[t1][t2][i].frame_stop == 0){
-                     i_table[t1][t2][i].frame_stop = i_table[t1][t2][i].frame_start;
-                     // update time
-                     i_table[t1][t2][i].time_stop = i_table[t1][t2][i].time_start;
-                     i_table[t1][t2][i].det = 1;
-                   }
-                   
-                   // calculate duration of event, if it is long -> calculate quality
-                   int duration = i_table[t1][t2][i].frame_stop - i_table[t1][t2][i].frame_start + 1;
-                   
-                   // check if previous event is of reasonable duration (less than F_MAX frames), if not cut it at F_MAX
-                   bool length (false);
-                   if (i_table[t1][t2][i].frame_stop - i_table[t1][t2][i].frame_start + 1 > F_MAX){
-                     i_table[t1][t2][i].frame_stop = i_table[t1][t2][i].frame_start + F_MAX;
-                     // update time
-                     i_table[t1][t2][i].time_stop = i_table[t1][t2][i].time_start + (F_MAX/2);
-                     length = true;
-                   }
-                   
-                   // if the previous event had several interactions, then calculate average positions of ants
-                   if (!inter.empty()){
-                     //cout<<"calling average position2. length = "<<length<<endl;
-                     //cout<<"2. Calculate average for interactions between tags "<<tag_list[t1]<<" and "<<tag_list[t2]<<endl;
-                     if (! average_position(i_table[t1][t2][i], inter, length, F_MAX)){
-                       return 1;
-                     }
-                   }else{                   // if the previous event had a single interaction, still fill in the AB etc information
-                   }
-                   
-                   // add event to table
-                   event e;
-                   e.tag1 = tag_list[t1];
-                   e.tag2 = tag_list[t2];
-                   e.d = i_table[t1][t2][i];
-                   event_table.push_back(e);
-                   inter.clear();
-                   missed[t1][t2]= 0; // reset counter for missed interactions
-                   
-                   // if temp2 is last interaction for this ant pair, add it as well to event_table
-                   if (i+1 == i_table[t1][t2].size()-1){
-                     i_table[t1][t2][i+1].frame_stop = i_table[t1][t2][i+1].frame_start;
-                     // update time
-                     i_table[t1][t2][i+1].time_stop = i_table[t1][t2][i+1].time_start;
-                     event e;
-                     e.tag1 = tag_list[t1];
-                     e.tag2 = tag_list[t2];
-                     e.d = i_table[t1][t2][i+1];
-                     event_table.push_back(e);
-                   }
-                 }
-                 
-                 
-                 // 2 subsequent interaction are NOT temporally close --> distinct events
-               }else{
-                 if (i_table[t1][t2][i].frame_stop == 0){
-                   i_table[t1][t2][i].frame_stop = i_table[t1][t2][i].frame_start;
-                   // update time
-                   i_table[t1][t2][i].time_stop = i_table[t1][t2][i].time_start;
-                 }
-                 //cout<<"new event: "<<temp1.frame_start<<" - "<<temp1.frame_stop<<endl;
-                 
-                 // calculate duration of event, if long test calculate quality
-                 int duration = i_table[t1][t2][i].frame_stop - i_table[t1][t2][i].frame_start + 1;
-                 bool length (false);
-                 // check if previous event is of reasonable duration (less than F_MAX frames), if not cut it at F_MAX
-                 if (i_table[t1][t2][i].frame_stop - i_table[t1][t2][i].frame_start + 1 > F_MAX){
-                   i_table[t1][t2][i].frame_stop = i_table[t1][t2][i].frame_start + F_MAX;
-                   //update time
-                   i_table[t1][t2][i].time_stop = i_table[t1][t2][i].time_start + (F_MAX/2);
-                   length = true;
-                 }
-                 
-                 // if the previous event had several interactions, then calculate average positions of ants
-                 if (!inter.empty()){
-                   //cout<<"calling average position3. length = "<<length<<endl;
-                   //cout<<"3. Calculate average for interactions between tags "<<tag_list[t1]<<" and "<<tag_list[t2]<<endl;
-                   
-                   if (!average_position(i_table[t1][t2][i], inter, length, F_MAX)){
-                     return 1;
-                   }
-                 }else{                   // if the previous event had a single interaction, still fill in the AB etc information
-                 }
-                 
-                 event e;
-                 e.tag1 = tag_list[t1];
-                 e.tag2 = tag_list[t2];
-                 e.d = i_table[t1][t2][i];
-                 event_table.push_back(e);
-                 
-                 // if temp2 is last interaction for this ant pair, add it as well to event_table
-                 if (i+1 == i_table[t1][t2].size()-1){
-                   i_table[t1][t2][i+1].frame_stop = i_table[t1][t2][i+1].frame_start;
-                   // update time
-                   i_table[t1][t2][i+1].time_stop = i_table[t1][t2][i+1].time_start;
-                   event e;
-                   e.tag1 = tag_list[t1];
-                   e.tag2 = tag_list[t2];
-                   e.d = i_table[t1][t2][i+1];
-                   event_table.push_back(e);
-                 }							
-                 
-                 inter.clear();
-                 missed[t1][t2]= 0;  // reset counter for missed interactions
-               }
-             } // end for i_table
-             
-           }else{  // only 1 interaction between these 2 ants
-           if (tgs.get_state(t1) && tgs.get_state(t2)){
-             //cout<<"only one interaction of 1 frame between ants "<<tag_list[t1]<<" and "<<tag_list[t2]<<endl;
-           }
-           event e;
-           e.tag1 = tag_list[t1];
-           e.tag2 = tag_list[t2];
-           e.d = i_table[t1][t2][0];
-           e.d.frame_stop = e.d.frame_start;
-           e.d.time_stop = e.d.time_start;
-           event_table.push_back(e);
-           singleinteraction++;
-           }
-         }// end if i_table
-         else{
-           if (tgs.get_state(t1) && tgs.get_state(t2)){
-             //cout<<"no interactions for tags : "<<tag_list[t1]<<" and "<<tag_list[t2]<<endl;
-           }
+     if (shards == 0){
+       // create table with interactions and inilialize with empty vectors of type data
+       PairTable <interaction_data> i_table;
+       
+       // read data from file and store in i_table
+       cout<<"reading data from input..."<<endl;
+       read_interaction_file(input, i_table);
+       
+       cout<<"filtering interactions..."<<endl;
+       singleinteraction = filter_pairs(i_table, event_table, tgs, F_TH, F_MAX, X_TH, threads);
+       i_table.clear();
+       write_events(output, event_table, summary);
+     }else{
+       // each shard contains all interactions of its pairs: the shards are filtered one after the other into output_n,
+       // so that only one shard is in memory, then the sorted event files are merged into output and removed
+       vector <string> parts;
+       for (int s(1); s <= shards; s++){
+         string part = output + "_" + to_string(s);
+         f.open(part.c_str());
+         if (f.is_open()){
+           f.close();
+           throw Exception (OUTPUT_EXISTS, part);
          }
-       }// end for t2
-     }// end for t1
-     
-     cout<<"There were "<<singleinteraction<<" antpairs that interaction only once for 1 frame. "<<endl; 
-     
-     // sorting the events
-     cout<<"sorting the events temporally ..."<<endl;
-     sort(event_table.begin(), event_table.end(), cmp);
-     
-     
-     // writing outfile
-     ofstream g;
-     g.open(output.c_str());
-     if (!g.is_open()){
-       throw Exception(CANNOT_OPEN_FILE, output);
+         parts.push_back(part);
+       }
+       // the parts are removed once merged, or when an error occurs
+       try{
+         for (int s(1); s <= shards; s++){
+           PairTable <interaction_data> i_table;
+           cout<<"reading data from shard "<<s<<"..."<<endl;
+           read_interaction_file(input + "_" + to_string(s), i_table);
+           cout<<"filtering interactions..."<<endl;
+           singleinteraction += filter_pairs(i_table, event_table, tgs, F_TH, F_MAX, X_TH, threads);
+           i_table.clear();
+           write_events(parts[s - 1], event_table, summary);
+           event_table.clear();
+         }
+         cout<<"merging the events of the shards..."<<endl;
+         merge_event_files(parts, output);
+       }catch(...){
+         for (int s(0); s < parts.size(); s++){
+           remove(parts[s].c_str());
+         }
+         throw;
+       }
+       for (int s(0); s < parts.size(); s++){
+         remove(parts[s].c_str());
+       }
      }
-     g<<"#Tag1,Tag2,Startframe,Stopframe,Starttime,Stoptime,Box,Xcoor1,Ycoor1,Angle1,Xcoor2,Ycorr2,Angle2,Direction,Detections"<<endl;
      
-     cout<<"writing sorted events to file..."<<endl;
-     for (int i(0); i< event_table.size(); i++){
-       if ((event_table[i].d.frame_stop - event_table[i].d.frame_start +1)  > F_MIN){
-         g<<event_table[i].tag1<<","<<event_table[i].tag2<<","<<event_table[i].d.frame_start<<","<<event_table[i].d.frame_stop<<",";
-         g.precision(12);
-         g<<event_table[i].d.time_start<<",";
-         g.precision(12);
-         g<<event_table[i].d.time_stop<<","<<event_table[i].d.box<<",";
-         g<<event_table[i].d.x1<<","<<event_table[i].d.y1<<","<<event_table[i].d.a1<<",";
-         g<<event_table[i].d.x2<<","<<event_table[i].d.y2<<","<<event_table[i].d.a2<<",";
-         g<<event_table[i].d.direction<<","<<event_table[i].d.det;
-          //g<<i_table[idx1][idx2].push_back(temp);
-         g<<endl;
-       }
+     if (summary != NULL){
+       summary->write(summary_file);
      }
      
-     g.close();
+     cout<<"There were "<<singleinteraction<<" antpairs that interaction only once for 1 frame. "<<endl; 
      
      return 0; 
    }catch(Exception e){
@@ -16,6 +16,10 @@
 #include <sstream>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <atomic>
+#include <exception>
 #include <getopt.h>
 
 #include <datfile.h>
@@ -26,14 +30,13 @@
 #include <statistics.h>
 #include <utils.h>
 #include <trackcvt.h>
+#include <occupancy_cube.h>
 
 using namespace std;
 
 const int START = 1167609600; // UNIX time of 1st january 2007 00:00:00, no data exists from before
-const int HEATMAP_REDUCTION = 5;
-const int HEATMAP_X = IMAGE_WIDTH / HEATMAP_REDUCTION;
-const int HEATMAP_Y = IMAGE_HEIGHT / HEATMAP_REDUCTION;
-const int HEATMAP_SIZE = HEATMAP_X * HEATMAP_Y;
+const int BATCH_FRAMES = 1024;		///< frames read at once from the dat file
+const int MAX_TAG_HEATMAPS = 3;		///< heatmaps of a tag: colony, group and ant
 
 
 struct statistics{
@@ -63,25 +66,278 @@ int find_max(int* heatmap){
 
 
 //================================================================================
-bool write_textfile(int* heatmap, string textfile){
+/**\fn bool write_textfile(const int* heatmap, string textfile)
+* \brief Writes a heatmap as text, one line x,y,value per cell
+* \param heatmap Heatmap
+* \param textfile Name of the file
+* \return True if the file was written, false otherwise
+*/
+bool write_textfile(const int* heatmap, string textfile){
   ofstream f;
   f.open(textfile.c_str());
   if (!f.is_open()){
     return false;
   }
-  cout<<"writing to file..."<<endl;
+  string text;
+  text.reserve(HEATMAP_X * 16);
+  char line[48];
   for (int i(0); i< HEATMAP_SIZE; i++){
     if (heatmap[i]<0) { // no control on upper values possible
       cerr << "No, this shouldn't happen! heatmap contains " << heatmap[i] << endl;
     }
     int x = i % HEATMAP_X;
     int y = i / HEATMAP_X;
-    f<<x<<","<<y<<","<<heatmap[i]<<endl;
-    
+    text.append(line, snprintf(line, sizeof(line), "%d,%d,%d\n", x, y, heatmap[i]));
+    // one row of the heatmap at a time
+    if (x == HEATMAP_X - 1){
+      f.write(text.data(), text.size());
+      text.clear();
+    }
   }
-  cout<<"...finished"<<endl;
+  f.write(text.data(), text.size());
   f.close();
-  return true;
+  return !f.fail();
+}
+
+
+/// heatmaps to which the detections of a tag are added: dense lookup table built once from the colony, groups and ants requested
+struct tag_heatmaps{
+  int idx;                            ///< index of the tag in tag_list
+  int death;                          ///< frame of death, 0 if alive
+  int n;                              ///< number of heatmaps
+  int heatmap[MAX_TAG_HEATMAPS];      ///< index of the heatmaps
+};
+
+/// frames of an interval accumulated by a thread into its own heatmaps
+struct accumulation{
+  long long begin;                    ///< index of the first frame in the dat file
+  long long end;                      ///< index of the end (excluded)
+  vector <int> grids;                 ///< heatmaps of the thread, one after the other
+  vector <char> data;                 ///< true for the heatmaps with data
+  exception_ptr error;
+};
+
+
+//================================================================================
+/**\fn void accumulate(const string& datfile, const vector <tag_heatmaps>& tags, int box, accumulation& a)
+* \brief Work of a thread: adds the detections in the box of a range of frames to the heatmaps of the thread
+* \param datfile Name of the dat file, read with a DatFile of the thread
+* \param tags Heatmaps of each tag that has heatmaps
+* \param box Box of the detections
+* \param a Range of frames and heatmaps of the thread
+*/
+void accumulate(const string& datfile, const vector <tag_heatmaps>& tags, int box, accumulation& a){
+  try{
+    memset(&a.grids[0], 0, a.grids.size() * sizeof(int));
+    a.data.assign(a.data.size(), false);
+    if (a.begin >= a.end){
+      return;
+    }
+    DatFile dat;
+    dat.open(datfile, 0);
+    dat.go_to_frame(dat.get_first_frame() + a.begin);
+    vector <framerec> buffer (BATCH_FRAMES);
+    for (long long k (a.begin); k < a.end; ){
+      int wanted = min((long long) BATCH_FRAMES, a.end - k);
+      if (!dat.read_frame(&buffer[0], wanted)){
+        break;
+      }
+      int n = dat.get_count();
+      for (int f(0); f < n; f++){
+        const framerec& temp = buffer[f];
+        for (size_t j(0); j < tags.size(); j++){
+          const tag_heatmaps& t = tags[j];
+          const tag_pos& p = temp.tags[t.idx];
+          if ((t.death == 0 || (int) temp.frame < t.death) && p.id == box && p.x != -1){
+            int x = min(p.x / HEATMAP_REDUCTION, HEATMAP_X - 1);
+            int y = min(p.y / HEATMAP_REDUCTION, HEATMAP_Y - 1);
+            for (int h(0); h < t.n; h++){
+              a.grids[(size_t) t.heatmap[h] * HEATMAP_SIZE + y * HEATMAP_X + x]++;
+              a.data[t.heatmap[h]] = true;
+            }
+          }
+        }
+      }
+      k += n;
+      if (n < wanted){
+        break;
+      }
+    }
+    dat.close();
+  }catch(...){
+    a.error = current_exception();
+  }
+}
+
+//================================================================================
+/**\fn void reduce(vector <accumulation>& acc, size_t from, size_t to)
+* \brief Work of a thread: adds the cells [from, to) of the heatmaps of all threads to the heatmaps of the first thread
+* \param acc Heatmaps of the threads
+* \param from First cell
+* \param to End (excluded)
+*/
+void reduce(vector <accumulation>& acc, size_t from, size_t to){
+  int* sum = &acc[0].grids[0];
+  for (size_t t(1); t < acc.size(); t++){
+    const int* g = &acc[t].grids[0];
+    for (size_t i(from); i < to; i++){
+      sum[i] += g[i];
+    }
+  }
+}
+
+//================================================================================
+/**\fn void write_heatmaps(const vector <int>& grids, const vector <pair <int, string> >& files, atomic <size_t>& next, exception_ptr& error)
+* \brief Work of a thread: writes the next heatmap of the list that is not written yet, until all are written
+* \param grids Heatmaps, one after the other
+* \param files Index of the heatmap and name of each file to write
+* \param next Next file, shared by the threads
+* \param error Error of the thread
+*/
+void write_heatmaps(const vector <int>& grids, const vector <pair <int, string> >& files, atomic <size_t>& next, exception_ptr& error){
+  try{
+    size_t i;
+    while ((i = next++) < files.size()){
+      if (!write_textfile(&grids[(size_t) files[i].first * HEATMAP_SIZE], files[i].second)){
+        throw Exception(CANNOT_OPEN_FILE, files[i].second);
+      }
+    }
+  }catch(...){
+    error = current_exception();
+  }
+}
+
+//================================================================================
+/**\fn double frame_time(DatFile& dat, long long i)
+* \brief Reads the time of a frame
+* \param dat Dat file
+* \param i Index of the frame in the file
+* \return Time of the frame
+*/
+double frame_time(DatFile& dat, long long i){
+  dat.go_to_frame(dat.get_first_frame() + i);
+  framerec temp;
+  if (!dat.read_frame(temp)){
+    throw Exception(CANNOT_READ_FILE, "frame " + to_string(dat.get_first_frame() + i));
+  }
+  return temp.time;
+}
+
+//================================================================================
+/**\fn long long find_time(DatFile& dat, long long from, long long count, double limit)
+* \brief Finds the first frame at or after a time (binary search)
+* \param dat Dat file
+* \param from Index of the first frame searched
+* \param count Number of frames in the file
+* \param limit Time
+* \return Index of the first frame from "from" with a time of at least limit, count if there is none
+*/
+long long find_time(DatFile& dat, long long from, long long count, double limit){
+  long long lo (from);
+  long long hi (count);
+  while (lo < hi){
+    long long mid = lo + (hi - lo) / 2;
+    if (frame_time(dat, mid) >= limit){
+      hi = mid;
+    }else{
+      lo = mid + 1;
+    }
+  }
+  return lo;
+}
+
+
+//================================================================================
+/**\fn void write_interval(int fi, const vector <int>& grids, const vector <char>& data, bool colony, const vector <string>& groups, const vector <int>& ants, const string& matlabfile, int threads)
+* \brief Reports the heatmaps of an interval that have data and writes them in parallel
+* \param fi Number of the interval
+* \param grids Heatmaps of the colony (if requested), then of the groups, then of the ants, one after the other
+* \param data True for the heatmaps with data
+* \param colony True if there is a heatmap of the colony
+* \param groups Groups
+* \param ants Ants
+* \param matlabfile Beginning of the names of the files, no files are written if empty
+* \param threads Number of threads writing the files
+*/
+void write_interval(int fi, const vector <int>& grids, const vector <char>& data, bool colony, const vector <string>& groups, const vector <int>& ants, const string& matlabfile, int threads){
+  int first_group = colony ? 1 : 0;
+  int first_ant = first_group + groups.size();
+  if (colony && data[0]){
+    cout<<"There is data for the colony."<<endl;
+  }
+  for (int i(0); i< (int) groups.size(); i++){
+    if (data[first_group + i]){
+      cout<<"There is group data for group "<< groups[i]<<"."<<endl;
+    }
+  }
+  for (int i(0); i< (int) ants.size(); i++){
+    if (data[first_ant + i]){
+      cout<<"There is ant data for group "<< ants[i]<<"."<<endl;
+    }
+  }
+  
+  
+  
+  // creating and writing output files for the interval, in parallel
+  vector <pair <int, string> > files;
+  // colony
+  if(colony){
+    if (data[0]){
+      if (matlabfile !=""){
+        stringstream ss;
+        ss<< matlabfile << "_col_" << fi << ".txt";
+        files.push_back(make_pair(0, ss.str()));
+      }
+      
+    }else{
+      cerr<<"No data for colony."<<endl;
+    }
+  }
+  //ants
+  for (int i(0); i< (int) ants.size(); i++){
+    
+    if (data[first_ant + i]) {
+      if (matlabfile !=""){
+        stringstream ss;
+        ss<< matlabfile << "_ant" << to_string(ants[i]) << fi << ".txt";
+        files.push_back(make_pair(first_ant + i, ss.str()));
+      }
+      
+      
+    }else{
+      cerr<<"No data for ant "<<ants[i]<<"."<<endl; 
+    }
+  }
+  //groups
+  for (int i(0); i< (int) groups.size(); i++){
+    
+    if (data[first_group + i]) {
+      if (matlabfile !=""){
+        stringstream ss;
+        ss<< matlabfile << "_group" << groups[i] << fi << ".txt";
+        files.push_back(make_pair(first_group + i, ss.str()));
+      }
+    }else{
+      cerr<<"No data for group "<<groups[i]<<"."<<endl; 
+    }
+  }
+  for (size_t i(0); i < files.size(); i++){
+    cout<<"writing "<<files[i].second<<endl;
+  }
+  atomic <size_t> next (0);
+  vector <exception_ptr> errors (threads);
+  vector <thread> pool;
+  for (int i(0); i < threads; i++){
+    pool.push_back(thread(write_heatmaps, cref(grids), cref(files), ref(next), ref(errors[i])));
+  }
+  for (int i(0); i < threads; i++){
+    pool[i].join();
+  }
+  for (int i(0); i < threads; i++){
+    if (errors[i]){
+      rethrow_exception(errors[i]);
+    }
+  }
 }
 
 
@@ -106,10 +362,12 @@ int main (int argc, char* argv[]){
     vector <string> groups; //ID of group, should be identical in tagsfile in column group
     int ctr_groups = 0; ///< number of groups
     string matlabfile = ""; // filename for textfiles (as input for matlab)
+    int threads = 1;	// number of threads accumulating the heatmaps
+    string cubefile = ""; // occupancy cube (heatmap_cube) from which the heatmaps are computed instead of the dat file
     
     // process arguments
     char option;
-    while ((option = getopt(argc, argv, ":t:i:b:s:d:a:n:cg:h:m:")) != -1) {
+    while ((option = getopt(argc, argv, ":t:i:b:s:d:a:n:cg:h:m:j:k:")) != -1) {
       switch (option)
       {
       case '?':
@@ -142,6 +400,12 @@ int main (int argc, char* argv[]){
       case 'm':
         matlabfile = (string) optarg;
         break;
+      case 'j':
+        threads = atoi(optarg);
+        break;
+      case 'k':
+        cubefile = (string) optarg;
+        break;
       case 'a': 
         {
           int ant = atoi(optarg);
@@ -167,28 +431,23 @@ int main (int argc, char* argv[]){
     
     // test if enough arguments
     if (argc < 7){
-      string info = (string) argv[0] + " -i input.dat -t intput.tags -b boxID -s unixstart(sec) -d interval(sec) -n nb_intervals(default=1) [-h columnname=group] [-a antID | -g groupID | -c] -m outputname";
+      string info = (string) argv[0] + " -i input.dat -t intput.tags -b boxID -s unixstart(sec) -d interval(sec) -n nb_intervals(default=1) [-h columnname=group] [-a antID | -g groupID | -c] [-j threads(default=1)] -m outputname\n"
+        + "  or: " + (string) argv[0] + " -k input.cube -s unixstart(sec) -d interval(sec) -n nb_intervals(default=1) [-a antID | -g groupID | -c] [-j threads(default=1)] -m outputname\n"
+        + "  -k  computes the heatmaps from an occupancy cube built by heatmap_cube (the frames with a time in [start, end) of each interval),\n"
+        + "      the start and the duration must be multiples of the bins of the cube";
       throw Exception (USE, info);
     }
     
     // check parameters
-    if (datfile == ""){
-      throw Exception(PARAMETER_ERROR, "The filename of option -i is missing.");
-    }
-    if (tagsfile == ""){
-      throw Exception(PARAMETER_ERROR, "The filename of option -t is missing.");
-    }
-    if (!is_valid_ID(box, box_list,box_count)){
-      string b = (string) argv[3];
-      throw Exception (BOX_NOT_FOUND,b);
-    }
-    
     if(start < START){
       throw Exception(PARAMETER_ERROR, "The parameter of option -s need to be a unixtime after " + to_string(START) + ".");
     }
     if (duration < 1){
       throw Exception(PARAMETER_ERROR, "The parameter of the option -n need to be a positiv integrer.");
     }
+    if (threads < 1){
+      throw Exception(PARAMETER_ERROR, "The number of threads (option -j) must be positive.");
+    }
     if(colname == ""){
       throw Exception(PARAMETER_ERROR, "The filename of option -h is empty.");
     }
@@ -197,6 +456,69 @@ int main (int argc, char* argv[]){
       throw Exception (OPTION_MISSING, "An option specifiy for whom the neatmap should be generated is missing. Possible options are -a antID , -g groupID and -c.");
     }
     
+    // heatmaps from the occupancy cube: difference of the slices at the limits of each interval
+    if (cubefile != ""){
+      OccupancyCube cube;
+      cube.open(cubefile);
+      if (box != 0 && box != cube.get_box()){
+        throw Exception(PARAMETER_ERROR, "The cube " + cubefile + " is of box " + to_string(cube.get_box()) + ".");
+      }
+      vector <int> layers;
+      if (colony){
+        layers.push_back(cube.find_layer(CUBE_COLONY, ""));
+      }
+      for (int i(0); i < ctr_groups; i++){
+        layers.push_back(cube.find_layer(CUBE_GROUP, groups[i]));
+      }
+      for (int i(0); i < ctr_ants; i++){
+        layers.push_back(cube.find_layer(CUBE_ANT, to_string(ants[i])));
+      }
+      for (int h(0); h < layers.size(); h++){
+        if (layers[h] == -1){
+          throw Exception(PARAMETER_ERROR, "A requested heatmap (colony, group or ant) is not in the cube " + cubefile + ".");
+        }
+      }
+      int first = cube.get_slice(start);
+      int step = cube.get_slice(cube.get_start() + duration);
+      if (first == -1 || step <= 0){
+        stringstream ss;
+        ss.precision(12);
+        ss << "The start and the duration of the intervals must be on the bins of the cube: " << cube.get_bin() << " seconds from " << cube.get_start() << " to " << cube.get_end() << ".";
+        throw Exception(PARAMETER_ERROR, ss.str());
+      }
+      int feasible = (cube.get_bins() - first) / step;
+      if (feasible == 0){
+        throw Exception(PARAMETER_ERROR, "When starting at " + to_string(start) + " the duration of the first interval exceeds the duration of the cube.");
+      }
+      if (feasible < nb_intervals){
+        cerr<<"Warning: the heatmap can only be calculated for "<<feasible<<" intervals instead of "<<nb_intervals<<" requested."<<endl;
+        nb_intervals = feasible;
+      }
+      
+      vector <int> grids ((size_t) layers.size() * HEATMAP_SIZE);
+      vector <char> data (layers.size());
+      for (int fi(1); fi <=nb_intervals; fi++){
+        cout<<"interval: "<<fi<<endl;
+        for (int h(0); h < layers.size(); h++){
+          data[h] = cube.get_heatmap(layers[h], first + step * (fi - 1), first + step * fi, &grids[(size_t) h * HEATMAP_SIZE]);
+        }
+        write_interval(fi, grids, data, colony, groups, ants, matlabfile, threads);
+      }
+      cube.close();
+      return 0;
+    }
+    
+    if (datfile == ""){
+      throw Exception(PARAMETER_ERROR, "The filename of option -i is missing.");
+    }
+    if (tagsfile == ""){
+      throw Exception(PARAMETER_ERROR, "The filename of option -t is missing.");
+    }
+    if (!is_valid_ID(box, box_list,box_count)){
+      string b = (string) argv[3];
+      throw Exception (BOX_NOT_FOUND,b);
+    }
+    
     DatFile dat;
     dat.open(datfile, 0);
     TagsFile tgs;
@@ -273,215 +595,116 @@ int main (int argc, char* argv[]){
       group_states.push_back(state);
     }
     
+    // heatmaps: colony (if requested), then groups, then ants; dense table of the heatmaps of each tag:
+    // a tag is added to the colony, to the first of its groups and to the heatmap of its first -a option
+    int col_heatmap = colony ? 0 : -1;
+    int first_group = colony ? 1 : 0;
+    int first_ant = first_group + ctr_groups;
+    int nb_heatmaps = first_ant + ctr_ants;
+    vector <tag_heatmaps> tags;
+    for (int i(0); i < tag_count; i++){
+      if (!tgs.get_state(i)){
+        continue;
+      }
+      tag_heatmaps t;
+      t.idx = i;
+      t.death = tgs.get_death(i);
+      t.n = 0;
+      if (colony){
+        t.heatmap[t.n++] = col_heatmap;
+      }
+      for (int j(0); j < ctr_groups; j++){
+        if (group_states[j][i]){
+          t.heatmap[t.n++] = first_group + j;
+          break;
+        }
+      }
+      for (int a(0); a < ctr_ants; a++){
+        if (idx_ants[a] == i){
+          t.heatmap[t.n++] = first_ant + a;
+          break;
+        }
+      }
+      if (t.n > 0){
+        tags.push_back(t);
+      }
+    }
+    
     // go to start time
     dat.go_to_time(start);
     cout << "Current time in file is " ;
     cout.precision(12);
     cout<< dat.get_current_time() << ", start is " << start << endl;
+    long long count = dat.get_frame_count();
+    long long first = dat.get_streampos() / sizeof(framerec);
+    double t = dat.get_current_time();
     
-    bool end = false;
-    
-    // create heatmap tables
-    // generate heatmap raster for colony
-    int* heatmap_col;
-    bool col_data;
-    if(colony){
-      heatmap_col = new int [HEATMAP_SIZE];
-      memset(heatmap_col, 0, sizeof(int) * HEATMAP_SIZE);
-    }
-    // generate heatmap for each tag
-    vector <int*> heatmap_groups;
-    vector <bool> groups_data;
-    groups_data.resize(ctr_groups);
-    for (int i(0); i< ctr_groups; i++){
-      int* heatmap;
-      heatmap = new int[HEATMAP_SIZE];
-      memset(heatmap, 0, sizeof(int) * HEATMAP_SIZE);
-      heatmap_groups.push_back(heatmap);
-    }
-    
-    // generate heatmap for each tag
-    vector <int*> heatmap_ants;
-    vector <bool> ants_data;
-    ants_data.resize(ctr_ants);
-    for (int i(0); i< ctr_ants; i++){
-      int* heatmap;
-      heatmap = new int [HEATMAP_SIZE];
-      memset(heatmap, 0, sizeof(int) * HEATMAP_SIZE);
-      heatmap_ants.push_back(heatmap);
+    // private heatmaps of each thread
+    vector <accumulation> acc (threads);
+    for (int i(0); i < threads; i++){
+      acc[i].grids.resize((size_t) nb_heatmaps * HEATMAP_SIZE);
+      acc[i].data.resize(nb_heatmaps);
     }
     
     cout<<"reading dat file..."<<endl;
     
-    while(!dat.eof() && !end){
+    // an interval contains the frames read while the time of the previous frame is before its end (the first frame of the
+    // interval is the frame following the last frame of the previous interval); an interval reaching the end of the file
+    // ends with the last frame of the file, counted once
+    for (int fi(1); fi <=nb_intervals; fi++){
       
-      for (int fi(1); fi <=nb_intervals; fi++){
-        
-        cout<<"interval: "<<fi<<endl;
-        // reset heatmaps for next interval
-        for (int i(0); i< ctr_ants; i++){
-          memset(heatmap_ants[i], 0, sizeof(int) * HEATMAP_SIZE);
-          ants_data.clear();
-          ants_data.resize(ctr_ants);
-        }
-        for (int i(0); i< ctr_groups; i++){
-          memset(heatmap_groups[i], 0, sizeof(int) * HEATMAP_SIZE);
-          groups_data.clear();
-          groups_data.resize(ctr_groups);
-        }
-        if(colony){
-          memset(heatmap_col, 0, sizeof(int) * HEATMAP_SIZE);
-          col_data = false;
-        }
-        
-        // read value of interval and fill heatmaps
-        double limit = start + duration * fi;
-        double t = dat.get_current_time();
-        while (t < limit && !dat.eof()){
-          framerec temp;
-          dat.read_frame(temp);
-          for (int i (0); i < tag_count; i++){
-            if (tgs.get_state(i) && (tgs.get_death(i)== 0 || temp.frame < tgs.get_death(i))){
-              // test if ant in a group
-              bool in_group = false;
-              int j(0);
-              if (ctr_groups > 0){
-                do{
-                  if (group_states[j][i]){
-                    in_group = true;
-                  }
-                  j++;
-                }while(!in_group && j < ctr_groups);
-              }
-              
-              if (colony || in_group  || (ctr_ants > 0 && ant_state[i])){
-                if (temp.tags[i].id == box && temp.tags[i].x != -1){
-                  int x = temp.tags[i].x/ HEATMAP_REDUCTION;
-                  int y = temp.tags[i].y/ HEATMAP_REDUCTION;
-                  // colony
-                  if (colony){
-                    heatmap_col[y * HEATMAP_X + x]++;
-                    col_data = true;
-                  }
-                  // ant
-                  if (ctr_ants > 0 && ant_state[i]){
-                    int a = 0;
-                    bool found(false);
-                    do {
-                      if (idx_ants[a] == i){
-                        found = true;
-                      }
-                      a++;
-                    }while ( !found && a < ctr_ants);
-                    if (!found){
-                      throw Exception(INTERNAL_ERROR, "Could not find correspondance between index of tag in tag_list and idx_ants.");
-                    }
-                    heatmap_ants[a-1][y * HEATMAP_X + x]++;
-                    ants_data[a-1] = true;
-                  }
-                  // group
-                  if (in_group){
-                    heatmap_groups[j-1][y * HEATMAP_X + x]++;
-                    groups_data[j-1] = true;
-                  }
-                }
-              }
-            }
-          }
-          t = temp.time;
-        }
-        
-        
-        if (col_data){
-          cout<<"There is data for the colony."<<endl;
-        }
-        for (int i(0); i< ctr_groups; i++){
-          if (groups_data[i]){
-            cout<<"There is group data for group "<< groups[i]<<"."<<endl;
-          }
-        }
-        for (int i(0); i< ctr_ants; i++){
-          if (ants_data[i]){
-            cout<<"There is ant data for group "<< ants[i]<<"."<<endl;
-          }
-        }
-        
-        
-        
-        // creating and writing output files for the interval 
-        // colony
-        if(colony){
-          if (col_data){
-            if (matlabfile !=""){
-              stringstream ss;
-              ss<< matlabfile << "_col_" << fi << ".txt";
-              string textfile;
-              ss>>textfile;
-              if (!write_textfile(heatmap_col, textfile)){
-                throw Exception(CANNOT_OPEN_FILE, textfile);
-              }
-            }
-            
-          }else{
-            cerr<<"No data for colony."<<endl;
-          }
-        }
-        //ants
-        for (int i(0); i< ctr_ants; i++){
-          
-          if (ants_data[i]) {
-            if (matlabfile !=""){
-              stringstream ss;
-              ss<< matlabfile << "_ant" << to_string(ants[i]) << fi << ".txt";
-              string textfile;
-              ss>>textfile;
-              if (!write_textfile(heatmap_ants[i], textfile)){
-                throw Exception(CANNOT_OPEN_FILE, textfile);
-              }
-            }
-            
-            
-          }else{
-            cerr<<"No data for ant "<<ants[i]<<"."<<endl; 
-          }
+      cout<<"interval: "<<fi<<endl;
+      
+      double limit = start + duration * fi;
+      long long last = first - 1;
+      if (first < count && t < limit){
+        last = min(find_time(dat, first, count, limit), count - 1);
+      }
+      
+      // frames of the interval, one range per thread, then sum of the heatmaps of the threads
+      vector <thread> pool;
+      for (int i(0); i < threads; i++){
+        acc[i].begin = first + (last + 1 - first) * i / threads;
+        acc[i].end = first + (last + 1 - first) * (i + 1) / threads;
+        acc[i].error = exception_ptr();
+        pool.push_back(thread(accumulate, cref(datfile), cref(tags), box, ref(acc[i])));
+      }
+      for (int i(0); i < threads; i++){
+        pool[i].join();
+      }
+      for (int i(0); i < threads; i++){
+        if (acc[i].error){
+          rethrow_exception(acc[i].error);
         }
-        //groups
-        for (int i(0); i< ctr_groups; i++){
-          
-          if (groups_data[i]) {
-            if (matlabfile !=""){
-              stringstream ss;
-              ss<< matlabfile << "_group" << groups[i] << fi << ".txt";
-              string textfile;
-              ss>>textfile;
-              cout<<"writing "<<textfile<<endl;
-              if (!write_textfile(heatmap_groups[i], textfile)){
-                throw Exception(CANNOT_OPEN_FILE, textfile);
-              }
-            }
-          }else{
-            cerr<<"No data for group "<<groups[i]<<"."<<endl; 
-          }
+      }
+      pool.clear();
+      size_t cells = acc[0].grids.size();
+      for (int i(0); i < threads; i++){
+        pool.push_back(thread(reduce, ref(acc), cells * i / threads, cells * (i + 1) / threads));
+      }
+      for (int i(0); i < threads; i++){
+        pool[i].join();
+      }
+      vector <char> data (nb_heatmaps, false);
+      for (int i(0); i < threads; i++){
+        for (int h(0); h < nb_heatmaps; h++){
+          data[h] = data[h] || acc[i].data[h];
         }
-      }	
-      end = true;
+      }
+      if (last >= first){
+        t = frame_time(dat, last);
+        first = last + 1;
+      }
+      
+      
+      write_interval(fi, acc[0].grids, data, colony, groups, ants, matlabfile, threads);
     }
     
     dat.close();
     
-    // delete heatmaps allocated with new
-    for (int i(0); i< ctr_groups; i++){
-      delete[] heatmap_groups[i];
-    }
-    for (int i(0); i< ctr_ants; i++){
-      delete[] heatmap_ants[i];
-    }
-    if(colony){
-      delete[] heatmap_col;
-    }
-    
     return 0;
   }
   catch (Exception e) {
+    return 1;
   }
 }
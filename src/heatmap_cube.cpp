@@ -0,0 +1,402 @@
+/*
+ *  heatmap_cube.cpp
+ *  --> builds the occupancy cube of a box (occupancy_cube.h): the heatmaps of the colony, of groups of the tags file and of ants,
+ *		cumulated over fixed time bins. The heatmap of any interval on the bins (e.g. per hour, per day, before and after a treatment)
+ *		is then computed from the cube by heatmap3_tofile -k without reading the dat file again.
+ *		As in heatmap3_tofile, an ant is counted in the colony, in the first of its groups and in its own heatmap, while it is alive.
+ *
+ *		The bins are split into one range per thread: each thread reads the frames of its bins and writes the slices counted from
+ *		the start of its range, the counts of the previous ranges are then added to the slices of each range (ranges in parallel).
+ *
+ *  Copyright UNIL. All rights reserved.
+ *
+ */
+
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <thread>
+#include <exception>
+#include <getopt.h>
+#include <stdint.h>
+
+#include "exception.h"
+#include "utils.h"
+#include "datfile.h"
+#include "tags3.h"
+#include "trackcvt.h"
+#include "occupancy_cube.h"
+
+using namespace std;
+
+const int BATCH_FRAMES = 1024;		///< frames read at once from the dat file
+const int MAX_TAG_LAYERS = 3;		///< layers of a tag: colony, group and ant
+
+/// layers to which the detections of a tag are added
+struct tag_layers{
+	int idx;						///< index of the tag in tag_list
+	int death;						///< frame of death, 0 if alive
+	int n;							///< number of layers
+	int layer[MAX_TAG_LAYERS];		///< index of the layers
+};
+
+/// bins of the cube built by a thread
+struct bin_range{
+	int first;						///< first bin
+	int end;						///< end (excluded)
+	long long begin;				///< index in the dat file of the first frame of the bins
+	long long stop;					///< index of the end (excluded)
+	vector <uint32_t> counts;		///< counts of each layer since the first bin of the range, one layer after the other
+	vector <uint32_t> offset;		///< counts of each layer before the first bin of the range
+	exception_ptr error;
+};
+
+
+// ==============================================================================
+/**\fn double frame_time(DatFile& dat, long long i)
+ * \brief Reads the time of a frame
+ * \param dat Dat file
+ * \param i Index of the frame in the file
+ * \return Time of the frame
+ */
+double frame_time(DatFile& dat, long long i){
+	dat.go_to_frame(dat.get_first_frame() + i);
+	framerec temp;
+	if (!dat.read_frame(temp)){
+		throw Exception(CANNOT_READ_FILE, "frame " + to_string(dat.get_first_frame() + i));
+	}
+	return temp.time;
+}
+
+// ==============================================================================
+/**\fn long long find_time(DatFile& dat, long long count, double limit)
+ * \brief Finds the first frame at or after a time (binary search)
+ * \param dat Dat file
+ * \param count Number of frames in the file
+ * \param limit Time
+ * \return Index of the first frame with a time of at least limit, count if there is none
+ */
+long long find_time(DatFile& dat, long long count, double limit){
+	long long lo (0);
+	long long hi (count);
+	while (lo < hi){
+		long long mid = lo + (hi - lo) / 2;
+		if (frame_time(dat, mid) >= limit){
+			hi = mid;
+		}else{
+			lo = mid + 1;
+		}
+	}
+	return lo;
+}
+
+// ==============================================================================
+/**\fn void count_bins(const string& datfile, const vector <tag_layers>& tags, int box, const OccupancyCube& cube, bin_range& r)
+ * \brief Work of a thread: counts the detections in the box of the frames of a range of bins and writes the slice at the end of
+ * each bin, counted from the start of the range
+ * \param datfile Name of the dat file, read with a DatFile of the thread
+ * \param tags Layers of each tag that has layers
+ * \param box Box of the detections
+ * \param cube Cube
+ * \param r Range of bins
+ */
+void count_bins(const string& datfile, const vector <tag_layers>& tags, int box, const OccupancyCube& cube, bin_range& r){
+	try{
+		r.counts.assign((size_t) cube.get_layer_count() * HEATMAP_SIZE, 0);
+		int bin (r.first);	// bin of the next slice written
+		DatFile dat;
+		dat.open(datfile, false);
+		dat.go_to_frame(dat.get_first_frame() + r.begin);
+		vector <framerec> buffer (BATCH_FRAMES);
+		for (long long k (r.begin); k < r.stop; ){
+			int wanted = min((long long) BATCH_FRAMES, r.stop - k);
+			if (!dat.read_frame(&buffer[0], wanted) || dat.get_count() != wanted){
+				throw Exception(CANNOT_READ_FILE, datfile);
+			}
+			for (int f(0); f < wanted; f++){
+				const framerec& temp = buffer[f];
+				int b = min(max((int) floor((temp.time - cube.get_start()) / cube.get_bin()), r.first), r.end - 1);
+				for (; bin < b; bin++){
+					for (int l(0); l < cube.get_layer_count(); l++){
+						cube.write_slice(bin + 1, l, &r.counts[(size_t) l * HEATMAP_SIZE]);
+					}
+				}
+				for (size_t j(0); j < tags.size(); j++){
+					const tag_layers& t = tags[j];
+					const tag_pos& p = temp.tags[t.idx];
+					if ((t.death == 0 || (int) temp.frame < t.death) && p.id == box && p.x != -1){
+						int x = min(p.x / HEATMAP_REDUCTION, HEATMAP_X - 1);
+						int y = min(p.y / HEATMAP_REDUCTION, HEATMAP_Y - 1);
+						for (int l(0); l < t.n; l++){
+							r.counts[(size_t) t.layer[l] * HEATMAP_SIZE + y * HEATMAP_X + x]++;
+						}
+					}
+				}
+			}
+			k += wanted;
+		}
+		dat.close();
+		for (; bin < r.end; bin++){
+			for (int l(0); l < cube.get_layer_count(); l++){
+				cube.write_slice(bin + 1, l, &r.counts[(size_t) l * HEATMAP_SIZE]);
+			}
+		}
+	}catch(...){
+		r.error = current_exception();
+	}
+}
+
+// ==============================================================================
+/**\fn void add_offset(const OccupancyCube& cube, bin_range& r)
+ * \brief Work of a thread: adds the counts of the previous ranges to the slices of a range of bins
+ * \param cube Cube
+ * \param r Range of bins
+ */
+void add_offset(const OccupancyCube& cube, bin_range& r){
+	try{
+		vector <uint32_t> slice (HEATMAP_SIZE);
+		for (int bin(r.first); bin < r.end; bin++){
+			for (int l(0); l < cube.get_layer_count(); l++){
+				const uint32_t* offset = &r.offset[(size_t) l * HEATMAP_SIZE];
+				cube.read_slice(bin + 1, l, &slice[0]);
+				for (int i(0); i < HEATMAP_SIZE; i++){
+					slice[i] += offset[i];
+				}
+				cube.write_slice(bin + 1, l, &slice[0]);
+			}
+		}
+	}catch(...){
+		r.error = current_exception();
+	}
+}
+
+// ==============================================================================
+/**\fn cube_layer make_layer(char type, const string& name)
+ * \brief Describes a layer of the cube
+ * \param type CUBE_COLONY, CUBE_GROUP or CUBE_ANT
+ * \param name Group or tag ID
+ * \return Description of the layer
+ */
+cube_layer make_layer(char type, const string& name){
+	cube_layer l;
+	memset(&l, 0, sizeof(l));
+	l.type = type;
+	if (name.size() >= sizeof(l.name)){
+		throw Exception(PARAMETER_ERROR, "The name " + name + " is too long for the cube (at most " + to_string(sizeof(l.name) - 1) + " characters).");
+	}
+	strcpy(l.name, name.c_str());
+	return l;
+}
+
+// ==============================================================================
+int main(int argc, char* argv[]){
+try{
+
+	string datfile = "";
+	string tagsfile = "";
+	string outfile = "";
+	string colname = "group";	// name of the column of the groups
+	int box (0);
+	int bin (3600);				// duration of a bin in seconds
+	bool colony (false);
+	vector <string> groups;
+	vector <int> ants;
+	int threads (1);
+	int option;
+	opterr = 0;
+	while ((option = getopt(argc, argv, ":i:t:b:w:h:cg:a:j:o:")) != -1){
+		switch (option){
+			case 'i':
+				datfile = optarg;
+				break;
+			case 't':
+				tagsfile = optarg;
+				break;
+			case 'b':
+				box = atoi(optarg);
+				break;
+			case 'w':
+				bin = atoi(optarg);
+				if (bin < 1){
+					throw Exception(PARAMETER_ERROR, "The duration of a bin (option -w) must be positive.");
+				}
+				break;
+			case 'h':
+				colname = optarg;
+				break;
+			case 'c':
+				colony = true;
+				break;
+			case 'g':
+				groups.push_back(optarg);
+				break;
+			case 'a':
+				ants.push_back(atoi(optarg));
+				break;
+			case 'j':
+				threads = atoi(optarg);
+				if (threads < 1){
+					throw Exception(PARAMETER_ERROR, "The number of threads (option -j) must be positive.");
+				}
+				break;
+			case 'o':
+				outfile = optarg;
+				break;
+			case '?':
+				throw Exception(UNKNOWN_OPTION, "-" + string(1, (char)optopt));
+			case ':':
+				throw Exception(ARGUMENT_MISSING, "-" + string(1, (char)optopt));
+		}
+	}
+
+	if (datfile == "" || tagsfile == "" || box == 0 || outfile == "" || (!colony && groups.empty() && ants.empty())){
+		string info = string (argv[0]) + " -i input.dat -t input.tags -b box [-w bin(sec)] [-h columnname=group] [-c] [-g groupID ...] [-a antID ...] [-j threads] -o output.cube\n"
+			+ "  builds the heatmaps of the colony (-c), of groups (-g) and of ants (-a) in the box, cumulated per time bin,\n"
+			+ "  for heatmap3_tofile -k\n"
+			+ "  -w  duration of a bin in seconds, the bins start on multiples of it in unix time (default 3600)\n"
+			+ "  -h  column of the groups in the tags file (default group)\n"
+			+ "  -j  number of threads (default 1)";
+		throw Exception (USE, info);
+	}
+
+	if (!is_valid_ID(box, box_list, box_count)){
+		throw Exception(BOX_NOT_FOUND, to_string(box));
+	}
+
+	TagsFile tgs;
+	tgs.read_file(tagsfile.c_str());
+
+	// layers: colony (if requested), then groups, then ants
+	vector <cube_layer> layers;
+	if (colony){
+		layers.push_back(make_layer(CUBE_COLONY, ""));
+	}
+	int first_group = layers.size();
+	for (int j(0); j < groups.size(); j++){
+		if (!tgs.content_exists(colname, groups[j])){
+			throw Exception (PARAMETER_ERROR, "There are no ants in the group " + groups[j] + ".");
+		}
+		layers.push_back(make_layer(CUBE_GROUP, groups[j]));
+	}
+	int first_ant = layers.size();
+	vector <int> idx_ants;
+	for (int a(0); a < ants.size(); a++){
+		int idx = get_idx(ants[a], tag_list, tag_count);
+		if (idx == -1){
+			throw Exception (TAG_NOT_FOUND, to_string(ants[a]));
+		}
+		idx_ants.push_back(idx);
+		layers.push_back(make_layer(CUBE_ANT, to_string(ants[a])));
+	}
+
+	// layers of each tag: the colony, the first of its groups and its first ant layer
+	vector <tag_layers> tags;
+	for (int i(0); i < tag_count; i++){
+		if (!tgs.get_state(i)){
+			continue;
+		}
+		tag_layers t;
+		t.idx = i;
+		t.death = tgs.get_death(i);
+		t.n = 0;
+		if (colony){
+			t.layer[t.n++] = 0;
+		}
+		string content;
+		if (!groups.empty() && tgs.get_content(i, colname, content)){
+			for (int j(0); j < groups.size(); j++){
+				if (content == groups[j]){
+					t.layer[t.n++] = first_group + j;
+					break;
+				}
+			}
+		}
+		for (int a(0); a < idx_ants.size(); a++){
+			if (idx_ants[a] == i){
+				t.layer[t.n++] = first_ant + a;
+				break;
+			}
+		}
+		if (t.n > 0){
+			tags.push_back(t);
+		}
+	}
+
+	// bins: from the multiple of the bin before the first frame until the last frame
+	DatFile dat;
+	dat.open(datfile, false);
+	long long count = dat.get_frame_count();
+	if (count == 0){
+		throw Exception(CANNOT_READ_FILE, datfile);
+	}
+	double start = floor(dat.get_first_time() / bin) * bin;
+	int bins = (int) floor((dat.get_last_time() - start) / bin) + 1;
+
+	// one range of bins per thread, and the frames of each range
+	threads = min(threads, bins);
+	vector <bin_range> ranges (threads);
+	for (int t(0); t < threads; t++){
+		ranges[t].first = (long long) bins * t / threads;
+		ranges[t].end = (long long) bins * (t + 1) / threads;
+		ranges[t].begin = (t == 0) ? 0 : ranges[t - 1].stop;
+		ranges[t].stop = (t == threads - 1) ? count : find_time(dat, count, start + (double) ranges[t].end * bin);
+	}
+	dat.close();
+
+	OccupancyCube cube;
+	cube.create(outfile, box, start, bin, bins, layers);
+
+	// an incomplete cube is removed
+	try{
+		vector <thread> pool;
+		for (int t(0); t < threads; t++){
+			pool.push_back(thread(count_bins, cref(datfile), cref(tags), box, cref(cube), ref(ranges[t])));
+		}
+		for (int t(0); t < threads; t++){
+			pool[t].join();
+		}
+		for (int t(0); t < threads; t++){
+			if (ranges[t].error){
+				rethrow_exception(ranges[t].error);
+			}
+		}
+
+		// cumulative sums over the ranges
+		pool.clear();
+		for (int t(1); t < threads; t++){
+			ranges[t].offset = ranges[t - 1].offset;
+			if (ranges[t].offset.empty()){
+				ranges[t].offset.assign(ranges[t - 1].counts.size(), 0);
+			}
+			for (size_t i(0); i < ranges[t].offset.size(); i++){
+				ranges[t].offset[i] += ranges[t - 1].counts[i];
+			}
+			pool.push_back(thread(add_offset, cref(cube), ref(ranges[t])));
+		}
+		for (int t(0); t < pool.size(); t++){
+			pool[t].join();
+		}
+		for (int t(1); t < threads; t++){
+			if (ranges[t].error){
+				rethrow_exception(ranges[t].error);
+			}
+		}
+		cube.finish();
+	}catch(...){
+		cube.close();
+		remove(outfile.c_str());
+		throw;
+	}
+	cube.close();
+
+	cout.precision(12);
+	cout<<outfile<<": "<<bins<<" bins of "<<bin<<" seconds from "<<start<<", "<<layers.size()<<" heatmaps of box "<<box<<endl;
+	return 0;
+}catch(Exception e){
+	return 1;
+}
+}
@@ -17,75 +17,111 @@
 #include <string>
 #include <cmath>
 #include <vector>
+#include <getopt.h>
 
 #include "trackcvt.h"
 #include "exception.h"
 #include "tags3.h"
 #include "utils.h"
+#include "interaction_file.h"
 
 using namespace std;
 
-struct coordinates{
-  double x;
-  double y;
+/// quadrilateral modelling the body of an ant (trapezoid of interaction_tags3_corrected)
+struct quadrilateral{
+  double x[4];	// corners: head left, head right, abdomen right, abdomen left
+  double y[4];
+  double r;		// bounding radius: distance between the tag and the farthest corner
 };
 
-struct segment{
-  coordinates point1;
-  coordinates point2;
-};
+// =====================================================================================
+/**\fn void get_quadrilateral(const tag_pos& pt, int size_md, double tl_md, double width_factor, double width_ratio, quadrilateral& q)
+ * \brief Calculates the corners and the bounding radius of the quadrilateral of an ant
+ * \param pt Position and angle of the tag
+ * \param size_md Md reach of the ant (distance between the tag and the head end of the quadrilateral)
+ * \param tl_md Trapezoid length of the ant, from mandibles to gaster tip
+ * \param width_factor Factor by which the trapezoid increases in width at the head of the ant compared to the abdomen of the ant
+ * \param width_ratio Ratio of the width of the ant compared to the height of the ant 
+ * \param q Quadrilateral to fill
+ */
+void get_quadrilateral(const tag_pos& pt, int size_md, double tl_md, double width_factor, double width_ratio, quadrilateral& q){
+  //param w1 Width of trapezoid at the head end of the ant modeled (= radius * width_ratio *width_factor)
+  //param w2 Width of trapezoid at the abdomen end of the ant modeled (= radius * width_ratio)
+  double w1 = tl_md/2 * width_ratio * width_factor;
+  double w2 = tl_md/2 * width_ratio;
+  // sine and cosine of the directions of the head, the gaster and the sides of the ant
+  const trig_value& front = trig_centidegree(pt.a);
+  const trig_value& back = trig_centidegree(pt.a + 18000);
+  const trig_value& left = trig_centidegree(pt.a + 9000);
+  const trig_value& right = trig_centidegree(pt.a - 9000);
+
+  double front_x = pt.x + size_md * front.c;
+  double front_y = pt.y - size_md * front.s;
+  double back_x = pt.x + (tl_md - size_md) * back.c;
+  double back_y = pt.y - (tl_md - size_md) * back.s;
 
-//==== NS code start =====
-// Returns 1 if the lines intersect, otherwise 0. In addition, if the lines 
-// intersect the intersection point may be stored in the doubles i_x and i_y.
-bool get_line_intersection(segment segment1, segment segment2)
-{
-  
-  double p0_x, p0_y, p1_x, p1_y, p2_x, p2_y, p3_x, p3_y;
-  p0_x = segment1.point1.x;p0_y = segment1.point1.y;
-  p1_x = segment1.point2.x;p1_y = segment1.point2.y;
-  p2_x = segment2.point1.x;p2_y = segment2.point1.y;
-  p3_x = segment2.point2.x;p3_y = segment2.point2.y;
-  
-  
-  double s1_x, s1_y, s2_x, s2_y;
-  s1_x = p1_x - p0_x;     s1_y = p1_y - p0_y;
-  s2_x = p3_x - p2_x;     s2_y = p3_y - p2_y;
-  
-  double s, t;
-  s = (-s1_y * (p0_x - p2_x) + s1_x * (p0_y - p2_y)) / (-s2_x * s1_y + s1_x * s2_y);
-  t = ( s2_x * (p0_y - p2_y) - s2_y * (p0_x - p2_x)) / (-s2_x * s1_y + s1_x * s2_y);
-  
-  if (s >= 0 && s <= 1 && t >= 0 && t <= 1)
-  {
-    // Collision detected
-     return 1;
+  q.x[0] = front_x + (w1/2) * left.c;
+  q.y[0] = front_y - (w1/2) * left.s;
+  q.x[1] = front_x + (w1/2) * right.c;
+  q.y[1] = front_y - (w1/2) * right.s;
+  q.x[2] = back_x + (w2/2) * right.c;
+  q.y[2] = back_y - (w2/2) * right.s;
+  q.x[3] = back_x + (w2/2) * left.c;
+  q.y[3] = back_y - (w2/2) * left.s;
+
+  q.r = 0;
+  for (int i(0); i < 4; i++){
+    double dx = q.x[i] - pt.x;
+    double dy = q.y[i] - pt.y;
+    q.r = fmax(q.r, sqrt(dx * dx + dy * dy));
   }
-  
-  return 0; // No collision
 }
-//==== NS code end =====
+
 // =====================================================================================
-/**\fn bool test_interaction(tag_pos pt1, tag_pos pt2, int size1, int size2, int d_th, int a_th_par, int a_th_beh, double width_factor, double width_ratio)
- * \brief Test whether 2 tags with positions pt1 ant pt2 and radius' size1 and size2 are interacting
+/**\fn bool has_separating_axis(const quadrilateral& q1, const quadrilateral& q2)
+ * \brief Tests whether the normal of one of the sides of q1 separates the two quadrilaterals
+ * \param q1 Quadrilateral whose sides are tested
+ * \param q2 Other quadrilateral
+ * \return True if the projections of the quadrilaterals on one of the normals do not overlap
+ */
+inline bool has_separating_axis(const quadrilateral& q1, const quadrilateral& q2){
+  for (int i(0); i < 4; i++){
+    int j = (i + 1) & 3;
+    double nx = q1.y[i] - q1.y[j];	// normal of side i
+    double ny = q1.x[j] - q1.x[i];
+    // projections of the corners on the normal (fixed size loops, vectorized by the compiler)
+    double p1[4], p2[4];
+    for (int k(0); k < 4; k++){
+      p1[k] = q1.x[k] * nx + q1.y[k] * ny;
+      p2[k] = q2.x[k] * nx + q2.y[k] * ny;
+    }
+    double min1 = fmin(fmin(p1[0], p1[1]), fmin(p1[2], p1[3]));
+    double max1 = fmax(fmax(p1[0], p1[1]), fmax(p1[2], p1[3]));
+    double min2 = fmin(fmin(p2[0], p2[1]), fmin(p2[2], p2[3]));
+    double max2 = fmax(fmax(p2[0], p2[1]), fmax(p2[2], p2[3]));
+    if (max1 < min2 || max2 < min1){
+      return true;
+    }
+  }
+  return false;
+}
+
+// =====================================================================================
+/**\fn bool test_interaction(tag_pos pt1, tag_pos pt2, const quadrilateral& q1, const quadrilateral& q2, int size_md1, int size_md2, int d_th, int a_th_par)
+ * \brief Test whether 2 tags with positions pt1 ant pt2 and radius' size1 and size2 are interacting, i.e. whether their quadrilaterals overlap.
+          Since the quadrilaterals are convex, they overlap unless the normal of one of their sides separates them (separating axis theorem);
+          this includes the case where one quadrilateral lies inside the other.
  * \param pt1 Position and angle of tag1
  * \param pt2 Position and angle of tag2
+ * \param q1 Quadrilateral of ant1
+ * \param q2 Quadrilateral of ant2
  * \param size_md1 Md reach of ant1
  * \param size_md2 Md of ant2
- * \param size_ant1 Antenna reach of ant1
- * \param size_ant2 Antenna of ant2
- * \param tl_md1 trapezoid kength of ant 1, from mandibles to gaster tip
- * \param tl_md2 trapezoid kength of ant 2, from mandibles to gaster tip
- * \param tl_ant1 trapezoid kength of ant 1, from antenna to gaster tip
- * \param tl_ant2 trapezoid kength of ant 2, from antenna to gaster tip
  * \param d_th Distance threshold
  * \param a_th_par Angle threshold for paralell ants
- * \param width_factor Factor by which the trapezoid increases in width at the head of the ant compared to the abdomen of the ant
- * \param width_ratio Ratio of the width of the ant compared to the height of the ant 
  * \return 0 if there is no interaction, 1 if interaction
  */
-bool test_interaction(tag_pos pt1, tag_pos pt2, int size_md1, int size_md2, double tl_md1, double tl_md2, int d_th, int a_th_par, double width_factor, double width_ratio){
-
+bool test_interaction(tag_pos pt1, tag_pos pt2, const quadrilateral& q1, const quadrilateral& q2, int size_md1, int size_md2, int d_th, int a_th_par){
 	// if no position data for one ant only or if ants in 2 different boxes, no interaction is possible
 	if (pt1.x == -1 || pt2.x==-1 || pt1.id != pt2.id){
 		return 0;
@@ -102,6 +138,11 @@ bool test_interaction(tag_pos pt1, tag_pos pt2, int size_md1, int size_md2, doub
 		return 0;
 	}
 
+	// the quadrilaterals cannot overlap if their bounding circles do not
+	if (dist > q1.r + q2.r){
+		return 0;
+	}
+
 	// Calculates angle difference between both orientation vectors of ants
 	double da = abs(limit_angle(a2 - a1));
 
@@ -110,124 +151,30 @@ bool test_interaction(tag_pos pt1, tag_pos pt2, int size_md1, int size_md2, doub
 	if (da < a_th_par){
 		return 0;
 	}
-  
-  //==== NS code start =====
-  // get the 4 corners of ant 1
-  //param w1 Width of trapezoid at the head end of the ant modeled (= radius * width_ratio *width_factor)
-	//param w2 Width of trapezoid at the abdomen end of the ant modeled (= radius * width_ratio)
-	  
-  double ant1_w1 = tl_md1/2 * width_ratio * width_factor;
-	double ant1_w2 = tl_md1/2 * width_ratio;
-	double ant1_angle_rad = a1 * M_PI / 180.0; // Convert angle to radians for trigonometry
-	
-	coordinates ant1_front_midpoint; 
-	ant1_front_midpoint.x = pt1.x + size_md1 * cos (ant1_angle_rad); 
-	ant1_front_midpoint.y = pt1.y - size_md1 * sin (ant1_angle_rad);
-	
-	coordinates ant1_back_midpoint; 
-	ant1_back_midpoint.x = pt1.x + (tl_md1-size_md1) * cos (ant1_angle_rad+M_PI); 
-	ant1_back_midpoint.y = pt1.y - (tl_md1-size_md1) * sin (ant1_angle_rad+M_PI);
-	
-	coordinates ant1_corner1; coordinates ant1_corner2; coordinates ant1_corner3; coordinates ant1_corner4; 
-	
-  ant1_corner1.x = ant1_front_midpoint.x + (ant1_w1/2) * cos(ant1_angle_rad + (M_PI/2));
-  ant1_corner1.y = ant1_front_midpoint.y - (ant1_w1/2) * sin(ant1_angle_rad + (M_PI/2));
-  ant1_corner2.x = ant1_front_midpoint.x + (ant1_w1/2) * cos(ant1_angle_rad - (M_PI/2));
-  ant1_corner2.y = ant1_front_midpoint.y - (ant1_w1/2) * sin(ant1_angle_rad - (M_PI/2));
-  ant1_corner3.x = ant1_back_midpoint.x +  (ant1_w2/2) * cos(ant1_angle_rad - (M_PI/2));
-  ant1_corner3.y = ant1_back_midpoint.y -  (ant1_w2/2) * sin(ant1_angle_rad - (M_PI/2));
-  ant1_corner4.x = ant1_back_midpoint.x +  (ant1_w2/2) * cos(ant1_angle_rad + (M_PI/2));
-  ant1_corner4.y = ant1_back_midpoint.y -  (ant1_w2/2) * sin(ant1_angle_rad + (M_PI/2));
-  
-   segment ant1_segment1;segment ant1_segment2;segment ant1_segment3;segment ant1_segment4;
-   ant1_segment1.point1 = ant1_corner1;ant1_segment1.point2 = ant1_corner2;
-   ant1_segment2.point1 = ant1_corner2;ant1_segment2.point2 = ant1_corner3;
-   ant1_segment3.point1 = ant1_corner3;ant1_segment3.point2 = ant1_corner4;
-   ant1_segment4.point1 = ant1_corner4;ant1_segment4.point2 = ant1_corner1;
-  
-  // get the 4 corners of ant 2
-  //param w1 Width of trapezoid at the head end of the ant modeled (= radius * width_ratio *width_factor)
-  //param w2 Width of trapezoid at the abdomen end of the ant modeled (= radius * width_ratio)
-  
-  double ant2_w1 = tl_md2/2 * width_ratio * width_factor;
-  double ant2_w2 = tl_md2/2 * width_ratio;
-  double ant2_angle_rad = a2 * M_PI / 180.0; // Convert angle to radians for trigonometry
-  
-  coordinates ant2_front_midpoint; 
-  ant2_front_midpoint.x = pt2.x + size_md2 * cos (ant2_angle_rad); 
-  ant2_front_midpoint.y = pt2.y - size_md2 * sin (ant2_angle_rad);
-  
-  coordinates ant2_back_midpoint; 
-  ant2_back_midpoint.x = pt2.x + (tl_md2-size_md2) * cos (ant2_angle_rad+M_PI); 
-  ant2_back_midpoint.y = pt2.y - (tl_md2-size_md2) * sin (ant2_angle_rad+M_PI);
-  
-  coordinates ant2_corner1; coordinates ant2_corner2; coordinates ant2_corner3; coordinates ant2_corner4; 
-  
-  ant2_corner1.x = ant2_front_midpoint.x + (ant2_w1/2) * cos(ant2_angle_rad + (M_PI/2));
-  ant2_corner1.y = ant2_front_midpoint.y - (ant2_w1/2) * sin(ant2_angle_rad + (M_PI/2));
-  ant2_corner2.x = ant2_front_midpoint.x + (ant2_w1/2) * cos(ant2_angle_rad - (M_PI/2));
-  ant2_corner2.y = ant2_front_midpoint.y - (ant2_w1/2) * sin(ant2_angle_rad - (M_PI/2));
-  ant2_corner3.x = ant2_back_midpoint.x +  (ant2_w2/2) * cos(ant2_angle_rad - (M_PI/2));
-  ant2_corner3.y = ant2_back_midpoint.y -  (ant2_w2/2) * sin(ant2_angle_rad - (M_PI/2));
-  ant2_corner4.x = ant2_back_midpoint.x +  (ant2_w2/2) * cos(ant2_angle_rad + (M_PI/2));
-  ant2_corner4.y = ant2_back_midpoint.y -  (ant2_w2/2) * sin(ant2_angle_rad + (M_PI/2));
-  
-  segment ant2_segment1;segment ant2_segment2;segment ant2_segment3;segment ant2_segment4;
-  ant2_segment1.point1 = ant2_corner1;ant2_segment1.point2 = ant2_corner2;
-  ant2_segment2.point1 = ant2_corner2;ant2_segment2.point2 = ant2_corner3;
-  ant2_segment3.point1 = ant2_corner3;ant2_segment3.point2 = ant2_corner4;
-  ant2_segment4.point1 = ant2_corner4;ant2_segment4.point2 = ant2_corner1;
-  
-  
-  bool intersection(0);
-  if (!intersection){intersection = get_line_intersection( ant1_segment1,ant2_segment1);}
-  if (!intersection){intersection = get_line_intersection( ant1_segment1,ant2_segment2);}
-  if (!intersection){intersection = get_line_intersection( ant1_segment1,ant2_segment3);}
-  if (!intersection){intersection = get_line_intersection( ant1_segment1,ant2_segment4);}
-  if (!intersection){intersection = get_line_intersection( ant1_segment2,ant2_segment1);}
-  if (!intersection){intersection = get_line_intersection( ant1_segment2,ant2_segment2);}
-  if (!intersection){intersection = get_line_intersection( ant1_segment2,ant2_segment3);}
-  if (!intersection){intersection = get_line_intersection( ant1_segment2,ant2_segment4);}
-  if (!intersection){intersection = get_line_intersection( ant1_segment3,ant2_segment1);}
-  if (!intersection){intersection = get_line_intersection( ant1_segment3,ant2_segment2);}
-  if (!intersection){intersection = get_line_intersection( ant1_segment3,ant2_segment3);}
-  if (!intersection){intersection = get_line_intersection( ant1_segment3,ant2_segment4);}
-  if (!intersection){intersection = get_line_intersection( ant1_segment4,ant2_segment1);}
-  if (!intersection){intersection = get_line_intersection( ant1_segment4,ant2_segment2);}
-  if (!intersection){intersection = get_line_intersection( ant1_segment4,ant2_segment3);}
-  if (!intersection){intersection = get_line_intersection( ant1_segment4,ant2_segment4);}
 
-  return (intersection);
-  //==== NS code end =====
+	return (!has_separating_axis(q1, q2) && !has_separating_axis(q2, q1));
 }
 
 // =====================================================================================
-/**\fn inline void cherche_interaction(framerec& temp, TagsFile& tgs, table* i_table, int j, int d_th, int a_th_par,double width_factor, double width_ratio)
+/**\fn inline void cherche_interaction(framerec& temp, TagsFile& tgs_md, const vector <quadrilateral>& quads, InteractionWriter& g, int j, int d_th, int a_th_par)
  * \brief Finds all interactions of a given tag (index j in tag_list) with all other tags
  * \param temp Frame recording of current frame
- * \param tgs File .tags with details on each tag
- * \param g Stream for output file
+ * \param tgs_md File .tags with details on each tag
+ * \param quads Quadrilaterals of the ants in the current frame
+ * \param g Writer of the output file
  * \param j Index of tag in tag_list (trackcvt.h file)
  * \param d_th Distance threshold
  * \param a_th_par Angle threshold for paralell ants
- * \param width_factor Factor by which the trapezoid increases in width at the head of the ant compared to the abdomen of the ant
- * \param width_ratio Ratio of the width of the ant compared to the height of the ant 
  */
-inline void cherche_interaction(framerec& temp, TagsFile& tgs_md, ofstream& g, int j, int d_th, int a_th_par, double width_factor, double width_ratio){
+inline void cherche_interaction(framerec& temp, TagsFile& tgs_md, const vector <quadrilateral>& quads, InteractionWriter& g, int j, int d_th, int a_th_par){
 	for (int k(j+1); k < tag_count; k++){
 		if (temp.tags[k].x != -1){
 			// check that partner ant is still alive, present in the tag file and, interactions only considered for live tagged ants
 			if (tgs_md.get_state(k) && (tgs_md.get_death(k)== 0 || tgs_md.get_death(k) > temp.frame)){
-				// if the interaction test return something different from 0 there is an interaction 
-				// the test distinguishes 2 types of interaction: unidirectional (return value 1) and bidirectional (return value 2) but we don't distinguish between these interactions for the moment
-//      testing <<tag_list[j]<<","<<tag_list[k]<<endl;
-        bool interac = test_interaction(temp.tags[j], temp.tags[k], tgs_md.get_rayon(j), tgs_md.get_rayon(k), tgs_md.get_trapezoid_length(j), tgs_md.get_trapezoid_length(k), d_th, a_th_par, width_factor, width_ratio);
-				if (interac){ // 
-          //cout<<"tag "<<tag_list[j]<<" interacts with tag "<<tag_list[k]<<" in frame "<<temp.frame<<endl;
-          g.precision(12);
-          g<<temp.time<<","<<temp.frame<<","<<(int)temp.tags[j].id<<","<<tag_list[j]<<","<<tag_list[k]<<",";
-					g<<temp.tags[j].x<<","<<temp.tags[j].y<<","<<temp.tags[j].a<<",";
-					g<<temp.tags[k].x<<","<<temp.tags[k].y<<","<<temp.tags[k].a<<endl;
+				bool interac = test_interaction(temp.tags[j], temp.tags[k], quads[j], quads[k], tgs_md.get_rayon(j), tgs_md.get_rayon(k), d_th, a_th_par);
+				if (interac){
+          interaction_record r = {temp.time, temp.frame, (uint16_t) tag_list[j], (uint16_t) tag_list[k], temp.tags[j].x, temp.tags[j].y, temp.tags[j].a, temp.tags[k].x, temp.tags[k].y, temp.tags[k].a, temp.tags[j].id, 0, 0, 0};
+          g.write(r);
 				}
 			}
 		}
@@ -238,20 +185,35 @@ inline void cherche_interaction(framerec& temp, TagsFile& tgs_md, ofstream& g, i
 int main(int argc, char* argv[]){
 try{
 
-	if (argc!=8){
-		string info = string (argv[0]) + " input.dat mandibles.tags outfile.txt distance(px) angle_paralell(deg) width_factor width_ratio"; //trapezoid.txt interaction_tester.txt tag_call.txt";
+	bool binary(false);	// binary output instead of CSV
+	int option;
+	opterr = 0;
+	while ((option = getopt(argc, argv, "b")) != -1){
+		switch (option){
+			case 'b':
+				binary = true;
+				break;
+			case '?':
+				throw Exception(UNKNOWN_OPTION, string(1, (char)optopt));
+		}
+	}
+
+	if (argc - optind != 7){
+		string info = string (argv[0]) + " [-b] input.dat mandibles.tags outfile.txt distance(px) angle_paralell(deg) width_factor width_ratio\n"
+			+ "  -b  write the interactions in binary format instead of CSV"; //trapezoid.txt interaction_tester.txt tag_call.txt";
 		throw Exception (USE, info);
 	}
+	char** args = argv + optind - 1;	// args[1] to args[7] are the positional parameters
 	
  
 	// read input parameters and tests whether they are valid
-	int d_th = atoi(argv[4]);		//distance threshold : maximum distance between 2 ants to be considered interacting, choice based on visual inspection of videos
+	int d_th = atoi(args[4]);		//distance threshold : maximum distance between 2 ants to be considered interacting, choice based on visual inspection of videos
 	cout << "distance_threshold = " << d_th << endl;
-	int a_th_par = atoi(argv[5]);	//angle threshold: minimum angle between 2 ants to be considered interacting
+	int a_th_par = atoi(args[5]);	//angle threshold: minimum angle between 2 ants to be considered interacting
 	cout << "angle threshold = " << a_th_par << endl;
-	double width_factor = atof(argv[6]);     // Head-width correction factor (determines how wide the trapezoid will be at the ant head)
+	double width_factor = atof(args[6]);     // Head-width correction factor (determines how wide the trapezoid will be at the ant head)
 	cout << "width_factor = " << width_factor << endl;
-	double width_ratio = atof(argv[7]);      // ratio width/height of ant (determines the height to average width of trapezoid)
+	double width_ratio = atof(args[7]);      // ratio width/height of ant (determines the height to average width of trapezoid)
 	cout << "width_ratio = " << width_ratio << endl;
 
 	if (d_th < 0){
@@ -276,47 +238,46 @@ try{
 	
 	// test if outfile exists already
 	ifstream f;
-	f.open(argv[3]);
+	f.open(args[3]);
 	if (f.is_open()){
 		f.close();
-		throw Exception (OUTPUT_EXISTS, (string) argv[3]);
+		throw Exception (OUTPUT_EXISTS, (string) args[3]);
 	}
 	// Open input files
-	f.open(argv[1]);
+	f.open(args[1]);
 	if (f.fail()){
-		string info = string (argv[1]);
+		string info = string (args[1]);
 		throw Exception (CANNOT_OPEN_FILE, info);
 	}
 	cout << "datfile opened" <<endl;
 	
 	TagsFile tgs_md;
-	cout << "About to open tag file" << argv[2] <<endl;
-	tgs_md.read_file(argv[2]);
+	cout << "About to open tag file" << args[2] <<endl;
+	tgs_md.read_file(args[2]);
 	cout << "tagfile opened" <<endl;
 	// opens outputfile
-	ofstream g;
-	g.open(argv[3]);
-	if (!g.is_open()){
-		f.close();
-		throw Exception(CANNOT_OPEN_FILE, (string) argv[3]);
-	}
+	InteractionWriter g;
+	g.open(args[3], binary, 0);
 	cout << "outfile opened" <<endl;
 	
-	g<<"Time,Frame,Box,Ant1,Ant2,Xcoor1,Ycoor1,Angle1,Xcoor2,Ycoor2,Angle2,Direction,From,To"<<endl;
-	
 	cout<<"start interaction search... "<<endl;
 	// read through binary file
-	while (!f.eof()){
+	framerec temp;
+	vector <quadrilateral> quads (tag_count);
+	while (f.read((char*) &temp, sizeof(temp))){
 		
-		framerec temp;
-		//cout<<"interval 1"<<endl;
-		f.read((char*) &temp, sizeof(temp)); 
+		// the quadrilaterals of the ants are calculated once per frame, not once per pair
+		for (int j(0); j < tag_count; j++){
+			if (temp.tags[j].x != -1 && tgs_md.get_state(j)){
+				get_quadrilateral(temp.tags[j], tgs_md.get_rayon(j), tgs_md.get_trapezoid_length(j), width_factor, width_ratio, quads[j]);
+			}
+		}
 		for (int j(0); j < tag_count; j++){ 
 			// for tags that are in the tags files and not dead/lost tags
 			if (tgs_md.get_state(j) && (tgs_md.get_death(j)== 0 || tgs_md.get_death(j) > temp.frame)){
 				// for tags that are detected
 				if (temp.tags[j].x != -1){
-					cherche_interaction(temp, tgs_md, g, j, d_th, a_th_par, width_factor, width_ratio);
+					cherche_interaction(temp, tgs_md, quads, g, j, d_th, a_th_par);
 				}
 			}
 		}
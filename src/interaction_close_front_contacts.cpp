@@ -18,11 +18,13 @@
 #include <string>
 #include <cmath>
 #include <vector>
+#include <getopt.h>
 
 #include "trackcvt.h"
 #include "exception.h"
 #include "tags3.h"
 #include "utils.h"
+#include "interaction_file.h"
 
 using namespace std;
 
@@ -65,11 +67,11 @@ is_interaction is_in_trapezoid_nath(int xc, int yc, int a, double w1, double w2,
 	double yt = y - yc;
 	
 	//Calculate rotation angle to have trapezoid facing "up" (i.e. with head at 90deg (top of image)
-	double ar = ((double) (90-a) * M_PI / 180.0);
+	const trig_value& ar = trig_centidegree((90-a) * 100);
 	
 	// Calculate rotation parameters
-	double ca = cos(ar);
-	double sa = -sin(ar);
+	double ca = ar.c;
+	double sa = -ar.s;
 	
 	// Apply rotation to centered, tested point
 	double xtr = xt * ca - yt * sa;
@@ -160,9 +162,9 @@ interaction_type test_interaction(tag_pos pt1, tag_pos pt2, int size_md1, int si
 
   	/////first test if the mandible tip of ant2 is within trapezoid of ant1; do it if no interaction has been found using the gaster tip
   	do {
-  		double a2r = (a2 + delta_a) * M_PI / 180.0; 	// Convert angle to radians for trigonometry
-    		double pt2e_x = pt2.x + size_md2 * cos(a2r);  	// calculates an "interaction point" for the ant
-    		double pt2e_y = pt2.y - size_md2 * sin(a2r);
+  		trig_value a2r = trig_degree(a2 + delta_a); 	// sine and cosine of the angle
+    		double pt2e_x = pt2.x + size_md2 * a2r.c;  	// calculates an "interaction point" for the ant
+    		double pt2e_y = pt2.y - size_md2 * a2r.s;
     		in2 = (is_in_trapezoid_nath(pt1.x, pt1.y, a1, tl_md1/2 * width_ratio * width_factor, tl_md1/2 * width_ratio, size_md1, tl_md1, pt2e_x, pt2e_y,"M"));
        		delta_a += interval_a;
   	}while (!in2.in && delta_a < a_th);
@@ -174,9 +176,9 @@ interaction_type test_interaction(tag_pos pt1, tag_pos pt2, int size_md1, int si
 
   	/////second test if the mandible tip of ant1 is within trapezoid of ant2
 	do {
-		double a1r = (a1 + delta_a) * M_PI / 180.0;
-    		double pt1e_x = pt1.x + size_md1 * cos(a1r);
-    		double pt1e_y = pt1.y - size_md1 * sin(a1r);  // -sin as y axis is turned downwards
+		trig_value a1r = trig_degree(a1 + delta_a);
+    		double pt1e_x = pt1.x + size_md1 * a1r.c;
+    		double pt1e_y = pt1.y - size_md1 * a1r.s;  // -sin as y axis is turned downwards
     		in1 = (is_in_trapezoid_nath(pt2.x, pt2.y, a2, tl_md2/2 * width_ratio * width_factor, tl_md2/2 * width_ratio, size_md2, tl_md2, pt1e_x, pt1e_y,"M"));
     		delta_a += interval_a;
   	}while (!in1.in && delta_a < a_th);
@@ -215,14 +217,14 @@ interaction_type test_interaction(tag_pos pt1, tag_pos pt2, int size_md1, int si
  * \brief Finds all interactions of a given tag (index j in tag_list) with all other tags
  * \param temp Frame recording of current frame
  * \param tgs File .tags with details on each tag
- * \param g Stream for output file
+ * \param g Writer of the output file
  * \param j Index of tag in tag_list (trackcvt.h file)
  * \param d_th Distance threshold
  * \param a_th_par Angle threshold for paralell ants
  * \param width_factor Factor by which the trapezoid increases in width at the head of the ant compared to the abdomen of the ant
  * \param width_ratio Ratio of the width of the ant compared to the height of the ant 
  */
-inline void cherche_interaction(framerec& temp, TagsFile& tgs_md, ofstream& g, int j, int d_th, int a_th_par, double width_factor, double width_ratio, double a_th, double interval_a){
+inline void cherche_interaction(framerec& temp, TagsFile& tgs_md, InteractionWriter& g, int j, int d_th, int a_th_par, double width_factor, double width_ratio, double a_th, double interval_a){
 	for (int k(j+1); k < tag_count; k++){
 		if (temp.tags[k].x != -1){
 			// check that partner ant is still alive, present in the tag file and, interactions only considered for live tagged ants
@@ -233,10 +235,8 @@ inline void cherche_interaction(framerec& temp, TagsFile& tgs_md, ofstream& g, i
         interaction_type interac = test_interaction(temp.tags[j], temp.tags[k], tgs_md.get_rayon(j), tgs_md.get_rayon(k), tgs_md.get_trapezoid_length(j), tgs_md.get_trapezoid_length(k), d_th, a_th_par, width_factor, width_ratio, a_th, interval_a);
 				if (interac.direction != 2){ // 2 = no interaction
           //cout<<"tag "<<tag_list[j]<<" interacts with tag "<<tag_list[k]<<" in frame "<<temp.frame<<endl;
-          g.precision(12);
-          g<<temp.time<<","<<temp.frame<<","<<(int)temp.tags[j].id<<","<<tag_list[j]<<","<<tag_list[k]<<",";
-					g<<temp.tags[j].x<<","<<temp.tags[j].y<<","<<temp.tags[j].a<<",";
-					g<<temp.tags[k].x<<","<<temp.tags[k].y<<","<<temp.tags[k].a<<","<<interac.direction<<","<<interac.from<<","<<interac.to<<endl;
+          interaction_record r = {temp.time, temp.frame, (uint16_t) tag_list[j], (uint16_t) tag_list[k], temp.tags[j].x, temp.tags[j].y, temp.tags[j].a, temp.tags[k].x, temp.tags[k].y, temp.tags[k].a, temp.tags[j].id, (int8_t) interac.direction, interac.from[0], interac.to[0]};
+          g.write(r);
 				}
 			}
 		}
@@ -247,24 +247,39 @@ inline void cherche_interaction(framerec& temp, TagsFile& tgs_md, ofstream& g, i
 int main(int argc, char* argv[]){
 try{
 
-	if (argc!=10){
-		string info = string (argv[0]) + " input.dat mandibles.tags outfile.txt distance(px) angle_paralell(deg) width_factor width_ratio delta_angle(degree) angle_interval(degree)"; //trapezoid.txt interaction_tester.txt tag_call.txt";
+	bool binary(false);	// binary output instead of CSV
+	int option;
+	opterr = 0;
+	while ((option = getopt(argc, argv, "b")) != -1){
+		switch (option){
+			case 'b':
+				binary = true;
+				break;
+			case '?':
+				throw Exception(UNKNOWN_OPTION, string(1, (char)optopt));
+		}
+	}
+
+	if (argc - optind != 9){
+		string info = string (argv[0]) + " [-b] input.dat mandibles.tags outfile.txt distance(px) angle_paralell(deg) width_factor width_ratio delta_angle(degree) angle_interval(degree)\n"
+			+ "  -b  write the interactions in binary format instead of CSV"; //trapezoid.txt interaction_tester.txt tag_call.txt";
 		throw Exception (USE, info);
 	}
+	char** args = argv + optind - 1;	// args[1] to args[9] are the positional parameters
 	
  
 	// read input parameters and tests whether they are valid
-	int d_th = atoi(argv[4]);		//distance threshold : maximum distance between 2 ants to be considered interacting, choice based on visual inspection of videos
+	int d_th = atoi(args[4]);		//distance threshold : maximum distance between 2 ants to be considered interacting, choice based on visual inspection of videos
 	cout << "distance_threshold = " << d_th << endl;
-	int a_th_par = atoi(argv[5]);	//angle threshold: minimum angle between 2 ants to be considered interacting
+	int a_th_par = atoi(args[5]);	//angle threshold: minimum angle between 2 ants to be considered interacting
 	cout << "angle threshold = " << a_th_par << endl;
-	double width_factor = atof(argv[6]);     // Head-width correction factor (determines how wide the trapezoid will be at the ant head)
+	double width_factor = atof(args[6]);     // Head-width correction factor (determines how wide the trapezoid will be at the ant head)
 	cout << "width_factor = " << width_factor << endl;
-	double width_ratio = atof(argv[7]);      // ratio width/height of ant (determines the height to average width of trapezoid)
+	double width_ratio = atof(args[7]);      // ratio width/height of ant (determines the height to average width of trapezoid)
 	cout << "width_ratio = " << width_ratio << endl;
-  	double a_th = atof(argv[8]); ///<  angle delta for arc calculation in degrees, a_th needs to be a multiple of interval_a, if = 0, only interaction point, no arc
+  	double a_th = atof(args[8]); ///<  angle delta for arc calculation in degrees, a_th needs to be a multiple of interval_a, if = 0, only interaction point, no arc
 	cout << "angle delta = " << a_th << endl;
-  	double interval_a = atof(argv[9]); ///< interval angle at which interaction points are calculated, can only be =0 if a_th is equal to zero!
+  	double interval_a = atof(args[9]); ///< interval angle at which interaction points are calculated, can only be =0 if a_th is equal to zero!
 	cout << "interval = " << interval_a << endl;
 
   
@@ -295,38 +310,31 @@ try{
 	
 	// test if outfile exists already
 	ifstream f;
-	f.open(argv[3]);
+	f.open(args[3]);
 	if (f.is_open()){
 		f.close();
-		throw Exception (OUTPUT_EXISTS, (string) argv[3]);
+		throw Exception (OUTPUT_EXISTS, (string) args[3]);
 	}
 	
 	// Open input files
-	f.open(argv[1]);
+	f.open(args[1]);
 	if (f.fail()){
-		string info = string (argv[1]);
+		string info = string (args[1]);
 		throw Exception (CANNOT_OPEN_FILE, info);
 	}
 	
 	TagsFile tgs_md;
-	tgs_md.read_file(argv[2]);
+	tgs_md.read_file(args[2]);
 
 	// opens outputfile
-	ofstream g;
-	g.open(argv[3]);
-	if (!g.is_open()){
-		f.close();
-		throw Exception(CANNOT_OPEN_FILE, (string) argv[3]);
-	}
-	g<<"Time,Frame,Box,Ant1,Ant2,Xcoor1,Ycoor1,Angle1,Xcoor2,Ycoor2,Angle2,Direction,From,To"<<endl;
+	InteractionWriter g;
+	g.open(args[3], binary, INTERACTION_DIRECTION | INTERACTION_FROM_TO);
 	
 	cout<<"start interaction search... "<<endl;
 	// read through binary file
-	while (!f.eof()){
+	framerec temp;
+	while (f.read((char*) &temp, sizeof(temp))){
 		
-		framerec temp;
-		//cout<<"interval 1"<<endl;
-		f.read((char*) &temp, sizeof(temp)); 
 		for (int j(0); j < tag_count; j++){ 
 			// for tags that are in the tags files and not dead/lost tags
 			if (tgs_md.get_state(j) && (tgs_md.get_death(j)== 0 || tgs_md.get_death(j) > temp.frame)){
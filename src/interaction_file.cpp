@@ -0,0 +1,300 @@
+/*
+ *  interaction_file.cpp
+ *
+ *  Copyright UNIL. All rights reserved.
+ *
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <cstddef>
+#include <algorithm>
+#include "interaction_file.h"
+
+const size_t INTERACTION_BUFFER = 1 << 20;	///< size of the read and write buffers in bytes
+
+
+//==================== InteractionWriter =====================================
+InteractionWriter::InteractionWriter(){
+	binary = false;
+	flags = 0;
+	count = 0;
+	used = 0;
+	buffer_size = INTERACTION_BUFFER;
+}
+
+InteractionWriter::~InteractionWriter(){
+	// a destructor must not throw: the writers that are not closed explicitly (e.g. during the unwinding of another
+	// exception) are closed here and a write error is only reported by the message of the exception
+	if (f.is_open()){
+		try{
+			close();
+		}catch(Exception e){
+		}
+	}
+}
+
+//============================================================================
+void InteractionWriter::open(const string& filename, const bool bin, const uint32_t fl){
+	name = filename;
+	binary = bin;
+	flags = fl;
+	count = 0;
+	used = 0;
+	// a CSV line needs up to 128 bytes
+	buffer.resize(max(buffer_size, (size_t) 256));
+	f.open(filename.c_str(), ios::out | ios::binary | ios::trunc);
+	if (!f.is_open()){
+		throw Exception(CANNOT_OPEN_FILE, filename);
+	}
+	if (binary){
+		// the number of records is written in close()
+		interaction_header h;
+		memset(&h, 0, sizeof(h));
+		memcpy(h.magic, INTERACTION_MAGIC, sizeof(h.magic));
+		h.version = INTERACTION_VERSION;
+		h.record_size = sizeof(interaction_record);
+		h.flags = flags;
+		f.write((char*) &h, sizeof(h));
+	}else{
+		f<<"Time,Frame,Box,Ant1,Ant2,Xcoor1,Ycoor1,Angle1,Xcoor2,Ycoor2,Angle2";
+		if (flags & INTERACTION_DIRECTION){
+			f<<",Direction";
+		}
+		if (flags & INTERACTION_FROM_TO){
+			f<<",From,To";
+		}
+		f<<"\n";
+	}
+	if (f.fail()){
+		throw Exception(CANNOT_WRITE_FILE, filename);
+	}
+}
+
+//============================================================================
+void InteractionWriter::set_buffer_size(const size_t bytes){
+	buffer_size = bytes;
+}
+
+//============================================================================
+void InteractionWriter::write(const interaction_record& r){
+	if (binary){
+		if (used + sizeof(r) > buffer.size()){
+			flush();
+		}
+		memcpy(&buffer[used], &r, sizeof(r));
+		used += sizeof(r);
+	}else{
+		// a line is at most ~100 characters
+		if (used + 128 > buffer.size()){
+			flush();
+		}
+		char* p = &buffer[used];
+		// same number formatting as an ostream with precision(12)
+		int n = sprintf(p, "%.12g,%u,%u,%u,%u,%d,%d,%d,%d,%d,%d", r.time, r.frame, (unsigned int) r.box, (unsigned int) r.tag1, (unsigned int) r.tag2, r.x1, r.y1, r.a1, r.x2, r.y2, r.a2);
+		if (flags & INTERACTION_DIRECTION){
+			n += sprintf(p + n, ",%d", r.direction);
+		}
+		if (flags & INTERACTION_FROM_TO){
+			n += sprintf(p + n, ",%c,%c", r.from, r.to);
+		}
+		p[n++] = '\n';
+		used += n;
+	}
+	count++;
+}
+
+//============================================================================
+void InteractionWriter::flush(){
+	if (used > 0){
+		f.write(&buffer[0], used);
+		used = 0;
+		if (f.fail()){
+			throw Exception(CANNOT_WRITE_FILE, name);
+		}
+	}
+}
+
+//============================================================================
+void InteractionWriter::close(){
+	flush();
+	if (binary){
+		f.seekp(offsetof(interaction_header, count), ios::beg);
+		f.write((char*) &count, sizeof(count));
+	}
+	f.close();
+	if (f.fail()){
+		throw Exception(CANNOT_WRITE_FILE, name);
+	}
+}
+
+//============================================================================
+uint64_t InteractionWriter::get_count() const{
+	return count;
+}
+
+
+//==================== InteractionReader =====================================
+InteractionReader::InteractionReader(){
+	binary = false;
+	flags = 0;
+	count = 0;
+	remaining = 0;
+	pos = 0;
+	filled = 0;
+	buffer_size = INTERACTION_BUFFER;
+}
+
+InteractionReader::~InteractionReader(){
+	close();
+}
+
+//============================================================================
+void InteractionReader::open(const string& filename){
+	name = filename;
+	pos = 0;
+	filled = 0;
+	count = 0;
+	f.open(filename.c_str(), ios::in | ios::binary);
+	if (!f.is_open()){
+		throw Exception(CANNOT_OPEN_FILE, filename);
+	}
+
+	// recognizes the format with the magic number
+	interaction_header h;
+	memset(&h, 0, sizeof(h));
+	f.read((char*) &h, sizeof(h));
+	binary = (f.gcount() == sizeof(h) && memcmp(h.magic, INTERACTION_MAGIC, sizeof(h.magic)) == 0);
+
+	if (binary){
+		if (h.version != INTERACTION_VERSION){
+			throw Exception(DATA_ERROR, filename + ": unsupported version " + to_string(h.version) + " of the interaction format.");
+		}
+		if (h.record_size != sizeof(interaction_record)){
+			throw Exception(DATA_ERROR, filename + ": invalid record size in header.");
+		}
+		flags = h.flags;
+
+		// the number of records is deduced from the file size, the count of the header is only set when the file was closed properly
+		f.seekg(0, ios::end);
+		uint64_t size = (uint64_t) f.tellg() - sizeof(h);
+		f.seekg(sizeof(h), ios::beg);
+		if (size % sizeof(interaction_record) != 0 || (h.count != 0 && h.count != size / sizeof(interaction_record))){
+			throw Exception(DATA_ERROR, filename + ": file is truncated.");
+		}
+		count = size / sizeof(interaction_record);
+		remaining = count;
+		buffer.resize(max(buffer_size - buffer_size % sizeof(interaction_record), sizeof(interaction_record)));
+	}else{
+		f.clear();
+		f.seekg(0, ios::beg);
+		// optional columns are given by the header line
+		string s;
+		getline(f, s);
+		flags = 0;
+		if (s.find("Direction") != string::npos){
+			flags |= INTERACTION_DIRECTION;
+		}
+		if (s.find("From") != string::npos){
+			flags |= INTERACTION_FROM_TO;
+		}
+		// the lines are parsed from the mapped file
+		f.close();
+		csv.open(filename);
+	}
+}
+
+//============================================================================
+void InteractionReader::set_buffer_size(const size_t bytes){
+	buffer_size = bytes;
+}
+
+//============================================================================
+bool InteractionReader::fill(){
+	size_t n = buffer.size() / sizeof(interaction_record);
+	if (n > remaining){
+		n = remaining;
+	}
+	if (n == 0){
+		return false;
+	}
+	f.read(&buffer[0], n * sizeof(interaction_record));
+	if ((size_t) f.gcount() != n * sizeof(interaction_record)){
+		throw Exception(CANNOT_READ_FILE, name);
+	}
+	remaining -= n;
+	pos = 0;
+	filled = n * sizeof(interaction_record);
+	return true;
+}
+
+//============================================================================
+bool InteractionReader::read(interaction_record& r){
+	if (binary){
+		if (pos == filled && !fill()){
+			return false;
+		}
+		memcpy(&r, &buffer[pos], sizeof(r));
+		pos += sizeof(r);
+		return true;
+	}
+	while (csv.next_line()){
+		if (parse_line(r)){
+			return true;
+		}
+	}
+	return false;
+}
+
+//============================================================================
+bool InteractionReader::parse_line(interaction_record& r){
+	memset(&r, 0, sizeof(r));
+	if (!csv.try_double(r.time)){
+		return false;	// header or empty line
+	}
+	r.frame = csv.read_uint();
+	r.box = csv.read_int();
+	r.tag1 = csv.read_int();
+	r.tag2 = csv.read_int();
+	r.x1 = csv.read_int();
+	r.y1 = csv.read_int();
+	r.a1 = csv.read_int();
+	r.x2 = csv.read_int();
+	r.y2 = csv.read_int();
+	r.a2 = csv.read_int();
+
+	// optional columns: direction, from, to
+	if (!csv.at_end()){
+		r.direction = csv.read_int();
+		if (!csv.at_end()){
+			r.from = csv.read_char();
+		}
+		if (!csv.at_end()){
+			r.to = csv.read_char();
+		}
+	}
+	return true;
+}
+
+//============================================================================
+void InteractionReader::close(){
+	if (f.is_open()){
+		f.close();
+	}
+	csv.close();
+}
+
+//============================================================================
+bool InteractionReader::is_binary() const{
+	return binary;
+}
+
+//============================================================================
+uint32_t InteractionReader::get_flags() const{
+	return flags;
+}
+
+//============================================================================
+uint64_t InteractionReader::get_count() const{
+	return count;
+}
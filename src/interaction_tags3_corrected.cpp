@@ -17,10 +17,14 @@
 #include <string>
 #include <cmath>
 #include <vector>
+#include <getopt.h>
 #include "trackcvt.h"
 #include "exception.h"
 #include "tags3.h"
 #include "utils.h"
+#include "interaction_file.h"
+#include "event_filter.h"
+#include "contact_network.h"
 
 using namespace std;
 
@@ -44,11 +48,10 @@ bool is_in_rect(int xc, int yc, int a, int w, int h, int x, int y){
   double xt = x - xc;
   double yt = y - yc;
 
-  double ar = ((double) (90-a) * M_PI / 180.0);
-
-  // Rotation
-  double ca = cos(ar);
-  double sa = -sin(ar);
+  // Rotation by 90-a degrees
+  const trig_value& ar = trig_centidegree((90-a) * 100);
+  double ca = ar.c;
+  double sa = -ar.s;
 
   double xtr = xt * ca - yt * sa;
   double ytr = xt * sa + yt * ca;
@@ -76,11 +79,10 @@ bool is_in_trapezoid(int xc, int yc, int a, int w1, int w2, int h, int x, int y)
 	double xt = x - xc;
 	double yt = y - yc;
 	
-	double ar = ((double) (90-a) * M_PI / 180.0);
-	
-	// Rotation
-	double ca = cos(ar);
-	double sa = -sin(ar);
+	// Rotation by 90-a degrees
+	const trig_value& ar = trig_centidegree((90-a) * 100);
+	double ca = ar.c;
+	double sa = -ar.s;
 	
 	double xtr = xt * ca - yt * sa;
 	double ytr = xt * sa + yt * ca;
@@ -115,11 +117,11 @@ bool is_in_trapezoid_variableheight(int xc, int yc, int a, double w1, double w2,
 	double yt = y - yc;
 	
 	//Calculate rotation angle to have trapezoid facing "up" (i.e. with head at 90deg (top of image)
-	double ar = ((double) (90-a) * M_PI / 180.0);
+	const trig_value& ar = trig_centidegree((90-a) * 100);
 	
 	// Calculate rotation parameters
-	double ca = cos(ar);
-	double sa = -sin(ar);
+	double ca = ar.c;
+	double sa = -ar.s;
 	
 	// Apply rotation to centered, tested point
 	double xtr = xt * ca - yt * sa;
@@ -146,6 +148,176 @@ bool is_in_trapezoid_variableheight(int xc, int yc, int a, double w1, double w2,
 }
 
 
+// =====================================================================================
+/**\fn bool is_arc_in_trapezoid(double xc, double yc, int a, double w1, double w2, double ha, double tl, double xo, double yo, int ao, double r, double a_th)
+ * \brief Exact test whether the antennal arc of an ant reaches into the trapezoid of another ant.
+          The arc is centered at (xo,yo), has the radius r and covers the angles ao-a_th to ao+a_th.
+          Since the trapezoid is convex, the arc enters it if and only if one of its end points is inside the trapezoid,
+          or if it crosses one of the 4 sides of the trapezoid. This replaces the sampling of points on the arc every interval_a degrees.
+          The trapezoid is the one of is_in_trapezoid_variableheight, the trapezoid of is_in_trapezoid corresponds to ha = h and tl = 2h.
+ * \param xc X-coordinate of tag of ant modeled as trapezoid
+ * \param yc Y-coordinate of tag of ant modeled as trapezoid
+ * \param a Angle of ant modeled as trapezoid (centidegrees)
+ * \param w1 Width of trapezoid at the head end of the ant modeled
+ * \param w2 Width of trapezoid at the abdomen end of the ant modeled
+ * \param ha Antennal reach of ant modeled as trapezoid (distance between tag and head end of trapezoid)
+ * \param tl Length of trapezoid
+ * \param xo X-coordinate of tag of the other ant (center of the arc)
+ * \param yo Y-coordinate of tag of the other ant (center of the arc)
+ * \param ao Angle of the other ant (centidegrees)
+ * \param r Antennal reach of the other ant (radius of the arc)
+ * \param a_th Half opening angle of the arc (degrees)
+ * \return True if a point of the arc is in the trapezoid
+ */
+bool is_arc_in_trapezoid(double xc, double yc, int a, double w1, double w2, double ha, double tl, double xo, double yo, int ao, double r, double a_th){
+	
+	// Rotation to have the trapezoid facing "up", as in is_in_trapezoid, the y axis is inverted to point upwards,
+	// so that the head of the trapezoid is at y = ha and its abdomen at y = -(tl-ha)
+	const trig_value& ar = trig_centidegree(9000 - a);
+	double ca = ar.c;
+	double sa = -ar.s;
+	double xt = xo - xc;
+	double yt = yo - yc;
+	double cx = xt * ca - yt * sa;
+	double cy = -(xt * sa + yt * ca);
+	
+	// in this frame the arc is (cx + r * cos(b), cy + r * sin(b)) with b between (ao+90-a)-a_th and (ao+90-a)+a_th
+	const trig_value& am = trig_centidegree(ao + 9000 - a);
+	double mx = am.c;	// direction of the middle of the arc
+	double my = am.s;
+	trig_value ah = trig_degree(a_th);
+	double ch = ah.c;
+	double sh = ah.s;
+	if (a_th >= 180){
+		ch = -1;
+	}
+	
+	// end points of the arc
+	double ex[2] = {cx + r * (mx * ch + my * sh), cx + r * (mx * ch - my * sh)};
+	double ey[2] = {cy + r * (my * ch - mx * sh), cy + r * (my * ch + mx * sh)};
+	for (int i(0); i < 2; i++){
+		double ytr = -ey[i];
+		if (ytr > -ha && ytr < tl - ha){
+			double wtr((w1 + (w2 - w1) * ((ytr+ha) / tl))/2);
+			if (abs(ex[i]) < wtr){
+				return true;
+			}
+		}
+	}
+	
+	// corners of the trapezoid: head left, head right, abdomen right, abdomen left
+	double px[4] = {-w1/2, w1/2, w2/2, -w2/2};
+	double py[4] = {ha, ha, -(tl-ha), -(tl-ha)};
+	for (int i(0); i < 4; i++){
+		// intersections of the circle with the side: solve |p + t*d - c|^2 = r^2 for t in [0,1]
+		double dx = px[(i+1)%4] - px[i];
+		double dy = py[(i+1)%4] - py[i];
+		double fx = px[i] - cx;
+		double fy = py[i] - cy;
+		double qa = dx * dx + dy * dy;
+		double qb = 2 * (dx * fx + dy * fy);
+		double qc = fx * fx + fy * fy - r * r;
+		double disc = qb * qb - 4 * qa * qc;
+		if (disc <= 0 || qa == 0){
+			continue;	// circle misses or touches the side
+		}
+		disc = sqrt(disc);
+		double t[2] = {(-qb - disc) / (2 * qa), (-qb + disc) / (2 * qa)};
+		for (int j(0); j < 2; j++){
+			if (t[j] >= 0 && t[j] <= 1){
+				// the intersection is on the arc if its angle to the middle of the arc is at most a_th
+				double ix = fx + t[j] * dx;
+				double iy = fy + t[j] * dy;
+				if (ix * mx + iy * my >= r * ch){
+					return true;
+				}
+			}
+		}
+	}
+	return false;
+}
+
+
+// =====================================================================================
+/**\fn int test_trapezoids(tag_pos pt1, tag_pos pt2, double a1, double a2, int size1, int size2, double tl1, double tl2, double width_factor, double width_ratio, double a_th, double interval_a, bool variable, bool exact)
+ * \brief Tests whether the antennal arc of each ant reaches into the trapezoid of the other ant (second part of test_interaction, once distance and angle thresholds are passed)
+ * \param pt1 Position and angle of tag1
+ * \param pt2 Position and angle of tag2
+ * \param a1 Angle of ant1 in degrees
+ * \param a2 Angle of ant2 in degrees
+ * \param size1 Antenna reach of ant1
+ * \param size2 Antenna of ant2
+ * \param tl1 Trapezoid length of ant1
+ * \param tl2 Trapezoid length of ant2
+ * \param width_factor Factor by which the trapezoid increases in width at the head of the ant compared to the abdomen of the ant
+ * \param width_ratio Ratio of the width of the ant compared to the height of the ant 
+ * \param a_th Half opening angle of the arc in degrees
+ * \param interval_a Interval between the tested points of the arc in degrees
+ * \param variable Use the trapezoid length of the tags file
+ * \param exact If true, the arcs are tested with is_arc_in_trapezoid instead of testing points every interval_a degrees
+ * \return 2 if there is no interaction, 1 if ant 1 is trapezoid of other, -1 if ant 2 is in trpaezoid of other and 0 if both are in trapezoids
+ */
+int test_trapezoids(tag_pos pt1, tag_pos pt2, double a1, double a2, int size1, int size2, double tl1, double tl2, double width_factor, double width_ratio, double a_th, double interval_a, bool variable, bool exact){
+  bool in1(false);
+  bool in2(false);
+  if (exact){
+    // exact intersection of the arc of each ant with the trapezoid of the other ant
+    if (variable){
+      in2 = is_arc_in_trapezoid(pt1.x, pt1.y, pt1.a, tl1/2 * width_ratio * width_factor, tl1/2 * width_ratio, size1, tl1, pt2.x, pt2.y, pt2.a, size2, a_th);
+      in1 = is_arc_in_trapezoid(pt2.x, pt2.y, pt2.a, tl2/2 * width_ratio * width_factor, tl2/2 * width_ratio, size2, tl2, pt1.x, pt1.y, pt1.a, size1, a_th);
+    }else{
+      in2 = is_arc_in_trapezoid(pt1.x, pt1.y, pt1.a, size1 * width_ratio * width_factor, size1 * width_ratio, size1, 2 * size1, pt2.x, pt2.y, pt2.a, size2, a_th);
+      in1 = is_arc_in_trapezoid(pt2.x, pt2.y, pt2.a, size2 * width_ratio * width_factor, size2 * width_ratio, size2, 2 * size2, pt1.x, pt1.y, pt1.a, size1, a_th);
+    }
+  }else{
+    // test whether an interaction point (on arc) of ant2 is within trapezoid of ant1
+    double delta_a(- a_th);
+    do {
+      trig_value t = trig_degree(a2 + delta_a);
+      double pt2e_x = pt2.x + size2 * t.c;  	// calculates an "interaction point" for the ant
+      double pt2e_y = pt2.y - size2 * t.s;
+      if (variable){
+        in2 = (is_in_trapezoid_variableheight(pt1.x, pt1.y, a1, tl1/2 * width_ratio * width_factor, tl1/2 * width_ratio, size1, tl1, pt2e_x, pt2e_y));
+  	}else{
+        in2 = (is_in_trapezoid(pt1.x, pt1.y, a1, size1 * width_ratio * width_factor, size1 * width_ratio, size1, pt2e_x, pt2e_y));
+
+      }
+    
+      delta_a += interval_a;
+    }while (!in2 && delta_a < a_th);
+  
+    // test whether interaction points (on arc) of ant1 is within trapezoid of ant2
+    delta_a = - a_th;
+    do {
+      trig_value t = trig_degree(a1 + delta_a);
+      double pt1e_x = pt1.x + size1 * t.c;
+      double pt1e_y = pt1.y - size1 * t.s;  // -sin as y axis is turned downwards
+      if (variable){
+        in1 = (is_in_trapezoid_variableheight(pt2.x, pt2.y, a2, tl2/2 * width_ratio * width_factor, tl2/2 * width_ratio, size2, tl2, pt1e_x, pt1e_y));
+      }else{
+         in1 = (is_in_trapezoid(pt2.x, pt2.y, a2, size2 * width_ratio * width_factor, size2 * width_ratio, size2, pt1e_x, pt1e_y));
+      }
+      delta_a += interval_a;
+    }while (!in1 && delta_a < a_th);
+  }
+
+  // interaction unlikely if none of the interaction points is in the rectangle of the other ant
+  //bool in1 = (is_in_rect(pt1.x, pt1.y, a1, size1 * 0.4, size1, pt2e_x, pt2e_y));
+  //bool in2 = (is_in_rect(pt2.x, pt2.y, a2, size2 * 0.4, size2, pt1e_x, pt1e_y));
+  //if (!in1 && !in2) return 0;
+  
+	if (!in1 && !in2){
+		return 2;
+	}
+  if(!in1 && in2){
+    return -1;
+  }else if (in1 && !in2){
+    return 1;
+  }else if (in1 && in2){
+    return 0;
+  }
+}
+
 // =====================================================================================
 /**\fn int test_interaction(tag_pos pt1, tag_pos pt2, int size1, int size2, int d_th, int a_th_par, int a_th_beh, double width_factor, double width_ratio)
  * \brief Test whether 2 tags with positions pt1 ant pt2 and radius' size1 and size2 are interacting
@@ -157,9 +329,10 @@ bool is_in_trapezoid_variableheight(int xc, int yc, int a, double w1, double w2,
  * \param a_th_par Angle threshold for paralell ants
  * \param width_factor Factor by which the trapezoid increases in width at the head of the ant compared to the abdomen of the ant
  * \param width_ratio Ratio of the width of the ant compared to the height of the ant 
+ * \param exact If true, the arcs are tested with is_arc_in_trapezoid instead of testing points every interval_a degrees
  * \return 2 if there is no interaction, 1 if ant 1 is trapezoid of other, -1 if ant 2 is in trpaezoid of other and 0 if both are in trapezoids
  */
-int test_interaction(tag_pos pt1, tag_pos pt2, int size1, int size2, double tl1, double tl2, int d_th, int a_th_par, double width_factor, double width_ratio, double a_th, double interval_a, bool variable){
+int test_interaction(tag_pos pt1, tag_pos pt2, int size1, int size2, double tl1, double tl2, int d_th, int a_th_par, double width_factor, double width_ratio, double a_th, double interval_a, bool variable, bool exact){
 	// if no position data for one ant only or if ants in 2 different boxes, no interaction is possible
 	if (pt1.x == -1 || pt2.x==-1 || pt1.id != pt2.id){ 
 		return 2;
@@ -184,55 +357,69 @@ int test_interaction(tag_pos pt1, tag_pos pt2, int size1, int size2, double tl1,
 	if (da < a_th_par){
 		return 2;
 	}
-  
-  // test whether an interaction point (on arc) of ant2 is within trapezoid of ant1
-  double delta_a(- a_th);
-  bool in2(false);
-  do {
-  	double a2r = (a2 + delta_a) * M_PI / 180.0; 	// Convert angle to radians for trigonometry
-    double pt2e_x = pt2.x + size2 * cos(a2r);  	// calculates an "interaction point" for the ant
-    double pt2e_y = pt2.y - size2 * sin(a2r);
-    if (variable){
-      in2 = (is_in_trapezoid_variableheight(pt1.x, pt1.y, a1, tl1/2 * width_ratio * width_factor, tl1/2 * width_ratio, size1, tl1, pt2e_x, pt2e_y));
-	}else{
-      in2 = (is_in_trapezoid(pt1.x, pt1.y, a1, size1 * width_ratio * width_factor, size1 * width_ratio, size1, pt2e_x, pt2e_y));
 
-    }
-    
-    delta_a += interval_a;
-  }while (!in2 && delta_a < a_th);
-  
-  // test whether interaction points (on arc) of ant1 is within trapezoid of ant2
-  delta_a = - a_th;
-  bool in1(false);
-  do {
-    double a1r = (a1 + delta_a) * M_PI / 180.0;
-    double pt1e_x = pt1.x + size1 * cos(a1r);
-    double pt1e_y = pt1.y - size1 * sin(a1r);  // -sin as y axis is turned downwards
-    if (variable){
-      in1 = (is_in_trapezoid_variableheight(pt2.x, pt2.y, a2, tl2/2 * width_ratio * width_factor, tl2/2 * width_ratio, size2, tl2, pt1e_x, pt1e_y));
-    }else{
-       in1 = (is_in_trapezoid(pt2.x, pt2.y, a2, size2 * width_ratio * width_factor, size2 * width_ratio, size2, pt1e_x, pt1e_y));
-    }
-    delta_a += interval_a;
-  }while (!in1 && delta_a < a_th);
+	return test_trapezoids(pt1, pt2, a1, a2, size1, size2, tl1, tl2, width_factor, width_ratio, a_th, interval_a, variable, exact);
+}
 
+// =====================================================================================
+/// temporal coherence between frames: with a maximal speed of the ants, a pair that is far apart cannot interact before a given frame
+struct pair_culling{
+	double speed;				///< maximal speed of an ant in pixels per frame
+	vector <uint32_t> until;	///< for each pair (j * tag_count + k), first frame in which the pair must be tested again
+	vector <uint8_t> box;		///< box of the pair when until was set
+	uint64_t skipped;			///< number of pair tests skipped
+};
 
-  // interaction unlikely if none of the interaction points is in the rectangle of the other ant
-  //bool in1 = (is_in_rect(pt1.x, pt1.y, a1, size1 * 0.4, size1, pt2e_x, pt2e_y));
-  //bool in2 = (is_in_rect(pt2.x, pt2.y, a2, size2 * 0.4, size2, pt1e_x, pt1e_y));
-  //if (!in1 && !in2) return 0;
-  
-	if (!in1 && !in2){
-		return 2;
+// =====================================================================================
+/**\fn inline bool is_culled(pair_culling* c, const framerec& temp, int j, int k)
+ * \brief Tests whether the pair (j,k) is known to be too far apart to interact in the current frame
+ * \param c Culling state (NULL if culling is not used)
+ * \param temp Current frame
+ * \param j Index of tag 1 in tag_list
+ * \param k Index of tag 2 in tag_list
+ * \return True if the pair can be skipped
+ */
+inline bool is_culled(pair_culling* c, const framerec& temp, int j, int k){
+	if (c == NULL){
+		return false;
 	}
-  if(!in1 && in2){
-    return -1;
-  }else if (in1 && !in2){
-    return 1;
-  }else if (in1 && in2){
-    return 0;
-  }
+	int p = j * tag_count + k;
+	if (temp.frame < c->until[p] && temp.tags[j].id == c->box[p] && temp.tags[k].id == c->box[p]){
+		c->skipped++;
+		return true;
+	}
+	return false;
+}
+
+// =====================================================================================
+/**\fn inline bool cull_pair(pair_culling* c, const framerec& temp, int j, int k, double threshold)
+ * \brief Calculates the distance of the pair (j,k) as test_interaction does; if it is beyond the threshold, sets the frame until which
+ *        the pair cannot come closer than the threshold, since both ants move at most c->speed pixels per frame
+ * \param c Culling state (NULL if culling is not used)
+ * \param temp Current frame
+ * \param j Index of tag 1 in tag_list
+ * \param k Index of tag 2 in tag_list
+ * \param threshold Distance under which the pair has to be tested (size1 + size2 + d_th)
+ * \return True if the pair is beyond the threshold (no interaction in this frame)
+ */
+inline bool cull_pair(pair_culling* c, const framerec& temp, int j, int k, double threshold){
+	if (c == NULL || temp.tags[j].id != temp.tags[k].id){
+		return false;
+	}
+	double dx = temp.tags[k].x - temp.tags[j].x;
+	double dy = temp.tags[k].y - temp.tags[j].y;
+	double dist = sqrtf((double)dx*dx + (double)dy*dy);
+	if (dist < threshold){
+		return false;
+	}
+	// the distance decreases by at most 2 * speed per frame (0.01 pixel margin for the rounding of sqrtf)
+	double frames = floor((dist - threshold - 0.01) / (2 * c->speed));
+	if (frames > 0){
+		int p = j * tag_count + k;
+		c->until[p] = temp.frame + 1 + (uint32_t) min(frames, 1e9);
+		c->box[p] = temp.tags[j].id;
+	}
+	return true;
 }
 
 // =====================================================================================
@@ -240,14 +427,19 @@ int test_interaction(tag_pos pt1, tag_pos pt2, int size1, int size2, double tl1,
  * \brief Finds all interactions of a given tag (index j in tag_list) with all other tags
  * \param temp Frame recording of current frame
  * \param tgs File .tags with details on each tag
- * \param g Stream for output file
+ * \param g Writers of the output files, one per shard (not used when the interactions are merged into events or into a contact network)
+ * \param shards Number of shards: the interactions of a pair are written to g[pair_shard(tag1, tag2, shards)]
+ * \param ev Event filter to which the interactions are given (NULL if not used)
+ * \param net Contact network to which the interactions are given (NULL if not used)
  * \param j Index of tag in tag_list (trackcvt.h file)
  * \param d_th Distance threshold
  * \param a_th_par Angle threshold for paralell ants
  * \param width_factor Factor by which the trapezoid increases in width at the head of the ant compared to the abdomen of the ant
  * \param width_ratio Ratio of the width of the ant compared to the height of the ant 
+ * \param exact Use the exact arc test instead of sampled interaction points
+ * \param c Culling state of the pairs (NULL if culling is not used)
  */
-inline void cherche_interaction(framerec& temp, TagsFile& tgs, ofstream& g, int j, int d_th, int a_th_par, double width_factor, double width_ratio, double a_th, double interval_a, bool variable){
+inline void cherche_interaction(framerec& temp, TagsFile& tgs, InteractionWriter* g, int shards, EventFilter* ev, ContactNetwork* net, int j, int d_th, int a_th_par, double width_factor, double width_ratio, double a_th, double interval_a, bool variable, bool exact, pair_culling* c){
 	for (int k(j+1); k < tag_count; k++){
 		if (temp.tags[k].x != -1){
 			// check that partner ant is still alive, interactions only considered for live tagged ants
@@ -255,13 +447,20 @@ inline void cherche_interaction(framerec& temp, TagsFile& tgs, ofstream& g, int
 				// if the interaction test return something different from 0 there is an interaction 
 				// the test distinguishes 2 types of interaction: unidirectional (return value 1) and bidirectional (return value 2) but we don't distinguish between these interactions for the moment
 //      testing <<tag_list[j]<<","<<tag_list[k]<<endl;
-        int direction = test_interaction(temp.tags[j], temp.tags[k], tgs.get_rayon(j), tgs.get_rayon(k), tgs.get_trapezoid_length(j), tgs.get_trapezoid_length(k), d_th, a_th_par, width_factor, width_ratio, a_th, interval_a, variable);
+        if (is_culled(c, temp, j, k) || cull_pair(c, temp, j, k, tgs.get_rayon(j) + tgs.get_rayon(k) + d_th)){
+          continue;
+        }
+        int direction = test_interaction(temp.tags[j], temp.tags[k], tgs.get_rayon(j), tgs.get_rayon(k), tgs.get_trapezoid_length(j), tgs.get_trapezoid_length(k), d_th, a_th_par, width_factor, width_ratio, a_th, interval_a, variable, exact);
 				if (direction != 2){ // 2 = no interaction
           //cout<<"tag "<<tag_list[j]<<" interacts with tag "<<tag_list[k]<<" in frame "<<temp.frame<<endl;
-          g.precision(12);
-          g<<temp.time<<","<<temp.frame<<","<<(int)temp.tags[j].id<<","<<tag_list[j]<<","<<tag_list[k]<<",";
-					g<<temp.tags[j].x<<","<<temp.tags[j].y<<","<<temp.tags[j].a<<",";
-					g<<temp.tags[k].x<<","<<temp.tags[k].y<<","<<temp.tags[k].a<<","<<direction<<endl;
+          interaction_record r = {temp.time, temp.frame, (uint16_t) tag_list[j], (uint16_t) tag_list[k], temp.tags[j].x, temp.tags[j].y, temp.tags[j].a, temp.tags[k].x, temp.tags[k].y, temp.tags[k].a, temp.tags[j].id, (int8_t) direction, 0, 0};
+          if (ev){
+            ev->write(r);
+          }else if (net){
+            net->write(r);
+          }else{
+            g[pair_shard(r.tag1, r.tag2, shards)].write(r);
+          }
 				}
 			}
 		}
@@ -269,41 +468,31 @@ inline void cherche_interaction(framerec& temp, TagsFile& tgs, ofstream& g, int
 }
 
 // =====================================================================================
-int main(int argc, char* argv[]){
-try{
+/// set of parameters evaluated in sweep mode, with its results
+struct parameter_set{
+	int d_th;					///< distance threshold
+	int a_th_par;				///< angle threshold for paralell ants
+	double width_factor;		///< head-width correction factor
+	double width_ratio;			///< width/height ratio of ant
+	double a_th;				///< angle delta for arc calculation
+	int geometry;				///< index of the first set with the same width_factor, width_ratio and a_th (test_trapezoids gives the same result)
+	uint64_t count;				///< number of interactions
+	uint64_t direction[3];		///< number of interactions with direction -1, 0 and 1
+	vector <bool> pairs;		///< pairs of ants that interacted at least once
+	InteractionWriter* g;		///< writer of the interactions of the set (NULL if only counts are written)
+};
 
-	if (argc!=11){
-		string info = string (argv[0]) + " input.dat input.tags outfile.txt distance(px) angle_paralell(deg) width_factor width_ratio delta_angle(degree) angle_interval(degree) use_trapezoid_length(0|1)"; //trapezoid.txt interaction_tester.txt tag_call.txt";
-		throw Exception (USE, info);
-	}
-	
-//  trapezoid.open(argv[8]);
-//  interaction_tester.open(argv[9]);
-//  testing.open(argv[10]);
-  
-  
-	// read input parameters and tests whether they are valid
-	int d_th = atoi(argv[4]);		//distance threshold : maximum distance between 2 ants to be considered interacting, choice based on visual inspection of videos
-	cout << "distance_threshold = " << d_th << endl;
-	int a_th_par = atoi(argv[5]);	//angle threshold: minimum angle between 2 ants to be considered interacting
-	cout << "angle threshold = " << a_th_par << endl;
-	double width_factor = atof(argv[6]);     // Head-width correction factor (determines how wide the trapezoid will be at the ant head)
-	cout << "width_factor = " << width_factor << endl;
-	double width_ratio = atof(argv[7]);      // ratio width/height of ant (determines the height to average width of trapezoid)
-	cout << "width_ratio = " << width_ratio << endl;
-  	double a_th = atof(argv[8]); ///<  angle delta for arc calculation in degrees, a_th needs to be a multiple of interval_a, if = 0, only interaction point, no arc
-	cout << "angle delta = " << a_th << endl;
-  	double interval_a = atof(argv[9]); ///< interval angle at which interaction points are calculated, can only be =0 if a_th is equal to zero!
-	cout << "interval = " << interval_a << endl;
-	bool variable = atof(argv[10]);
-	cout << "use trapezoid = " << variable << endl;
-  
+// =====================================================================================
+/**\fn void check_parameters(int d_th, int a_th_par, double width_factor, double width_ratio, double a_th, double interval_a, bool exact)
+ * \brief Tests whether the parameters of the interaction detection are valid, throws an exception otherwise
+ */
+void check_parameters(int d_th, int a_th_par, double width_factor, double width_ratio, double a_th, double interval_a, bool exact){
 	if (d_th < 0){
 		string info = "Enter a positiv distance.";
 		throw Exception (PARAMETER_ERROR, info);
 	}
 
-  if (a_th != 0 && interval_a == 0){
+  if (!exact && a_th != 0 && interval_a == 0){
     string info = "Invalid parameter combination: if delta angle differs from zero, the angle_interval cannot be zero.";
 		throw Exception (PARAMETER_ERROR, info);
   }
@@ -322,54 +511,451 @@ try{
 		string info = "Enter a positive width ratio.";
 		throw Exception(PARAMETER_ERROR, info);
 	}
+}
+
+// =====================================================================================
+/**\fn void read_grid(const string& filename, vector <parameter_set>& sets, double interval_a, bool exact)
+ * \brief Reads the parameter sets of a sweep, one set per line: distance(px) angle_paralell(deg) width_factor width_ratio delta_angle(degree),
+ *        separated by spaces or commas. Lines starting with # are ignored.
+ * \param filename Name of the file
+ * \param sets Table of parameter sets to fill
+ * \param interval_a Angle interval (for the validation of the parameters)
+ * \param exact Exact arc test (for the validation of the parameters)
+ */
+void read_grid(const string& filename, vector <parameter_set>& sets, double interval_a, bool exact){
+	ifstream f;
+	f.open(filename.c_str());
+	if (!f.is_open()){
+		throw Exception(CANNOT_OPEN_FILE, filename);
+	}
+	string s;
+	int line (0);
+	while (getline(f, s)){
+		line++;
+		rtrim(s);
+		if (s.empty() || s[0] == '#'){
+			continue;
+		}
+		for (int i(0); i < s.size(); i++){
+			if (s[i] == ','){
+				s[i] = ' ';
+			}
+		}
+		stringstream ss;
+		ss.str(s);
+		parameter_set p;
+		ss>>p.d_th>>p.a_th_par>>p.width_factor>>p.width_ratio>>p.a_th;
+		if (ss.fail()){
+			throw Exception(DATA_ERROR, filename + ": invalid parameter set in line " + to_string(line));
+		}
+		check_parameters(p.d_th, p.a_th_par, p.width_factor, p.width_ratio, p.a_th, interval_a, exact);
+		p.geometry = sets.size();
+		for (int i(0); i < sets.size(); i++){
+			if (sets[i].width_factor == p.width_factor && sets[i].width_ratio == p.width_ratio && sets[i].a_th == p.a_th){
+				p.geometry = i;
+				break;
+			}
+		}
+		p.count = 0;
+		p.direction[0] = p.direction[1] = p.direction[2] = 0;
+		p.pairs.assign(tag_count * tag_count, false);
+		p.g = NULL;
+		sets.push_back(p);
+	}
+	f.close();
+	if (sets.empty()){
+		throw Exception(DATA_ERROR, filename + ": no parameter set.");
+	}
+}
+
+// =====================================================================================
+/**\fn inline void sweep_interaction(framerec& temp, TagsFile& tgs, vector <parameter_set>& sets, int d_max, vector <int>& cache, int j, double interval_a, bool variable, bool exact, pair_culling* c)
+ * \brief Finds all interactions of a given tag (index j in tag_list) with all other tags for every parameter set.
+ *        Pairs are first tested at the largest distance threshold, and test_trapezoids is run once per pair for all sets sharing the same geometry.
+ * \param temp Frame recording of current frame
+ * \param tgs File .tags with details on each tag
+ * \param sets Parameter sets
+ * \param d_max Largest distance threshold of the sets
+ * \param cache Result of test_trapezoids for each geometry (one entry per set)
+ * \param j Index of tag in tag_list (trackcvt.h file)
+ * \param c Culling state of the pairs (NULL if culling is not used)
+ */
+inline void sweep_interaction(framerec& temp, TagsFile& tgs, vector <parameter_set>& sets, int d_max, vector <int>& cache, int j, double interval_a, bool variable, bool exact, pair_culling* c){
+	tag_pos& pt1 = temp.tags[j];
+	int size1 = tgs.get_rayon(j);
+	double tl1 = tgs.get_trapezoid_length(j);
+	for (int k(j+1); k < tag_count; k++){
+		tag_pos& pt2 = temp.tags[k];
+		// same conditions as cherche_interaction and test_interaction
+		if (pt2.x == -1 || pt2.id != pt1.id){
+			continue;
+		}
+		if (!tgs.get_state(k) || (tgs.get_death(k) != 0 && tgs.get_death(k) <= temp.frame)){
+			continue;
+		}
+		int size2 = tgs.get_rayon(k);
+		if (is_culled(c, temp, j, k) || cull_pair(c, temp, j, k, size1 + size2 + d_max)){
+			continue;
+		}
+		double a1 = ((double) pt1.a / 100.0);
+		double a2 = ((double) pt2.a / 100.0);
+		double dx = pt2.x - pt1.x;
+		double dy = pt2.y - pt1.y;
+		double dist = sqrtf((double)dx*dx + (double)dy*dy);
+		if (dist >= size1 + size2 + d_max){
+			continue;
+		}
+		double da = abs(limit_angle(a2 - a1));
+		double tl2 = tgs.get_trapezoid_length(k);
+
+		for (int i(0); i < sets.size(); i++){
+			cache[i] = -2;	// not tested yet
+		}
+		for (int i(0); i < sets.size(); i++){
+			parameter_set& p = sets[i];
+			if (dist >= size1 + size2 + p.d_th || da < p.a_th_par){
+				continue;
+			}
+			int& direction = cache[p.geometry];
+			if (direction == -2){
+				direction = test_trapezoids(pt1, pt2, a1, a2, size1, size2, tl1, tl2, p.width_factor, p.width_ratio, p.a_th, interval_a, variable, exact);
+			}
+			if (direction != 2){
+				p.count++;
+				p.direction[direction + 1]++;
+				p.pairs[j * tag_count + k] = true;
+				if (p.g){
+					interaction_record r = {temp.time, temp.frame, (uint16_t) tag_list[j], (uint16_t) tag_list[k], pt1.x, pt1.y, pt1.a, pt2.x, pt2.y, pt2.a, pt1.id, (int8_t) direction, 0, 0};
+					p.g->write(r);
+				}
+			}
+		}
+	}
+}
+
+// =====================================================================================
+int main(int argc, char* argv[]){
+try{
+
+	bool exact(false);	// exact arc test instead of interaction points every interval_a degrees
+	bool binary(false);	// binary output instead of CSV
+	bool events(false);	// interactions are merged into events while they are detected
+	string grid = "";	// file with parameter sets for the sweep mode
+	bool contacts(false);	// in sweep mode, write the interactions of each set
+	double max_speed (0);	// maximal speed of the ants in pixels per frame, 0 if pair culling is not used
+	int F_TH = -1; // threshold for temporary close interaction, they are tested whether they are part of the same event 
+	int F_MAX = 0; /// maximal duration in frames of interaction, if longer than is considered to be
+	int X_TH = -1; // maximal variation in x and y coordinate that is accepted for interactions belonging to the same event
+	int X_min = -1; // minimum variation in x and y coordinate that is necessary for the ant to be declared awake
+	double window (0);	// length in seconds of the windows of the contact network, 0 if the interactions are written
+	bool durations (false);	// the contact network is weighted by durations instead of frame counts
+	int shards (0);	// number of files into which the interactions are split by pair, 0 for a single file
+	int option;
+	opterr = 0;
+	while ((option = getopt(argc, argv, ":ebst:m:d:a:S:wv:n:Dk:")) != -1){
+		switch (option){
+			case 'e':
+				exact = true;
+				break;
+			case 'b':
+				binary = true;
+				break;
+			case 's':
+				events = true;
+				break;
+			case 'S':
+				grid = optarg;
+				break;
+			case 'w':
+				contacts = true;
+				break;
+			case 'v':
+				max_speed = atof(optarg);
+				if (max_speed <= 0){
+					throw Exception(PARAMETER_ERROR, "The maximal speed (option -v) must be positive.");
+				}
+				break;
+			case 'n':
+				window = atof(optarg);
+				if (window <= 0){
+					throw Exception(PARAMETER_ERROR, "The length of the windows (option -n) must be positive.");
+				}
+				break;
+			case 'D':
+				durations = true;
+				break;
+			case 'k':
+				shards = atoi(optarg);
+				if (shards < 1){
+					throw Exception(PARAMETER_ERROR, "The number of shards (option -k) must be positive.");
+				}
+				break;
+			case 't':
+				F_TH = atoi(optarg);
+				break;
+			case 'm':
+				F_MAX = atoi(optarg);
+				break;
+			case 'd':
+				X_TH = atoi(optarg);
+				break;
+			case 'a':
+				X_min = atoi(optarg);
+				break;
+			case '?':
+				throw Exception(UNKNOWN_OPTION, "-" + string(1, (char)optopt));
+			case ':':
+				throw Exception(ARGUMENT_MISSING, "-" + string(1, (char)optopt));
+		}
+	}
+
+	if ((grid == "" && argc - optind != 10) || (grid != "" && argc - optind != 5)){
+		string info = string (argv[0]) + " [-e] [-b] [-v max_speed] [-s -t timethreshold(frames) -m max_duration(frames) -d distance_threshold(pixels) -a min_awake_distance(pixels)] [-n window(s) [-D]] [-k shards] input.dat input.tags outfile.txt distance(px) angle_paralell(deg) width_factor width_ratio delta_angle(degree) angle_interval(degree) use_trapezoid_length(0|1)\n"
+			+ "  -e  exact intersection of the antennal arc with the trapezoid, angle_interval is then ignored\n"
+			+ "  -b  write the interactions in binary format instead of CSV\n"
+			+ "  -v  maximal speed of the ants in pixels per frame: pairs that cannot come close enough before a given frame are not tested until then\n"
+			+ "  -s  merge the interactions into events as filter_interactions_cut_immobile does (options -t -m -d -a), outfile is then the file of events\n"
+			+ "  -n  contact network: counts the frames in which each pair interacted in windows of the given length in seconds,\n"
+			+ "      outfile is then the list of windows and the edges of window n (Tag1,Tag2,Weight) are written to outfile_n\n"
+			+ "  -D  with -n, weight the contacts by their duration in seconds instead of the number of frames\n"
+			+ "  -k  split the interactions by pair into the given number of files outfile_1 to outfile_k, that can be filtered independently\n"
+			+ "\n" + string (argv[0]) + " -S grid.txt [-w] [-e] [-b] [-v max_speed] input.dat input.tags outfile.txt angle_interval(degree) use_trapezoid_length(0|1)\n"
+			+ "  -S  sweep mode: evaluates in one pass every parameter set of grid.txt (one set per line: distance angle_paralell width_factor width_ratio delta_angle),\n"
+			+ "      outfile is then a summary with the number of interactions of each set\n"
+			+ "  -w  in sweep mode, also write the interactions of set n to outfile_n"; //trapezoid.txt interaction_tester.txt tag_call.txt";
+		throw Exception (USE, info);
+	}
+	if (grid != "" && events){
+		throw Exception(PARAMETER_ERROR, "Options -S and -s cannot be combined.");
+	}
+	if (grid == "" && contacts){
+		throw Exception(PARAMETER_ERROR, "Option -w requires option -S.");
+	}
+	if (window > 0 && (grid != "" || events || binary)){
+		throw Exception(PARAMETER_ERROR, "Option -n cannot be combined with options -S, -s and -b.");
+	}
+	if (window == 0 && durations){
+		throw Exception(PARAMETER_ERROR, "Option -D requires option -n.");
+	}
+	if (shards > 0 && (grid != "" || events || window > 0)){
+		throw Exception(PARAMETER_ERROR, "Option -k cannot be combined with options -S, -s and -n.");
+	}
+	if (events){
+		if (binary){
+			throw Exception(PARAMETER_ERROR, "Options -s and -b cannot be combined.");
+		}
+		if (F_TH == -1){
+			throw Exception(PARAMETER_ERROR,"Parameter of option -t is missing.");
+		}
+		if (F_TH < 0){
+			throw Exception(PARAMETER_ERROR,"Time threshold need to be positive.");
+		}
+		if (F_MAX == 0){
+			throw Exception(PARAMETER_ERROR,"Parameter of option -m is missing.");
+		}
+		if (F_MAX < 1){
+			throw Exception(PARAMETER_ERROR,"Maximal duration of interaction need to be positive.");
+		}
+		if (X_TH == -1){
+			throw Exception(PARAMETER_ERROR,"Parameter of option -d is missing.");
+		}
+		if (X_TH < 0){
+			throw Exception(PARAMETER_ERROR,"Distance threshold need to be non-negative.");
+		}
+		if (X_min == -1){
+			throw Exception(PARAMETER_ERROR,"Parameter of option -a is missing.");
+		}
+		if (X_min < 0){
+			throw Exception(PARAMETER_ERROR,"Min distance awake need to be non-negative.");
+		}
+	}else if (F_TH != -1 || F_MAX != 0 || X_TH != -1 || X_min != -1){
+		throw Exception(PARAMETER_ERROR, "Options -t -m -d -a require option -s.");
+	}
+	char** args = argv + optind - 1;	// args[1] to args[10] are the positional parameters
 	
-	// test if outfile exists already
+//  trapezoid.open(argv[8]);
+//  interaction_tester.open(argv[9]);
+//  testing.open(argv[10]);
+  
+  
+	// read input parameters and tests whether they are valid
+	int d_th (0);
+	int a_th_par (0);
+	double width_factor (0);
+	double width_ratio (0);
+	double a_th (0);
+	double interval_a (0);
+	bool variable (false);
+	vector <parameter_set> sets;
+	int d_max (0);	// largest distance threshold of the sweep
+	if (grid == ""){
+		d_th = atoi(args[4]);		//distance threshold : maximum distance between 2 ants to be considered interacting, choice based on visual inspection of videos
+		cout << "distance_threshold = " << d_th << endl;
+		a_th_par = atoi(args[5]);	//angle threshold: minimum angle between 2 ants to be considered interacting
+		cout << "angle threshold = " << a_th_par << endl;
+		width_factor = atof(args[6]);     // Head-width correction factor (determines how wide the trapezoid will be at the ant head)
+		cout << "width_factor = " << width_factor << endl;
+		width_ratio = atof(args[7]);      // ratio width/height of ant (determines the height to average width of trapezoid)
+		cout << "width_ratio = " << width_ratio << endl;
+		a_th = atof(args[8]); ///<  angle delta for arc calculation in degrees, a_th needs to be a multiple of interval_a, if = 0, only interaction point, no arc
+		cout << "angle delta = " << a_th << endl;
+		interval_a = atof(args[9]); ///< interval angle at which interaction points are calculated, can only be =0 if a_th is equal to zero!
+		cout << "interval = " << interval_a << endl;
+		variable = atof(args[10]);
+		cout << "use trapezoid = " << variable << endl;
+		cout << "exact arc test = " << exact << endl;
+
+		check_parameters(d_th, a_th_par, width_factor, width_ratio, a_th, interval_a, exact);
+	}else{
+		interval_a = atof(args[4]);
+		cout << "interval = " << interval_a << endl;
+		variable = atof(args[5]);
+		cout << "use trapezoid = " << variable << endl;
+		cout << "exact arc test = " << exact << endl;
+		read_grid(grid, sets, interval_a, exact);
+		for (int i(0); i < sets.size(); i++){
+			if (sets[i].d_th > d_max){
+				d_max = sets[i].d_th;
+			}
+		}
+		cout << sets.size() << " parameter sets" << endl;
+	}
+	
+	// test if outfile (or one of the shards) exists already
+	vector <string> outputs;
+	if (shards > 0){
+		for (int i(0); i < shards; i++){
+			outputs.push_back(string(args[3]) + "_" + to_string(i+1));
+		}
+	}else{
+		outputs.push_back(args[3]);
+	}
 	ifstream f;
-	f.open(argv[3]);
-	if (f.is_open()){
-		f.close();
-		throw Exception (OUTPUT_EXISTS, (string) argv[3]);
+	for (int i(0); i < outputs.size(); i++){
+		f.open(outputs[i].c_str());
+		if (f.is_open()){
+			f.close();
+			throw Exception (OUTPUT_EXISTS, outputs[i]);
+		}
 	}
 	
 	// Open input files
-	f.open(argv[1]);
+	f.open(args[1]);
 	if (f.fail()){
-		string info = string (argv[1]);
+		string info = string (args[1]);
 		throw Exception (CANNOT_OPEN_FILE, info);
 	}
 	
 	TagsFile tgs;
-	tgs.read_file(argv[2]);
+	tgs.read_file(args[2]);
 
 	
 	// opens outputfile
-	ofstream g;
-	g.open(argv[3]);
-	if (!g.is_open()){
-		f.close();
-		throw Exception(CANNOT_OPEN_FILE, (string) argv[3]);
+	vector <InteractionWriter> g (outputs.size());
+	EventFilter ev(F_TH, F_MAX, X_TH, X_min);
+	ContactNetwork net(window, durations);
+	vector <InteractionWriter> writers (sets.size());
+	vector <int> cache (sets.size());
+	if (grid != ""){
+		if (contacts){
+			for (int i(0); i < sets.size(); i++){
+				string name = string(args[3]) + "_" + to_string(i+1);
+				ifstream h;
+				h.open(name.c_str());
+				if (h.is_open()){
+					h.close();
+					throw Exception (OUTPUT_EXISTS, name);
+				}
+				writers[i].open(name, binary, INTERACTION_DIRECTION);
+				sets[i].g = &writers[i];
+			}
+		}
+	}else if (events){
+		ev.open(args[3]);
+	}else if (window > 0){
+		// the ants of the network are the ants of the tags file
+		vector <int> ants;
+		for (int j(0); j < tag_count; j++){
+			if (tgs.get_state(j)){
+				ants.push_back(j);
+			}
+		}
+		net.open(args[3], ants);
+	}else{
+		for (int i(0); i < g.size(); i++){
+			g[i].open(outputs[i], binary, INTERACTION_DIRECTION);
+		}
+	}
+	
+	pair_culling culling_state;
+	pair_culling* culling = NULL;
+	if (max_speed > 0){
+		culling_state.speed = max_speed;
+		culling_state.until.assign(tag_count * tag_count, 0);
+		culling_state.box.assign(tag_count * tag_count, 0);
+		culling_state.skipped = 0;
+		culling = &culling_state;
 	}
-	g<<"Time,Frame,Box,Ant1,Ant2,Xcoor1,Ycoor1,Angle1,Xcoor2,Ycoor2,Angle2,Direction"<<endl;
 	
 	cout<<"start interaction search... "<<endl;
 	// read through binary file
-	while (!f.eof()){
+	framerec temp;
+	while (f.read((char*) &temp, sizeof(temp))){
+		if (window > 0){
+			net.next_frame(temp.frame, temp.time);
+		}
 		
-		framerec temp;
-		//cout<<"interval 1"<<endl;
-		f.read((char*) &temp, sizeof(temp)); 
 		for (int j(0); j < tag_count; j++){ 
 			// for tags that are in the tags files and not dead/lost tags
 			if (tgs.get_state(j) && (tgs.get_death(j)== 0 || tgs.get_death(j) > temp.frame)){
 				// for tags that are detected
 				if (temp.tags[j].x != -1){
-					cherche_interaction(temp, tgs, g, j, d_th, a_th_par, width_factor, width_ratio, a_th, interval_a, variable);
+					if (grid != ""){
+						sweep_interaction(temp, tgs, sets, d_max, cache, j, interval_a, variable, exact, culling);
+					}else{
+						cherche_interaction(temp, tgs, &g[0], g.size(), events ? &ev : NULL, window > 0 ? &net : NULL, j, d_th, a_th_par, width_factor, width_ratio, a_th, interval_a, variable, exact, culling);
+					}
 				}
 			}
 		}
 	}
 	
-	g.close();
+	if (culling){
+		cout<<culling->skipped<<" pair tests skipped by the maximal speed."<<endl;
+	}
+	
+	if (grid != ""){
+		// summary of the sweep
+		ofstream h;
+		h.open(args[3]);
+		if (!h.is_open()){
+			throw Exception(CANNOT_OPEN_FILE, (string) args[3]);
+		}
+		h<<"Set,Distance,Angle_paralell,Width_factor,Width_ratio,Delta_angle,Interactions,Direction_-1,Direction_0,Direction_1,Pairs"<<endl;
+		for (int i(0); i < sets.size(); i++){
+			int pairs (0);
+			for (int k(0); k < sets[i].pairs.size(); k++){
+				pairs += sets[i].pairs[k];
+			}
+			h<<i+1<<","<<sets[i].d_th<<","<<sets[i].a_th_par<<","<<sets[i].width_factor<<","<<sets[i].width_ratio<<","<<sets[i].a_th<<",";
+			h<<sets[i].count<<","<<sets[i].direction[0]<<","<<sets[i].direction[1]<<","<<sets[i].direction[2]<<","<<pairs<<endl;
+			if (sets[i].g){
+				sets[i].g->close();
+			}
+		}
+		h.close();
+	}else if (events){
+		ev.close();
+		cout<<"There were "<<ev.get_single_count()<<" antpairs that interaction only once for 1 frame. "<<endl; 
+		cout<<ev.get_event_count()<<" events written."<<endl;
+	}else if (window > 0){
+		net.close();
+		cout<<net.get_window_count()<<" windows written."<<endl;
+	}else{
+		for (int i(0); i < g.size(); i++){
+			g[i].close();
+		}
+	}
 	f.close();
 //  trapezoid.close();
 //  interaction_tester.close();
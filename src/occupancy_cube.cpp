@@ -0,0 +1,189 @@
+/*
+ *  occupancy_cube.cpp
+ *
+ *  Copyright UNIL. All rights reserved.
+ *
+ */
+
+#include <cmath>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "occupancy_cube.h"
+#include "exception.h"
+
+//============================================================================================
+OccupancyCube::OccupancyCube(){
+  fd = -1;
+  memset(&header, 0, sizeof(header));
+  data_offset = 0;
+}
+
+//============================================================================================
+OccupancyCube::~OccupancyCube(){
+  close();
+}
+
+//============================================================================================
+void OccupancyCube::create(const string& name, int box, double start, double bin, int bins, const vector <cube_layer>& l){
+  close();
+  if (bin <= 0 || bins < 1 || l.empty()){
+    throw Exception(INTERNAL_ERROR, "A cube needs at least one bin and one layer");
+  }
+  fd = ::open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+  if (fd == -1){
+    throw Exception(errno == EEXIST ? OUTPUT_EXISTS : CANNOT_OPEN_FILE, name);
+  }
+  filename = name;
+  // the magic is written by finish: an unfinished cube is not a cube file for open
+  memset(header.magic, 0, sizeof(header.magic));
+  header.version = CUBE_VERSION;
+  header.box = box;
+  header.width = HEATMAP_X;
+  header.height = HEATMAP_Y;
+  header.layers = l.size();
+  header.bins = bins;
+  header.start = start;
+  header.bin = bin;
+  layers = l;
+  data_offset = sizeof(cube_header) + layers.size() * sizeof(cube_layer);
+
+  // the slices are zero until they are written
+  if (pwrite(fd, &header, sizeof(header), 0) != sizeof(header)
+      || pwrite(fd, &layers[0], layers.size() * sizeof(cube_layer), sizeof(header)) != (ssize_t) (layers.size() * sizeof(cube_layer))
+      || ftruncate(fd, slice_offset(bins + 1, 0)) != 0){
+    close();
+    unlink(filename.c_str());
+    throw Exception(CANNOT_WRITE_FILE, filename);
+  }
+}
+
+//============================================================================================
+void OccupancyCube::finish(){
+  memcpy(header.magic, CUBE_MAGIC, sizeof(header.magic));
+  if (fd == -1 || fsync(fd) != 0 || pwrite(fd, header.magic, sizeof(header.magic), 0) != sizeof(header.magic) || fsync(fd) != 0){
+    throw Exception(CANNOT_WRITE_FILE, filename);
+  }
+}
+
+//============================================================================================
+void OccupancyCube::open(const string& name){
+  close();
+  fd = ::open(name.c_str(), O_RDONLY);
+  if (fd == -1){
+    throw Exception(CANNOT_OPEN_FILE, name);
+  }
+  filename = name;
+  if (pread(fd, &header, sizeof(header), 0) != sizeof(header)){
+    throw Exception(CANNOT_READ_FILE, filename);
+  }
+  if (memcmp(header.magic, CUBE_MAGIC, sizeof(header.magic)) != 0 || header.version != CUBE_VERSION){
+    throw Exception(CANNOT_READ_FILE, filename + ": not a cube file of version " + to_string(CUBE_VERSION) + ".");
+  }
+  if (header.width != HEATMAP_X || header.height != HEATMAP_Y || header.layers == 0 || header.bins == 0 || header.bin <= 0){
+    throw Exception(DATA_ERROR, filename + ": invalid size of the cube.");
+  }
+  layers.resize(header.layers);
+  if (pread(fd, &layers[0], layers.size() * sizeof(cube_layer), sizeof(header)) != (ssize_t) (layers.size() * sizeof(cube_layer))){
+    throw Exception(CANNOT_READ_FILE, filename);
+  }
+  for (int i(0); i < layers.size(); i++){
+    layers[i].name[sizeof(layers[i].name) - 1] = '\0';
+  }
+  data_offset = sizeof(cube_header) + layers.size() * sizeof(cube_layer);
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (uint64_t) st.st_size != slice_offset(header.bins + 1, 0)){
+    throw Exception(CANNOT_READ_FILE, filename + ": the cube file is truncated.");
+  }
+}
+
+//============================================================================================
+void OccupancyCube::close(){
+  if (fd != -1){
+    ::close(fd);
+    fd = -1;
+  }
+}
+
+//============================================================================================
+uint64_t OccupancyCube::slice_offset(int k, int layer) const{
+  return data_offset + ((uint64_t) k * layers.size() + layer) * HEATMAP_SIZE * sizeof(uint32_t);
+}
+
+//============================================================================================
+void OccupancyCube::read_slice(int k, int layer, uint32_t* cells) const{
+  if (k < 0 || k > (int) header.bins || layer < 0 || layer >= layers.size()){
+    throw Exception(INTERNAL_ERROR, "Invalid slice of the cube");
+  }
+  char* p = (char*) cells;
+  size_t size = HEATMAP_SIZE * sizeof(uint32_t);
+  uint64_t offset = slice_offset(k, layer);
+  while (size > 0){
+    ssize_t n = pread(fd, p, size, offset);
+    if (n <= 0){
+      throw Exception(CANNOT_READ_FILE, filename);
+    }
+    p += n;
+    size -= n;
+    offset += n;
+  }
+}
+
+//============================================================================================
+void OccupancyCube::write_slice(int k, int layer, const uint32_t* cells) const{
+  if (k < 0 || k > (int) header.bins || layer < 0 || layer >= layers.size()){
+    throw Exception(INTERNAL_ERROR, "Invalid slice of the cube");
+  }
+  const char* p = (const char*) cells;
+  size_t size = HEATMAP_SIZE * sizeof(uint32_t);
+  uint64_t offset = slice_offset(k, layer);
+  while (size > 0){
+    ssize_t n = pwrite(fd, p, size, offset);
+    if (n <= 0){
+      throw Exception(CANNOT_WRITE_FILE, filename);
+    }
+    p += n;
+    size -= n;
+    offset += n;
+  }
+}
+
+//============================================================================================
+int OccupancyCube::get_slice(double time) const{
+  double k = floor((time - header.start) / header.bin + 0.5);
+  if (k < 0 || k > header.bins || fabs(header.start + k * header.bin - time) > 1e-6){
+    return -1;
+  }
+  return (int) k;
+}
+
+//============================================================================================
+bool OccupancyCube::get_heatmap(int layer, int from, int to, int* heatmap) const{
+  if (from > to){
+    throw Exception(INTERNAL_ERROR, "Invalid interval of the cube");
+  }
+  vector <uint32_t> first (HEATMAP_SIZE);
+  vector <uint32_t> last (HEATMAP_SIZE);
+  read_slice(from, layer, &first[0]);
+  read_slice(to, layer, &last[0]);
+  bool data (false);
+  for (int i(0); i < HEATMAP_SIZE; i++){
+    heatmap[i] = last[i] - first[i];
+    if (heatmap[i] != 0){
+      data = true;
+    }
+  }
+  return data;
+}
+
+//============================================================================================
+int OccupancyCube::find_layer(char type, const string& name) const{
+  for (int i(0); i < layers.size(); i++){
+    if (layers[i].type == type && name == layers[i].name){
+      return i;
+    }
+  }
+  return -1;
+}
@@ -9,15 +9,69 @@
 
 #include <fstream>
 #include <sstream>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <exception>
 #include "plume.h"
 #include "exception.h"
 
-// plume file
+//==================== ZoneLUT ===============================================
+ZoneLUT::ZoneLUT(){
+  data = NULL;
+  mapping = NULL;
+  mapping_size = 0;
+}
+
+ZoneLUT::~ZoneLUT(){
+  clear();
+}
+
+//========================================================================
+const float* ZoneLUT::get_data() const{
+  return data;
+}
+
+//========================================================================
+void ZoneLUT::assign(const vector <float>& v){
+  clear();
+  values = v;
+  data = &values[0];
+}
 
-const int REDUCED_W = 608;
-const int REDUCED_H = 912;
-const int REDUCED_SIZE = REDUCED_W * REDUCED_H;
+//========================================================================
+void ZoneLUT::map_file(const int fd, const size_t size, const size_t offset){
+  clear();
+  void* m = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  if (m == MAP_FAILED){
+    throw Exception(CANNOT_READ_FILE, "LUT file cannot be mapped into memory");
+  }
+  mapping = m;
+  mapping_size = size;
+  data = (const float*) ((const char*) m + offset);
+}
+
+//========================================================================
+void ZoneLUT::clear(){
+  if (mapping != NULL){
+    munmap(mapping, mapping_size);
+    mapping = NULL;
+    mapping_size = 0;
+  }
+  vector <float>().swap(values);
+  data = NULL;
+}
 
+
+//==================== Plume =================================================
 Plume::Plume()
 {
   bitmap = new uint8_t[REDUCED_SIZE]; // alloue bitmap et initialise tout à 255
@@ -181,31 +235,96 @@ int Plume::get_firstframe(){
 int Plume::get_lastframe(){
 	return lastframe;
 }
+//========================================================================
+/**\fn static void distance_transform(const double* f, const int n, const int step, double* d, int* v, double* z)
+ * \brief One-dimensional squared Euclidean distance transform (Felzenszwalb and Huttenlocher, 2012):
+ *        d[q] = min over p of ((q - p)^2 + f[p]), computed in linear time as the lower envelope of the parabolas rooted at each p
+ * \param f Input values, read every step elements (0 for a zone cell, DOUBLE_MAX otherwise in the first pass)
+ * \param n Number of values
+ * \param step Distance between 2 successive values in f and d
+ * \param d Output values, written every step elements (may be f)
+ * \param v Work array of n integers: roots of the parabolas of the envelope
+ * \param z Work array of n+1 doubles: boundaries between the parabolas of the envelope
+ */
+static void distance_transform(const double* f, const int n, const int step, double* d, int* v, double* z){
+  // values, copied because d may be f
+  vector <double> g (n);
+  for (int q(0); q < n; q++){
+    g[q] = f[q * step];
+  }
+  // lower envelope of the parabolas rooted at the finite values
+  int k (-1);
+  for (int q(0); q < n; q++){
+    if (g[q] == DOUBLE_MAX){
+      continue;
+    }
+    double s (0);
+    while (k >= 0){
+      s = ((g[q] + (double) q * q) - (g[v[k]] + (double) v[k] * v[k])) / (2.0 * (q - v[k]));
+      if (s > z[k]){
+        break;
+      }
+      k--;
+    }
+    k++;
+    v[k] = q;
+    z[k] = (k == 0) ? -DOUBLE_MAX : s;
+    z[k + 1] = DOUBLE_MAX;
+  }
+  if (k == -1){
+    // no finite value: all distances are infinite
+    for (int q(0); q < n; q++){
+      d[q * step] = DOUBLE_MAX;
+    }
+    return;
+  }
+  k = 0;
+  for (int q(0); q < n; q++){
+    while (z[k + 1] < q){
+      k++;
+    }
+    d[q * step] = (double) (q - v[k]) * (q - v[k]) + g[v[k]];
+  }
+}
+
 //========================================================================
 bool Plume::init_LUT(const int code){
   if (code <= 0 || code > NUMBER_LINES_COLOR) {
     return false;
   }
-	for (int x(0); x < IMAGE_WIDTH; x++){
-		cout<<"-> x: "<<x<<" of "<<IMAGE_WIDTH<<endl;
-		for (int y(0); y < IMAGE_HEIGHT; y++){
-			//cout<<"--> y: "<<y<<" of "<<IMAGE_HEIGHT<<endl;
-			position p(x,y);
-			double d(DOUBLE_MAX);
-			for (int i(0); i < REDUCED_SIZE; i++){
-				//cout<<"initializing.."<<endl;
-				
-				if(bitmap[i] == code){
-					//cout<<"calculating for "<<i<<"/"<<REDUCED_SIZE<<"..."<<endl;
-					double temp = calculate_dist(p, i);
-					if (temp <d){
-						d = temp;
-					}
-				}
-			}
-			LUT[code - 1][p] = sqrt(d);
-		}
-	}
+  // exact squared distance, in cells of the bitmap, from each cell to the nearest cell of the zone:
+  // the 2D transform is separable into a transform of each column followed by a transform of each row
+  vector <double> dist (REDUCED_SIZE);
+  bool found (false);
+  for (int i(0); i < REDUCED_SIZE; i++){
+    if (bitmap[i] == code){
+      dist[i] = 0;
+      found = true;
+    }else{
+      dist[i] = DOUBLE_MAX;
+    }
+  }
+  if (!found){
+    return false;
+  }
+  int n = max(REDUCED_W, REDUCED_H);
+  vector <int> v (n);
+  vector <double> z (n + 1);
+  for (int x(0); x < REDUCED_W; x++){
+    distance_transform(&dist[x], REDUCED_H, REDUCED_W, &dist[x], &v[0], &z[0]);
+  }
+  for (int y(0); y < REDUCED_H; y++){
+    distance_transform(&dist[y * REDUCED_W], REDUCED_W, 1, &dist[y * REDUCED_W], &v[0], &z[0]);
+  }
+
+  // the LUT is indexed by cell of the bitmap (image coordinates divided by 5, as in get_code), the distances are in image pixels
+  vector <float> values (REDUCED_SIZE);
+  for (int i(0); i < REDUCED_SIZE; i++){
+    values[i] = 5 * sqrt(dist[i]);
+  }
+  LUT[code - 1].assign(values);
+  LUT_state[code - 1] = true;
+  return true;
 }
 
 //========================================================================
@@ -228,7 +347,7 @@ double Plume::calculate_dist(const position& p, int bitmap_index){
 	int y = (bitmap_index / REDUCED_W) * 5;
 	int x = (bitmap_index % REDUCED_W) * 5;
 	double dx = x - p.x;
-	double dy = y - p.x;
+	double dy = y - p.y;
 	return (dx*dx + dy*dy);
 }
 
@@ -302,13 +421,103 @@ int Plume::exists(string codename){
 	return -1;
 }
 
+//========================================================================
+uint64_t Plume::zone_hash(const int code){
+  uint64_t h = 14695981039346656037ULL;
+  for (int i(0); i < REDUCED_SIZE; i++){
+    h ^= (bitmap[i] == code) ? 1 : 0;
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+//========================================================================
+bool Plume::LUT_file_matches(const string filename, const int code){
+  if (code <= 0 || code > NUMBER_LINES_COLOR) {
+    return false;
+  }
+  ifstream f;
+  f.open(filename.c_str(), ios::in | ios::binary);
+  if (!f.is_open()) {
+    return false;
+  }
+  lut_header h;
+  f.read((char*) &h, sizeof(h));
+  if (f.gcount() != (streamsize) sizeof(h) || memcmp(h.magic, LUT_MAGIC, sizeof(h.magic)) != 0 || h.version != LUT_VERSION) {
+    return false;
+  }
+  h.zone[sizeof(h.zone) - 1] = '\0';
+  return h.code == code && h.width == REDUCED_W && h.height == REDUCED_H && zone[code - 1].compare(h.zone) == 0
+    && h.firstframe <= firstframe && h.lastframe >= lastframe && h.zone_hash == zone_hash(code);
+}
+
 //========================================================================
 bool Plume::load_LUT(const string filename, const int code){
 
+  if (code <= 0 || code > NUMBER_LINES_COLOR) {
+    return false;
+  }
   if (LUT_state[code - 1]) {
     throw Exception(INTERNAL_ERROR, "LUT already existing");
   }
 
+  // binary format: the header is checked and the distances are mapped into memory
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd == -1) {
+    throw Exception(CANNOT_OPEN_FILE, filename);
+  }
+  struct stat st;
+  lut_header h;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    throw Exception(CANNOT_READ_FILE, filename);
+  }
+  if (st.st_size >= (off_t) sizeof(h) && pread(fd, &h, sizeof(h), 0) == (ssize_t) sizeof(h) && memcmp(h.magic, LUT_MAGIC, sizeof(h.magic)) == 0) {
+    try {
+      if (h.version != LUT_VERSION) {
+        ostringstream os;
+        os << filename << ": unsupported LUT version " << h.version << ".";
+        throw Exception(CANNOT_READ_FILE, os.str());
+      }
+      if (h.width != REDUCED_W || h.height != REDUCED_H || st.st_size < (off_t) (sizeof(h) + sizeof(float) * REDUCED_SIZE)) {
+        throw Exception(CANNOT_READ_FILE, filename + ": invalid size of LUT.");
+      }
+      if (h.code != code) {
+        ostringstream os;
+        os << "File is a LUT for code " << h.code << ", but the program wanted to load it on code " << code << ".";
+        throw Exception(DATA_ERROR, os.str());
+      }
+      h.zone[sizeof(h.zone) - 1] = '\0';
+      if (zone[code - 1].compare(h.zone) != 0) {
+        ostringstream os;
+        os << "File is a LUT for zone " << h.zone << ", but the loaded plume file names it " << zone[code - 1] << ".";
+        throw Exception(DATA_ERROR, os.str());
+      }
+      if (h.zone_hash != zone_hash(code)) {
+        throw Exception(DATA_ERROR, "File is a LUT for another bitmap of zone " + zone[code - 1] + ".");
+      }
+      if (h.firstframe > firstframe) {
+        ostringstream os;
+        os << "File is a LUT starting at frame " << h.firstframe << ", but the loaded plume file starts at " << firstframe << ".";
+        throw Exception(DATA_ERROR, os.str());
+      }
+      if (h.lastframe < lastframe) {
+        ostringstream os;
+        os << "File is a LUT ending at frame " << h.lastframe << ", but the loaded plume file ends at " << lastframe << ".";
+        throw Exception(DATA_ERROR, os.str());
+      }
+      LUT[code - 1].map_file(fd, st.st_size, sizeof(h));
+    } catch (...) {
+      close(fd);
+      throw;
+    }
+    close(fd);
+    LUT_state[code - 1] = true;
+    return true;
+  }
+  close(fd);
+
+  // former format: text header followed by doubles
   ifstream f;
   f.open(filename.c_str(), ios::in | ios::binary);
   if (!f.is_open()) {
@@ -374,18 +583,12 @@ bool Plume::load_LUT(const string filename, const int code){
     throw Exception(DATA_ERROR, os.str());
   }
   
-  double* buffer = new double[REDUCED_SIZE];
-  f.read((char*) buffer, sizeof(double) * REDUCED_SIZE);
-  
-  double* bptr = buffer;
-  for (unsigned int y(0); y < REDUCED_H; y++) {
-    for (unsigned int x(0); x < REDUCED_W; x++) {
-      position p(x, y);
-      LUT[code - 1][p] = *bptr;
-      bptr++;
-    }
+  vector <double> buffer (REDUCED_SIZE);
+  f.read((char*) &buffer[0], sizeof(double) * REDUCED_SIZE);
+  if (f.gcount() != (streamsize) (sizeof(double) * REDUCED_SIZE)) {
+    throw Exception(CANNOT_READ_FILE, filename + ": LUT is incomplete.");
   }
-  delete[] buffer;
+  LUT[code - 1].assign(vector <float> (buffer.begin(), buffer.end()));
   LUT_state[code - 1] = true;
 
   return true;
@@ -408,27 +611,28 @@ bool Plume::save_LUT(const string filename, const int code){
   if (!LUT_state[code - 1]) {
     throw Exception(INTERNAL_ERROR, "Could not save uninitialized LUT");
   }
-  double* buffer = new double[REDUCED_SIZE];
-  double* bptr = buffer;
-  for (unsigned int y(0); y < REDUCED_H; y++) {
-    for (unsigned int x(0); x < REDUCED_W; x++) {
-      position p(x, y);
-      *bptr = LUT[code - 1][p];
-      bptr++;
-    }
-  }
+  lut_header h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, LUT_MAGIC, sizeof(h.magic));
+  h.version = LUT_VERSION;
+  h.code = code;
+  h.width = REDUCED_W;
+  h.height = REDUCED_H;
+  h.firstframe = firstframe;
+  h.lastframe = lastframe;
+  h.zone_hash = zone_hash(code);
+  strncpy(h.zone, zone[code - 1].c_str(), sizeof(h.zone) - 1);
   ofstream f;
   f.open(filename.c_str(), ios::out | ios::binary);
   if (!f.is_open()) {
     throw Exception(CANNOT_OPEN_FILE, filename);
   }
-  f << "# ZoneLUT" << endl;
-  f << "# " << code << endl;
-  f << "# " << zone[code - 1] << endl;
-  f << "# " << firstframe << " firstframe" << endl;
-  f << "# " << lastframe << " lastframe" << endl;
-  f.write((const char*) buffer, sizeof(double) * REDUCED_SIZE);
-  delete[] buffer;
+  f.write((const char*) &h, sizeof(h));
+  f.write((const char*) LUT[code - 1].get_data(), sizeof(float) * REDUCED_SIZE);
+  f.close();
+  if (f.fail()) {
+    throw Exception(CANNOT_WRITE_FILE, filename);
+  }
   return true;
 }
 
@@ -451,6 +655,7 @@ void Plume::clear_LUT(){
 //========================================================================
 void Plume::clear_LUT(const int code){
   if (code > 0 && code <= NUMBER_LINES_COLOR) {
+    LUT[code - 1].clear();
     LUT_state[code - 1] = false;
   }
 }
@@ -464,11 +669,11 @@ int Plume::get_code(position p){
   p.x /= 5;
   p.y /= 5;
   // test for border cases (pixels that are not in the low resolution images)
-  if (p.x > REDUCED_W) {
-    p.x = REDUCED_W;
+  if (p.x >= REDUCED_W) {
+    p.x = REDUCED_W - 1;
   }
-  if (p.y > REDUCED_H) {
-    p.y = REDUCED_H;
+  if (p.y >= REDUCED_H) {
+    p.y = REDUCED_H - 1;
   }
   unsigned int idx = p.x + (p.y * REDUCED_W);
   return bitmap[idx];
@@ -501,3 +706,128 @@ void Plume::set_zonename(const int code, const string name){
   }
   zone[code - 1] = name;
 }
+
+//========================================================================
+/**\fn static void build_LUT_tasks(vector <lut_task>& tasks, atomic <size_t>& next, exception_ptr& error, mutex& m)
+ * \brief Work of a thread of build_LUT_files: takes the next task that is not taken yet until all tasks are done
+ * \param tasks LUTs to build
+ * \param next Next task, shared by the threads
+ * \param error First error of the threads
+ * \param m Mutex protecting error
+ */
+static void build_LUT_tasks(vector <lut_task>& tasks, atomic <size_t>& next, exception_ptr& error, mutex& m){
+  size_t i;
+  while ((i = next++) < tasks.size()){
+    lut_task& t = tasks[i];
+    try{
+      if (t.plume->LUT_file_matches(t.filename, t.code)){
+        t.status = LUT_SKIPPED;
+      }else if (!t.plume->init_LUT(t.code)){
+        t.status = LUT_EMPTY;
+      }else{
+        t.plume->save_LUT(t.filename, t.code);
+        t.plume->clear_LUT(t.code);
+        t.status = LUT_BUILT;
+      }
+    }catch(...){
+      lock_guard <mutex> lock (m);
+      if (!error){
+        error = current_exception();
+      }
+      next = tasks.size();
+    }
+  }
+}
+
+//========================================================================
+void build_LUT_files(vector <lut_task>& tasks, const int threads){
+  // the tasks only share the bitmaps, which are read, each one writes the LUT of its own zone
+  atomic <size_t> next (0);
+  exception_ptr error;
+  mutex m;
+  vector <thread> pool;
+  for (int i(0); i < threads; i++){
+    pool.push_back(thread(build_LUT_tasks, ref(tasks), ref(next), ref(error), ref(m)));
+  }
+  for (int i(0); i < pool.size(); i++){
+    pool[i].join();
+  }
+  if (error){
+    rethrow_exception(error);
+  }
+}
+
+//==================== PlumeSchedule =========================================
+PlumeSchedule::PlumeSchedule(){
+}
+
+PlumeSchedule::~PlumeSchedule(){
+  for (int i(0); i < plumes.size(); i++){
+    delete plumes[i];
+  }
+}
+
+//========================================================================
+void PlumeSchedule::read(const string& plumefiles){
+  stringstream ss (plumefiles);
+  string name;
+  while (getline(ss, name, ',')){
+    if (name == ""){
+      continue;
+    }
+    Plume* p = new Plume;
+    if (!p->read_plume(name)){
+      delete p;
+      throw Exception(CANNOT_READ_FILE, name);
+    }
+    // insertion by first frame
+    size_t i = upper_bound(firstframes.begin(), firstframes.end(), p->get_firstframe()) - firstframes.begin();
+    plumes.insert(plumes.begin() + i, p);
+    filenames.insert(filenames.begin() + i, name);
+    firstframes.insert(firstframes.begin() + i, p->get_firstframe());
+    lastframes.insert(lastframes.begin() + i, p->get_lastframe());
+  }
+  if (plumes.empty()){
+    throw Exception(PARAMETER_ERROR, "No plume file given.");
+  }
+  for (int i(1); i < plumes.size(); i++){
+    if (firstframes[i] <= lastframes[i - 1]){
+      throw Exception(PARAMETER_ERROR, "The validities of the plume files " + filenames[i - 1] + " and " + filenames[i] + " overlap.");
+    }
+  }
+}
+
+//========================================================================
+int PlumeSchedule::size() const{
+  return plumes.size();
+}
+
+Plume& PlumeSchedule::operator[] (const int i){
+  return *plumes[i];
+}
+
+const string& PlumeSchedule::get_filename(const int i) const{
+  return filenames[i];
+}
+
+int PlumeSchedule::get_firstframe() const{
+  return firstframes.front();
+}
+
+int PlumeSchedule::get_lastframe() const{
+  return lastframes.back();
+}
+
+//========================================================================
+int PlumeSchedule::find(const int frame, int& cursor) const{
+  if (cursor >= 0 && cursor < plumes.size() && firstframes[cursor] <= frame && frame <= lastframes[cursor]){
+    return cursor;
+  }
+  // last plume file starting at or before the frame
+  int i = (int) (upper_bound(firstframes.begin(), firstframes.end(), frame) - firstframes.begin()) - 1;
+  if (i < 0 || frame > lastframes[i]){
+    return -1;
+  }
+  cursor = i;
+  return i;
+}
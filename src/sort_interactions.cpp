@@ -0,0 +1,400 @@
+/*
+ *  sort_interactions.cpp
+ *  --> sorts interaction files (binary or CSV) that do not fit into memory, for example files obtained by concatenating
+ *		the outputs of several boxes or programs, by frame or by pair of ants and frame (external merge sort):
+ *		1. the input files are read into a buffer of the given size, each full buffer is cut into one slice per thread,
+ *		   the slices are sorted in parallel and written as sorted runs into temporary binary files
+ *		2. the runs are merged (k-way merge), in several passes if there are more runs than files that can be merged at once
+ *		The memory budget (-m) bounds both steps: it is shared by the sort buffer and the read and write buffers of the files,
+ *		and the number of runs merged at once is chosen so that their read buffers fit into it.
+ *		The sort is stable: interactions with the same key keep the order of the input files.
+ *
+ *  Copyright UNIL. All rights reserved.
+ *
+ */
+
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <queue>
+#include <algorithm>
+#include <thread>
+#include <exception>
+#include <getopt.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "exception.h"
+#include "interaction_file.h"
+
+using namespace std;
+
+const size_t MAX_FANIN = 256;				///< maximal number of runs merged at once (open files)
+const size_t MIN_IO_BUFFER = 4 * 1024;		///< smallest read or write buffer of a file
+const size_t MAX_IO_BUFFER = 1024 * 1024;	///< largest read or write buffer of a file
+
+
+// ==============================================================================
+/**\fn inline uint32_t pair_key(const interaction_record& r)
+ * \brief Key of the pair of ants of an interaction, the same for (tag1, tag2) and (tag2, tag1)
+ * \param r Interaction
+ * \return Key: smallest tag in the high 16 bits, largest tag in the low 16 bits
+ */
+inline uint32_t pair_key(const interaction_record& r){
+	return (r.tag1 < r.tag2) ? ((uint32_t) r.tag1 << 16 | r.tag2) : ((uint32_t) r.tag2 << 16 | r.tag1);
+}
+
+/// order of the interactions: by frame, or by pair then frame
+struct record_order{
+	bool by_pair;
+	record_order(const bool p): by_pair(p){}
+	bool operator() (const interaction_record& a, const interaction_record& b) const{
+		if (by_pair){
+			uint32_t ka = pair_key(a);
+			uint32_t kb = pair_key(b);
+			if (ka != kb){
+				return ka < kb;
+			}
+		}
+		return a.frame < b.frame;
+	}
+};
+
+/// sorted sequence of interactions: a temporary file, or a slice of the buffer that is still in memory
+struct run{
+	string file;					///< name of the temporary file, empty for a slice in memory
+	interaction_record* begin;		///< first interaction of the slice
+	interaction_record* end;		///< end of the slice
+};
+
+/// temporary files of the runs, deleted when the program ends whatever the exit path
+struct temp_files{
+	vector <string> names;
+	/**\brief Creates an empty temporary file, a file that exists already is not overwritten
+	 * \param name Name of the file
+	 * \return Name of the file
+	 */
+	string create(const string& name){
+		int fd = open(name.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+		if (fd == -1){
+			throw Exception(errno == EEXIST ? OUTPUT_EXISTS : CANNOT_OPEN_FILE, name);
+		}
+		close(fd);
+		names.push_back(name);
+		return name;
+	}
+	~temp_files(){
+		for (int i(0); i < names.size(); i++){
+			remove(names[i].c_str());
+		}
+	}
+};
+
+/// next interaction of one of the merged runs
+struct merge_head{
+	interaction_record r;
+	int run;						///< index of the run among the merged runs
+};
+
+/// order of the heap: smallest interaction on top, ties broken by the order of the runs to keep the sort stable
+struct head_order{
+	record_order order;
+	head_order(const bool p): order(p){}
+	bool operator() (const merge_head& a, const merge_head& b) const{
+		if (order(a.r, b.r)){
+			return false;
+		}
+		if (order(b.r, a.r)){
+			return true;
+		}
+		return b.run < a.run;
+	}
+};
+
+
+// ==============================================================================
+/**\fn void sort_run(run& r, bool by_pair, uint32_t flags, size_t io, exception_ptr& error)
+ * \brief Work of a sorting thread: sorts a slice of the buffer and writes it into its temporary file if it has one
+ * \param r Slice
+ * \param by_pair True to sort by pair then frame, false to sort by frame
+ * \param flags Optional columns of the interactions
+ * \param io Size of the write buffer in bytes
+ * \param error Error of the thread
+ */
+void sort_run(run& r, bool by_pair, uint32_t flags, size_t io, exception_ptr& error){
+	try{
+		stable_sort(r.begin, r.end, record_order(by_pair));
+		if (r.file != ""){
+			InteractionWriter g;
+			g.set_buffer_size(io);
+			g.open(r.file, true, flags);
+			for (interaction_record* p (r.begin); p != r.end; p++){
+				g.write(*p);
+			}
+			g.close();
+		}
+	}catch(...){
+		error = current_exception();
+	}
+}
+
+// ==============================================================================
+/**\fn void sort_slices(vector <interaction_record>& buffer, size_t n, int threads, bool by_pair, uint32_t flags, const string& prefix, size_t io, vector <run>& runs, temp_files& temps)
+ * \brief Cuts the first n interactions of the buffer into one slice per thread, sorts the slices in parallel and adds them to the runs
+ * \param buffer Interactions
+ * \param n Number of interactions in the buffer
+ * \param threads Number of threads
+ * \param by_pair True to sort by pair then frame, false to sort by frame
+ * \param flags Optional columns of the interactions
+ * \param prefix Prefix of the temporary files, empty to keep the slices in memory
+ * \param io Size of the write buffer of each temporary file in bytes
+ * \param runs Runs, the slices are added in the order of the buffer
+ * \param temps Temporary files, the files of the slices are added
+ */
+void sort_slices(vector <interaction_record>& buffer, size_t n, int threads, bool by_pair, uint32_t flags, const string& prefix, size_t io, vector <run>& runs, temp_files& temps){
+	vector <run> slices;
+	size_t size = (n + threads - 1) / threads;
+	for (size_t s(0); s < n; s += size){
+		run r;
+		r.file = (prefix == "") ? "" : temps.create(prefix + ".run_" + to_string(runs.size() + slices.size() + 1));
+		r.begin = &buffer[0] + s;
+		r.end = &buffer[0] + min(n, s + size);
+		slices.push_back(r);
+	}
+	vector <exception_ptr> errors (slices.size());
+	vector <thread> pool;
+	for (int i(0); i < slices.size(); i++){
+		pool.push_back(thread(sort_run, ref(slices[i]), by_pair, flags, io, ref(errors[i])));
+	}
+	for (int i(0); i < pool.size(); i++){
+		pool[i].join();
+	}
+	runs.insert(runs.end(), slices.begin(), slices.end());
+	for (int i(0); i < errors.size(); i++){
+		if (errors[i]){
+			rethrow_exception(errors[i]);
+		}
+	}
+}
+
+// ==============================================================================
+/**\fn uint64_t merge_runs(const vector <run>& runs, InteractionWriter& g, bool by_pair, size_t io)
+ * \brief Merges sorted runs (k-way merge), only the next interaction of each run is kept in the heap
+ * \param runs Runs to merge, in the order of the input
+ * \param g Output
+ * \param by_pair True if the runs are sorted by pair then frame, false if they are sorted by frame
+ * \param io Size of the read buffer of each temporary file in bytes
+ * \return Number of interactions written
+ */
+uint64_t merge_runs(const vector <run>& runs, InteractionWriter& g, bool by_pair, size_t io){
+	vector <InteractionReader> f (runs.size());
+	vector <interaction_record*> next (runs.size());
+	priority_queue <merge_head, vector <merge_head>, head_order> heads ((head_order(by_pair)));
+	for (int i(0); i < runs.size(); i++){
+		merge_head h;
+		h.run = i;
+		if (runs[i].file != ""){
+			f[i].set_buffer_size(io);
+			f[i].open(runs[i].file);
+			if (f[i].read(h.r)){
+				heads.push(h);
+			}
+		}else{
+			next[i] = runs[i].begin;
+			if (next[i] != runs[i].end){
+				h.r = *next[i]++;
+				heads.push(h);
+			}
+		}
+	}
+	uint64_t count (0);
+	while (!heads.empty()){
+		merge_head h = heads.top();
+		heads.pop();
+		g.write(h.r);
+		count++;
+		int i = h.run;
+		if (runs[i].file != ""){
+			if (f[i].read(h.r)){
+				heads.push(h);
+			}
+		}else if (next[i] != runs[i].end){
+			h.r = *next[i]++;
+			heads.push(h);
+		}
+	}
+	for (int i(0); i < runs.size(); i++){
+		f[i].close();
+	}
+	return count;
+}
+
+// ==============================================================================
+/**\fn void remove_runs(const vector <run>& runs)
+ * \brief Deletes the temporary files of runs
+ * \param runs Runs
+ */
+void remove_runs(const vector <run>& runs){
+	for (int i(0); i < runs.size(); i++){
+		if (runs[i].file != ""){
+			remove(runs[i].file.c_str());
+		}
+	}
+}
+
+
+// ==============================================================================
+int main(int argc, char* argv[]){
+	vector <run> runs;	// sorted runs, in the order of the input
+	temp_files temps;	// deleted when main returns
+	try{
+		bool by_pair (false);	// sort by pair then frame instead of frame
+		bool binary (false);	// binary output instead of CSV
+		double memory (1024);	// size of the sort buffer in MB
+		int threads (1);		// number of threads sorting the buffer
+		string output = "";
+		string temp = "";		// prefix of the temporary files
+		int option;
+		opterr = 0;
+		while ((option = getopt(argc, argv, ":pbm:j:o:T:")) != -1){
+			switch (option){
+				case 'p':
+					by_pair = true;
+					break;
+				case 'b':
+					binary = true;
+					break;
+				case 'm':
+					memory = atof(optarg);
+					if (memory <= 0){
+						throw Exception(PARAMETER_ERROR, "The memory budget (option -m) must be positive.");
+					}
+					break;
+				case 'j':
+					threads = atoi(optarg);
+					if (threads < 1){
+						throw Exception(PARAMETER_ERROR, "The number of threads (option -j) must be positive.");
+					}
+					break;
+				case 'o':
+					output = optarg;
+					break;
+				case 'T':
+					temp = optarg;
+					break;
+				case '?':
+					throw Exception(UNKNOWN_OPTION, "-" + string(1, (char)optopt));
+				case ':':
+					throw Exception(ARGUMENT_MISSING, "-" + string(1, (char)optopt));
+			}
+		}
+
+		if (output == "" || argc - optind < 1){
+			string info = string (argv[0]) + " [-p] [-b] [-m memory(MB)] [-j threads] [-T temp_prefix] -o output input1 [input2 ...]\n"
+				+ "  sorts the interactions of the input files (binary or CSV, in this order) by frame, the order of the input is kept for equal frames\n"
+				+ "  -p  sort by pair of ants, then by frame\n"
+				+ "  -b  write the output in binary format instead of CSV\n"
+				+ "  -m  memory budget in MB for the sort buffer and the file buffers (default 1024)\n"
+				+ "  -j  number of threads sorting the buffer (default 1)\n"
+				+ "  -T  prefix of the temporary files of the sorted runs temp_prefix.run_* (default: output), which must not exist";
+			throw Exception (USE, info);
+		}
+		if (temp == ""){
+			temp = output;
+		}
+
+		FILE* test = fopen(output.c_str(), "r");
+		if (test != NULL){
+			fclose(test);
+			throw Exception(OUTPUT_EXISTS, output);
+		}
+
+		// optional columns of the output: all columns present in an input
+		uint32_t flags (0);
+		for (int i(optind); i < argc; i++){
+			InteractionReader f;
+			f.open(argv[i]);
+			flags |= f.get_flags();
+			f.close();
+		}
+
+		// buffers of the files and sort buffer within the memory budget
+		size_t budget = memory * 1024 * 1024;
+		size_t io = min(MAX_IO_BUFFER, max(MIN_IO_BUFFER, budget / 64));
+		io -= io % sizeof(interaction_record);
+		size_t reserved = (threads + 1) * io;	// input and one temporary file per sorting thread
+		// stable_sort uses a temporary buffer of half of each slice
+		size_t capacity = max((size_t) threads, (budget > reserved ? budget - reserved : 0) * 2 / (3 * sizeof(interaction_record)));
+		size_t fanin = min(MAX_FANIN, max((size_t) 2, budget / io - 1));	// read buffers of the runs and write buffer of the output
+
+		// 1. sorted runs
+		vector <interaction_record> buffer (capacity);
+		size_t n (0);
+		uint64_t total (0);
+		for (int i(optind); i < argc; i++){
+			cout<<"reading "<<argv[i]<<"..."<<endl;
+			InteractionReader f;
+			f.set_buffer_size(io);
+			f.open(argv[i]);
+			while (f.read(buffer[n])){
+				n++;
+				total++;
+				if (n == capacity){
+					sort_slices(buffer, n, threads, by_pair, flags, temp, io, runs, temps);
+					n = 0;
+				}
+			}
+			f.close();
+		}
+		// the last slices stay in memory if all interactions fit into the buffer, otherwise the buffer is released for the merge
+		if (runs.empty()){
+			sort_slices(buffer, n, threads, by_pair, flags, "", io, runs, temps);
+		}else{
+			sort_slices(buffer, n, threads, by_pair, flags, temp, io, runs, temps);
+			vector <interaction_record> ().swap(buffer);
+		}
+		cout<<total<<" interactions in "<<runs.size()<<" sorted runs"<<endl;
+
+		// 2. intermediate merges of consecutive runs, until all runs can be merged at once
+		int pass (0);
+		while (runs.size() > fanin){
+			pass++;
+			cout<<"merge pass "<<pass<<": "<<runs.size()<<" runs..."<<endl;
+			vector <run> merged;
+			for (size_t s(0); s < runs.size(); s += fanin){
+				vector <run> group (runs.begin() + s, runs.begin() + min(runs.size(), s + fanin));
+				run r;
+				r.file = temps.create(temp + ".run_" + to_string(pass) + "_" + to_string(merged.size() + 1));
+				r.begin = r.end = NULL;
+				InteractionWriter g;
+				g.set_buffer_size(io);
+				g.open(r.file, true, flags);
+				merge_runs(group, g, by_pair, io);
+				g.close();
+				remove_runs(group);
+				merged.push_back(r);
+			}
+			runs.swap(merged);
+		}
+
+		// 3. final merge
+		cout<<"merging the runs into "<<output<<"..."<<endl;
+		InteractionWriter g;
+		g.set_buffer_size(io);
+		g.open(output, binary, flags);
+		merge_runs(runs, g, by_pair, io);
+		g.close();
+		remove_runs(runs);
+
+		return 0;
+	}catch(Exception e){
+		return 1;
+	}catch(const exception& e){
+		cerr<<e.what()<<endl;
+		return 1;
+	}
+}
@@ -132,7 +132,7 @@ double Stats::find_median(){
 	if (value_list.empty()){
 		return 0;
 	}else{
-		angle_list.sort();
+		value_list.sort();
 		double median;
 		list<double>::iterator iter = value_list.begin();
 		if (ctr % 2 == 0){
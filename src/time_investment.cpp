@@ -2,6 +2,12 @@
  *  time_investment.cpp
  *  counts how many timesteps a given ant invests in the visit of various zones requested by the user and defined in a plume file
  *
+ *  Several boxes (one plume file per box, or one plume file for all boxes) and windows of a fixed number of frames are counted
+ *  in one pass over the dat file: the frames are cut into one range per thread, each thread reads its range with its own DatFile.
+ *  The zone of each cell of the plume bitmap is looked up once per box in a table giving directly the counter to increment.
+ *  The plume file of a box can be a schedule of plume files (e.g. of successive nest arrangements): each frame uses the plume file
+ *  valid at this frame, detections at frames without a valid plume file are counted in no_zone.
+ *
  *  Created by Danielle Mersch on 4/8/11.
  *  Copyright 2011 __UNIL__. All rights reserved.
  *
@@ -13,6 +19,10 @@
 #include <sstream>
 #include <string>
 #include <cstdlib>
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <exception>
 #include <getopt.h>
 
 #include "exception.h"
@@ -24,22 +34,150 @@
 
 using namespace std;
 
+const int BATCH_FRAMES = 1024;		///< frames read at once from the dat file
+
+// counters of an ant after the counters of the requested zones
+const int OUTZONE = 0;			///< detected outside of the requested zones
+const int NOZONE = 1;			///< detected in an area that is not defined as zone (subsample of outzone)
+const int ABSENT = 2;			///< absent / not visible
+const int UNDETECTED = 3;		///< undetected but supposed to be visible (or detected in another box)
+const int EXTRA_COUNTERS = 4;
+
+/// parameters shared by the threads
+struct investment{
+	string datfile;
+	vector <int> boxes;
+	vector <int> box_index;					///< index in boxes of each box number, -1 for the boxes that are not counted
+	vector <const PlumeSchedule*> schedules;	///< plume files of each box
+	vector <vector <vector <uint8_t> > > cells;	///< counter of each cell of the bitmap of each plume file of each box: zone, Nzones (outzone) or Nzones + 1 (no zone)
+	int Nzones;
+	vector <int> ants;						///< index in tag_list of the ants alive at startframe
+	vector <int> death;						///< death frame of each ant, 0 if alive
+	int startframe;
+	int window;								///< frames per window
+	int counters;							///< counters per ant: Nzones + EXTRA_COUNTERS
+};
+
+/// range of frames counted by a thread
+struct frame_range{
+	int begin;						///< first frame, relative to startframe
+	int end;						///< end (excluded)
+	vector <int> ctr;				///< counters of the windows of the range: ((window - first window) * boxes + box) * ants + ant
+	int read;						///< number of frames read
+	exception_ptr error;
+};
+
+
+// ==============================================================================
+/**\fn void count_range(const investment& inv, frame_range& r)
+ * \brief Work of a thread: reads the frames of a range and counts the frames spent by each ant in each zone of each box, per window
+ * \param inv Parameters of the count
+ * \param r Range of frames
+ */
+void count_range(const investment& inv, frame_range& r){
+	try{
+		size_t n_boxes = inv.boxes.size();
+		size_t n_ants = inv.ants.size();
+		size_t block = n_boxes * n_ants * inv.counters;		// counters of a window
+		int first_window = r.begin / inv.window;
+		r.ctr.assign(((r.end - 1) / inv.window - first_window + 1) * block, 0);
+		r.read = 0;
+
+		DatFile dat;
+		dat.open(inv.datfile, false);
+		if (!dat.go_to_frame(inv.startframe + r.begin)){
+			dat.close();
+			return;
+		}
+		vector <framerec> buffer (BATCH_FRAMES);
+		vector <int> cursor (n_boxes, -1);
+		vector <const uint8_t*> table (n_boxes);
+		for (int k (r.begin); k < r.end; ){
+			int wanted = min(BATCH_FRAMES, r.end - k);
+			if (!dat.read_frame(&buffer[0], wanted)){
+				break;
+			}
+			int n = dat.get_count();
+			for (int f(0); f < n; f++){
+				const framerec& temp = buffer[f];
+				int* window_ctr = &r.ctr[((k + f) / inv.window - first_window) * block];
+				// plume file of each box at this frame
+				for (size_t b(0); b < n_boxes; b++){
+					int j = inv.schedules[b]->find(temp.frame, cursor[b]);
+					table[b] = (j == -1) ? NULL : &inv.cells[b][j][0];
+				}
+				for (size_t a(0); a < n_ants; a++){
+					if (inv.death[a] != 0 && inv.death[a] <= (int) temp.frame){
+						continue;
+					}
+					const tag_pos& t = temp.tags[inv.ants[a]];
+					// box in which the tag is detected, and its counter in this box
+					int detected = -1;
+					int counter = -1;
+					if (t.x != -1){
+						detected = inv.box_index[t.id];
+					}
+					if (detected != -1){
+						if (t.x < 0 || t.x > IMAGE_WIDTH || t.y < 0 || t.y > IMAGE_HEIGHT){
+							throw Exception(DATA_ERROR, "Invalid image coordinates");
+						}
+						int cell = min(t.x / 5, REDUCED_W - 1) + min(t.y / 5, REDUCED_H - 1) * REDUCED_W;
+						counter = (table[detected] == NULL) ? inv.Nzones + 1 : table[detected][cell];
+					}
+					for (size_t b(0); b < n_boxes; b++){
+						int* c = window_ctr + (b * n_ants + a) * inv.counters;
+						// tag detected in box b
+						if ((int) b == detected){
+							if (counter < inv.Nzones){
+								c[counter]++;
+							}else{
+								c[inv.Nzones + OUTZONE]++;
+								if (counter == inv.Nzones + 1){
+									c[inv.Nzones + NOZONE]++;
+								}
+							}
+						// tag absent / not visible
+						}else if (t.y == -2){
+							c[inv.Nzones + ABSENT]++;
+						// tag undetected but supposed to be visible
+						}else{
+							c[inv.Nzones + UNDETECTED]++;
+						}
+					}
+				}
+			}
+			k += n;
+			r.read += n;
+			if (n < wanted){
+				break;
+			}
+		}
+		dat.close();
+	}catch(...){
+		r.error = current_exception();
+	}
+}
+
+
+// ==============================================================================
 int main(int argc, char* argv[]){
 try{
 
 	string tagsfile = "";
 	string datfile = "";
 	string outfile = "";
-	string plumefile = "";
+	vector <string> plumefiles;
 	int duration(0);
 	int startframe (0);
-	int box (0);
+	vector <int> boxes;
+	int window (0);
+	int threads (1);
 	string zones[NUMBER_LINES_COLOR];
 	int Nzones(0);
 
 	// process arguments
 	char option;
-	while ((option = getopt(argc, argv, ":p:i:z:t:o:b:s:d:")) != -1) {
+	while ((option = getopt(argc, argv, ":p:i:z:t:o:b:s:d:w:j:")) != -1) {
 		switch (option)
 		{
 			case '?':
@@ -51,20 +189,31 @@ try{
 				tagsfile = (string)optarg;
 				break;
 			case 'p':
-				plumefile = (string)optarg;
+				plumefiles.push_back(optarg);
 				break;
 			case 'o':
 				outfile = optarg;
 				break;
-			case 'b':
-				box = atoi(optarg);
+			case 'b': {
+				stringstream ss (optarg);
+				string b;
+				while (getline(ss, b, ',')){
+					boxes.push_back(atoi(b.c_str()));
+				}
 				break;
+			}
 			case 'd':
 				duration = atoi(optarg);
 				break;
 			case 's':
 				startframe = atoi(optarg);
 				break;
+			case 'w':
+				window = atoi(optarg);
+				break;
+			case 'j':
+				threads = atoi(optarg);
+				break;
 			case 'z': {
 				if (Nzones >= NUMBER_LINES_COLOR){
 					cerr<<"Too many zones. Only "<<NUMBER_LINES_COLOR<<" zones possible."<<endl;
@@ -79,7 +228,13 @@ try{
 
 	// check if essential parameters are there
 	if (argc < 9){
-		string info = "Usage: " + (string)argv[0] + " -i input.dat -t input.tags -p input.plume -z zone1 -b box -s startframe -d duration(frames) -o output.txt";
+		string info = "Usage: " + (string)argv[0] + " -i input.dat -t input.tags -p input.plume[,input2.plume,...] -z zone1 -b box -s startframe -d duration(frames) [-w window(frames)] [-j threads] -o output.txt\n"
+			+ "  -p  several plume files separated by commas are used each for the frames of its validity\n"
+			+ "  -z  can be repeated for several zones\n"
+			+ "  -b  can be repeated or list several boxes (box1,box2,...), with one -p per box (in the same order) or one -p for all boxes\n"
+			+ "  -w  counts the frames per window of w frames from startframe (default: one window of the whole duration)\n"
+			+ "  -j  number of threads (default 1)\n"
+			+ "  With several boxes or windows, the output has one line per window, box and ant, starting with the first frame of the window and the box";
 		throw Exception (USE, info);
 	}
 
@@ -92,9 +247,15 @@ try{
 	if (outfile == ""){
 		throw Exception(PARAMETER_ERROR, "Name of output.txt file is missing.");
 	}
-	if (plumefile == ""){
+	if (plumefiles.empty()){
 		throw Exception(PARAMETER_ERROR, "Input.plume file is missing.");
 	}
+	if (boxes.empty()){
+		throw Exception(PARAMETER_ERROR, "Box is missing.");
+	}
+	if (plumefiles.size() != 1 && plumefiles.size() != boxes.size()){
+		throw Exception(PARAMETER_ERROR, "One plume file per box, or one plume file for all boxes, is needed.");
+	}
 
 	// test if output exists already
 	ifstream f;
@@ -103,167 +264,235 @@ try{
 		throw Exception(OUTPUT_EXISTS, outfile);
 	}
 
-	// open datfile, plume file, check coverage of plume file, validity of box, startframe and duration
+	// open datfile, plume files, check coverage of plume files, validity of boxes, startframe and duration
 	DatFile dat;
 	dat.open(datfile, 0);
 
 	TagsFile tgs;
 	tgs.read_file(tagsfile.c_str());
 
-	Plume plm;
-	plm.read_plume(plumefile);
+	vector <PlumeSchedule> plm (plumefiles.size());
+	for (int p(0); p < plumefiles.size(); p++){
+		plm[p].read(plumefiles[p]);
 
-	if (plm.get_firstframe() > dat.get_last_frame() || plm.get_lastframe() < dat.get_first_frame()){
-		throw Exception (PARAMETER_ERROR, "The frames covered by the plume file are not in the dat file.");
+		if (plm[p].get_firstframe() > dat.get_last_frame() || plm[p].get_lastframe() < dat.get_first_frame()){
+			throw Exception (PARAMETER_ERROR, "The frames covered by the plume file " + plumefiles[p] + " are not in the dat file.");
+		}
+
+		if (startframe < plm[p].get_firstframe() || startframe > plm[p].get_lastframe()){
+			throw Exception(PARAMETER_ERROR, "Startframe is not within the range of frames covered by the plume file " + plumefiles[p] + ".");
+		}
 	}
 
-	if (!is_valid_ID(box, box_list, box_count)){
-		ostringstream os;
-		os <<box;
-		throw Exception(BOX_NOT_FOUND, os.str());
+	vector <int> box_index (256, -1);
+	for (int b(0); b < boxes.size(); b++){
+		if (!is_valid_ID(boxes[b], box_list, box_count)){
+			ostringstream os;
+			os <<boxes[b];
+			throw Exception(BOX_NOT_FOUND, os.str());
+		}
+		if (box_index[boxes[b]] != -1){
+			throw Exception(PARAMETER_ERROR, "Box " + to_string(boxes[b]) + " is given twice.");
+		}
+		box_index[boxes[b]] = b;
 	}
 
-	if (startframe < plm.get_firstframe() || startframe > plm.get_lastframe()){
-		throw Exception(PARAMETER_ERROR, "Startframe is not within the range of frames covered by the plume file.");
+	if (startframe < dat.get_first_frame()){
+		throw Exception(PARAMETER_ERROR, "Startframe is not within the range of frames of the dat file.");
 	}
 
 	if (duration <= 0 ){
 		throw Exception(PARAMETER_ERROR, "The duration entered is invalid.");
 	}
+	if (window < 0){
+		throw Exception(PARAMETER_ERROR, "The window entered is invalid.");
+	}
+	if (window == 0){
+		window = duration;
+	}
+	if (threads < 1){
+		throw Exception(PARAMETER_ERROR, "The number of threads (option -j) must be positive.");
+	}
 
-	// check if codes are valid
-	bool zonestate[NUMBER_LINES_COLOR];
-	memset(&zonestate, 0, sizeof(zonestate));
-	string zonenames[NUMBER_LINES_COLOR];
+	// check if codes are valid, the zones are counted in the order of their code in the first plume file
+	vector <string> zonenames;
 	for (int i(0); i<Nzones; i++){
 		if (zones[i].empty()){
 			throw Exception(PARAMETER_ERROR,"Parameter of option -z is missing.");
-		}else if(plm.exists(zones[i])== -1){
-			throw Exception(PARAMETER_ERROR, "Zone: " + zones[i] + " does not exist in plume file.");
-		}else{
-			zonestate[plm.exists(zones[i])-1] = true;
-			zonenames[plm.exists(zones[i])-1]= zones[i];
 		}
-	}
-
-	/*for (int i(0); i < NUMBER_LINES_COLOR; i++){
-		if (zonestate[i]){
-			cout<<"Zone "<<zonenames[i]<<"is in "<<i+1<<endl;
+		for (int p(0); p < plm.size(); p++){
+			for (int j(0); j < plm[p].size(); j++){
+				if(plm[p][j].exists(zones[i])== -1){
+					throw Exception(PARAMETER_ERROR, "Zone: " + zones[i] + " does not exist in plume file " + plm[p].get_filename(j) + ".");
+				}
+			}
 		}
-	}*/
-
-	// create and init tables for counters
-	int ctr_zone[tag_count][NUMBER_LINES_COLOR]; ///< table with counter of timestep spend in different zones
-	memset(&ctr_zone, 0, sizeof(ctr_zone));
-	int ctr_outzone[tag_count];///< table with counter of timespect spend outside the requested zones
-	memset(&ctr_outzone, 0, sizeof(ctr_outzone));
-	int ctr_nozone[tag_count]; ///< table with counter for timesteps spent in a not defined zone (subsample of outzone)
-	memset(&ctr_nozone, 0, sizeof(ctr_nozone));
-	int ctr_absent[tag_count]; ///< table with counter for timesteps where the ant was absent
-	memset(&ctr_absent, 0, sizeof(ctr_absent));
-	int ctr_nan[tag_count]; ///< table with counter if timesteps spend undetected
-	memset(&ctr_nan, 0, sizeof(ctr_nan));
-	int	fctr (0); ///< counter for number of frames read
-
-	// go to startframe
-	dat.go_to_frame(startframe);
-
-	// open outfile
-	ofstream g;
-	g.open(outfile.c_str());
-	if (!g.is_open()){
-		throw Exception(CANNOT_OPEN_FILE, outfile);
 	}
-
-	// calculate size of each zone
-	int zone_size[NUMBER_LINES_COLOR + 2]; // size of zones and outzone(idx = NUMBER_LINES_COLOR ) and nozone (idx = NUMBER_LINES_COLOR +1)
-	memset(&zone_size, 0, sizeof(zone_size));
-	//uint8_t* bitmap = plm.get_bitmap();
-	for (int i(0); i<plm.size();i++){
-		int code = plm.get_code(i);
-		if (code <= NUMBER_LINES_COLOR && code >0){
-			if (zonestate[code-1]){
-				zone_size[code-1]++;		// zones
-			}else{
-				zone_size[NUMBER_LINES_COLOR]++;  // outzone
+	for (int code(1); code <= NUMBER_LINES_COLOR; code++){
+		for (int i(0); i<Nzones; i++){
+			if (plm[0][0].exists(zones[i]) == code){
+				zonenames.push_back(zones[i]);
+				break;
 			}
-		}else{
-			zone_size[NUMBER_LINES_COLOR]++;	// outzone
-			zone_size[NUMBER_LINES_COLOR + 1]++;  // nozone
 		}
 	}
 
-  cout<<"You entered "<<Nzones<<" zones."<<endl;
-
-	cout<<"-----------> Zones sizes (pixels) <----------"<<endl;
-	for (int i(0); i<(NUMBER_LINES_COLOR); i++){  // why plus 2 ?
-		if (zonestate[i]){
-			cout<<zonenames[i]<<": "<<zone_size[i] * 25<<endl;
+	investment inv;
+	inv.datfile = datfile;
+	inv.boxes = boxes;
+	inv.box_index = box_index;
+	inv.Nzones = zonenames.size();
+	inv.counters = inv.Nzones + EXTRA_COUNTERS;
+	inv.startframe = startframe;
+	inv.window = window;
+	for (int i(0); i < tag_count; i++){
+		if (tgs.get_state(i) && (tgs.get_death(i) == 0 || tgs.get_death(i) > startframe)){
+			inv.ants.push_back(i);
+			inv.death.push_back(tgs.get_death(i));
 		}
 	}
-	cout<<"Outzone: "<<zone_size[NUMBER_LINES_COLOR] * 25 <<endl;
-	cout<<"Nozone: "<<zone_size[NUMBER_LINES_COLOR+1] * 25 <<endl;
-	cout<<"---------------------------------------------"<<endl;
-
-	// read frames from datfile
-	while(!dat.eof() && fctr < duration){
-		framerec temp;
-		if (dat.read_frame(temp)){
-			for (int i(0); i < tag_count; i++){
-				if (tgs.get_state(i) && (tgs.get_death(i) == 0 || tgs.get_death(i) > temp.frame)){
-					// tag detected in correct box
-					if (temp.tags[i].id == box && temp.tags[i].x != -1 ){
-						position p (temp.tags[i].x, temp.tags[i].y);
-						int code = plm.get_code(p);
-						if (code <= NUMBER_LINES_COLOR && code >0 && zonestate[code-1]){
-							ctr_zone[i][code-1]++;
-						}else{
-							ctr_outzone[i]++;  // contains every time step in which ant detected but outside of specified zones
-							if (code > NUMBER_LINES_COLOR){
-								ctr_nozone[i]++; // times steps in which ant detected in area not defined at all as zone (subsample of outzone)
-							}
-						}
 
-					// tag absent / not visible
-					}else if (temp.tags[i].y == -2){
-						ctr_absent[i]++;
-					// tag undetected but supposed but supposed to be visible
-					}else{
-						ctr_nan[i]++;
+	// counter of each cell of the bitmap of each plume file, and size of each zone
+	vector <vector <vector <uint8_t> > > cells (plm.size());
+	cout<<"You entered "<<Nzones<<" zones."<<endl;
+	for (int p(0); p < plm.size(); p++){
+		cells[p].resize(plm[p].size());
+		for (int j(0); j < plm[p].size(); j++){
+			Plume& plume = plm[p][j];
+			vector <int> column (256, inv.Nzones + 1);	// no zone
+			for (int code(0); code <= NUMBER_LINES_COLOR; code++){
+				column[code] = inv.Nzones;				// outzone
+			}
+			for (int z(0); z < inv.Nzones; z++){
+				column[plume.exists(zonenames[z])] = z;
+			}
+			cells[p][j].resize(REDUCED_SIZE);
+			vector <int> zone_size (inv.counters, 0);
+			for (int i(0); i<plume.size();i++){
+				int c = column[plume.get_code(i)];
+				cells[p][j][i] = c;
+				if (c < inv.Nzones){
+					zone_size[c]++;								// zones
+				}else{
+					zone_size[inv.Nzones + OUTZONE]++;			// outzone
+					if (c == inv.Nzones + 1){
+						zone_size[inv.Nzones + NOZONE]++;		// nozone
 					}
-
 				}
 			}
+
+			cout<<"-----------> Zones sizes (pixels) <----------"<<endl;
+			if (plm.size() > 1 || plm[p].size() > 1){
+				cout<<plm[p].get_filename(j)<<" (frames "<<plume.get_firstframe()<<" to "<<plume.get_lastframe()<<"):"<<endl;
+			}
+			for (int z(0); z < inv.Nzones; z++){
+				cout<<zonenames[z]<<": "<<zone_size[z] * 25<<endl;
+			}
+			cout<<"Outzone: "<<zone_size[inv.Nzones + OUTZONE] * 25 <<endl;
+			cout<<"Nozone: "<<zone_size[inv.Nzones + NOZONE] * 25 <<endl;
+			cout<<"---------------------------------------------"<<endl;
 		}
-		fctr++;
 	}
-	dat.close();
+	for (int b(0); b < boxes.size(); b++){
+		int p = (plm.size() == 1) ? 0 : b;
+		inv.schedules.push_back(&plm[p]);
+		inv.cells.push_back(cells[p]);
+	}
 
+	// frames that can be read from the dat file
+	int fctr = duration;
+	if ((long long) startframe + duration - 1 > dat.get_last_frame()){
+		fctr = dat.get_last_frame() - startframe + 1;
+	}
+	dat.close();
 	if (fctr < duration){
 		cerr<<"Warning: Could only read "<<fctr<<" frames."<<endl;
 	}
+	int Nwindows = (duration + window - 1) / window;
+
+	// frames without a valid plume file
+	for (int p(0); p < plm.size(); p++){
+		int cursor (-1);
+		int uncovered (0);
+		for (int k(0); k < fctr; k++){
+			if (plm[p].find(startframe + k, cursor) == -1){
+				uncovered++;
+			}
+		}
+		if (uncovered > 0){
+			cerr<<"Warning: "<<uncovered<<" frames are not covered by the plume files "<<plumefiles[p]<<"."<<endl;
+		}
+	}
 
+	// open outfile
+	ofstream g;
+	g.open(outfile.c_str());
+	if (!g.is_open()){
+		throw Exception(CANNOT_OPEN_FILE, outfile);
+	}
+
+	// one range of frames per thread, the counters of the windows shared by 2 ranges are added
+	size_t block = boxes.size() * inv.ants.size() * inv.counters;
+	vector <int> ctr (Nwindows * block, 0);
+	int n_ranges = max(1, min(threads, fctr));
+	vector <frame_range> ranges (n_ranges);
+	vector <thread> pool;
+	for (int t(0); t < n_ranges; t++){
+		ranges[t].begin = (long long) fctr * t / n_ranges;
+		ranges[t].end = (long long) fctr * (t + 1) / n_ranges;
+		if (ranges[t].begin < ranges[t].end){
+			pool.push_back(thread(count_range, cref(inv), ref(ranges[t])));
+		}
+	}
+	for (int t(0); t < pool.size(); t++){
+		pool[t].join();
+	}
+	int read (0);
+	for (int t(0); t < n_ranges; t++){
+		if (ranges[t].begin >= ranges[t].end){
+			continue;
+		}
+		if (ranges[t].error){
+			rethrow_exception(ranges[t].error);
+		}
+		int* c = &ctr[(ranges[t].begin / window) * block];
+		for (size_t i(0); i < ranges[t].ctr.size(); i++){
+			c[i] += ranges[t].ctr[i];
+		}
+		read += ranges[t].read;
+	}
+	if (read < fctr){
+		cerr<<"Warning: Could only read "<<read<<" frames."<<endl;
+	}
 
 	//write proportion of time spend in different zones to outfile
+	bool single = (Nwindows == 1 && boxes.size() == 1);
+	if (!single){
+		g<<"frame box ";
+	}
 	g<<"tag ";
-	for (int j(0); j< NUMBER_LINES_COLOR; j++){
-		if (zonestate[j]){
-			g<<zonenames[j]<<" ";
-		}
+	for (int z(0); z < inv.Nzones; z++){
+		g<<zonenames[z]<<" ";
 	}
 	g<<"outzone no_zone absent undetected"<<endl;
 
-	for (int i(0); i < tag_count; i++){
-		if (tgs.get_state(i) && (tgs.get_death(i) == 0 || tgs.get_death(i) > startframe)){
-			g<<tag_list[i]<<" ";
-      int tot(0);
-			for (int j(0); j< NUMBER_LINES_COLOR; j++){
-				if (zonestate[j]){
-					g<<ctr_zone[i][j]<<" ";
-          tot += ctr_zone[i][j];
+	for (int w(0); w < Nwindows; w++){
+		int frame = startframe + w * window;
+		for (int b(0); b < boxes.size(); b++){
+			for (int a(0); a < inv.ants.size(); a++){
+				if (inv.death[a] != 0 && inv.death[a] <= frame){
+					continue;
+				}
+				const int* c = &ctr[w * block + (b * inv.ants.size() + a) * inv.counters];
+				if (!single){
+					g<<frame<<" "<<boxes[b]<<" ";
+				}
+				g<<tag_list[inv.ants[a]]<<" ";
+				for (int z(0); z < inv.counters; z++){
+					g<<c[z]<<(z + 1 < inv.counters ? " " : "");
 				}
+				g<<endl;
 			}
-			g<<ctr_nozone[i]<<" "<<ctr_nozone[i]<<" "<<ctr_absent[i]<<" "<<ctr_nan[i]<<endl;
 		}
 	}
 
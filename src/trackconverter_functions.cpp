@@ -208,30 +208,20 @@ bool find_index(int tag, int& idx){
 }
 
 //==========================================================
-//Parses a line from the csv input file, stores information in line structure
-bool parse_line(string& s, line& temp){
-	istringstream ss;
-	ss.str(s);
-	ss>>temp.time;
-	ss.ignore(1,',');
-	ss>>temp.frame;
-	ss.ignore(1,',');
-	ss>>temp.seg;
-	ss.ignore(1,',');
-	ss>>temp.nb;
+//Parses the current line of the csv input file, stores information in line structure
+bool parse_line(CsvReader& f, line& temp){
+	temp.time = f.read_double();
+	temp.frame = f.read_uint();
+	temp.seg = f.read_int();
+	temp.nb = f.read_int();
 	if (temp.nb>0){
 		int i(0);
 		do {
 			marker m;
-			ss.ignore(1,',');
-			ss>>m.id;
-			ss.ignore(1,',');
-			ss>>m.p.x;
-			ss.ignore(1,',');
-			ss>>m.p.y;
-			ss.ignore(1,',');
-			double a;
-			ss>>a;
+			m.id = f.read_int();
+			m.p.x = f.read_int();
+			m.p.y = f.read_int();
+			double a = f.read_double();
 			m.a = (short) round2(a * 100);
 			temp.tags.push_back(m);
 			i++;
@@ -258,26 +248,14 @@ void convert(double& a){
 
 //==========================================================
 // Reads a line from the csv input, extracts frame number, timestamp, nb segments and nb tags detected
-bool read_line(ifstream& f, frameline& my_frame, map<int,bool>& frames,list <timestamp>& frames_read, timestamp& my_current){
-  string s;
-  getline(f, s);
-  istringstream ss;
-  ss.str(s);
-  if (!s.empty()){
-    ss>>my_frame.time;
-    if (!ss.fail()){
-      ss.ignore(1,',');
-      ss>>my_frame.frame;
-      ss.ignore(1,',');
-      ss>>my_frame.segments;
-      ss.ignore(1,',');
-      ss>>my_frame.tags;
-      ss.ignore(1,',');
-      ss>>my_frame.content;
-      ss.clear();
-    }else{
-      throw Exception(CANNOT_READ_FILE, "Error while reading input.");
-    }
+bool read_line(CsvReader& f, frameline& my_frame, map<int,bool>& frames,list <timestamp>& frames_read, timestamp& my_current){
+  if (f.next_line() && !f.is_empty()){
+    // a malformed line throws an exception giving its number
+    my_frame.time = f.read_double();
+    my_frame.frame = f.read_int();
+    my_frame.segments = f.read_int();
+    my_frame.tags = f.read_int();
+    my_frame.content = f.read_rest();
     frames[my_frame.frame]=true;  /// add frame to map of read frames
     my_current.frame= my_frame.frame;
     my_current.time = my_frame.time;
@@ -149,13 +149,9 @@ try {
 	for (int nfile(4); nfile < argc; nfile++) {
 		
 	  // opens input file that will be read
-	  ifstream f;
-	  f.open(argv[nfile], ios::in);
+	  CsvReader f;
 	  cout << "reading file: " << argv[nfile] << endl; 
-	  if (!f.is_open()) {
-      string info = string(argv[nfile]);
-      throw Exception(CANNOT_OPEN_FILE, info);
-	  }
+	  f.open(argv[nfile]);
 	  files++;
 		
 	  // set variables for file reading
@@ -289,26 +285,19 @@ try {
 		id = box;
 		
 		/// opens input file
-		ifstream f;
-		f.open(filelist2[nfile].c_str());
+		CsvReader f;
 		cout << "File: " << filelist2[nfile] << endl;
-		if (!f.is_open()) {
-			string info = string(filelist2[nfile]);
-			throw Exception(CANNOT_OPEN_FILE, info);
-		}
+		f.open(filelist2[nfile]);
 
 		/// reads line after line from input file
-		while (!f.eof()){
-			
-			string s;		///< string to read line from file
+		while (f.next_line()){
 			
-			getline(f, s);
-			if (!f.fail()){
+			if (!f.is_empty()){
 				line temp;		///< temporary line to store data from one frame
 				
 				/// parses input into temporary line
-				if (!parse_line(s, temp)){
-					string info = "Error reading input from line : "+ s;
+				if (!parse_line(f, temp)){
+					string info = "Error reading input from line : "+ f.get_line();
 					throw Exception (DATA_ERROR, info);
 				}
 			
@@ -11,9 +11,24 @@
 
 using namespace std;
 
+alignas(64) trig_value trig_table[TRIG_MAX - TRIG_MIN + 1];
 
 //==========================================================
-bool position_compare::operator() (const position& a, const position& b){
+// Fills trig_table with the same expression as the conversions of tag_pos::a (a / 100.0 * M_PI / 180), so that the values are identical to the ones calculated with sin and cos
+static bool init_trig_table(){
+	for (int i(0); i <= TRIG_MAX - TRIG_MIN; i++){
+		double a = (double) (i + TRIG_MIN) / 100.0;
+		trig_table[i].s = sin(a * M_PI / 180);
+		trig_table[i].c = cos(a * M_PI / 180);
+	}
+	return true;
+}
+
+static const bool trig_table_filled = init_trig_table();
+
+
+//==========================================================
+bool position_compare::operator() (const position& a, const position& b) const{
 	return (a.y < b.y) || (a.y == b.y && a.x < b.x);
 }
 
@@ -82,12 +97,14 @@ float limit_angle(float a){
 }
 
 // =====================================================================================
-double average_direction(vector <double> angles){
+double average_direction(const vector <double>& angles){
 	double x (0);
 	double y (0);
 	for(int i(0); i< angles.size(); i++) {
-		x += cos(angles[i] * M_PI / 180);
-		y += sin(angles[i] * M_PI / 180);
+		// angles read from tracking data are whole centidegrees, their sine and cosine are tabulated
+		trig_value t = trig_degree(angles[i]);
+		x += t.c;
+		y += t.s;
 	}
 	return atan2(y, x);
 }
@@ -1,6 +1,12 @@
 /*
  *  zone2id.cpp
  *  takes all detections (in a box) in a given zone defined in a plume file, and writes a new dat files in which these detections are labelled with a distinct ID
+ *  Several plume files (e.g. of successive nest arrangements) can be given: each frame uses the plume file valid at this frame
+ *  Several zones can be labelled each with its own ID in one pass.
+ *
+ *  The output is a copy of the input dat file (or the input itself with -I) which is mapped into memory: only the IDs of the
+ *  detections in the zones are changed, by several threads each patching a block of frames.
+ *  The detections are checked in a first read-only pass, so that an invalid input is not changed at all.
  *
  *  Created by Danielle Mersch on 5/1/13.
  *  Copyright 2013 __UNIL__. All rights reserved.
@@ -13,7 +19,14 @@
 #include <sstream>
 #include <string>
 #include <getopt.h>
-#include <cstdlib> 
+#include <cstdlib>
+#include <vector>
+#include <thread>
+#include <exception>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "exception.h"
 #include "utils.h"
@@ -23,19 +36,122 @@
 
 using namespace std;
 
+/// block of frames checked or patched by a thread
+struct frame_block{
+	framerec* begin;
+	framerec* end;
+	vector <uint64_t> labelled;		///< number of detections labelled with each new ID (index in the list of zones)
+	exception_ptr error;
+};
+
+// ==============================================================================
+/**\fn framerec* map_frames(const string& filename, bool write, int& fd, size_t& n_frames)
+ * \brief Maps a dat file into memory
+ * \param filename Name of the dat file
+ * \param write True to change the file through the mapping, false to read it only
+ * \param fd File descriptor of the mapped file
+ * \param n_frames Number of frames in the file
+ * \return First frame of the mapping
+ */
+framerec* map_frames(const string& filename, bool write, int& fd, size_t& n_frames){
+	fd = open(filename.c_str(), write ? O_RDWR : O_RDONLY);
+	if (fd == -1){
+		throw Exception(CANNOT_OPEN_FILE, filename);
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0 || st.st_size % sizeof(framerec) != 0){
+		close(fd);
+		throw Exception(CANNOT_READ_FILE, filename);
+	}
+	void* mapping = mmap(NULL, st.st_size, write ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+	if (mapping == MAP_FAILED){
+		close(fd);
+		throw Exception(write ? CANNOT_WRITE_FILE : CANNOT_READ_FILE, filename);
+	}
+	n_frames = st.st_size / sizeof(framerec);
+	return (framerec*) mapping;
+}
+
+// ==============================================================================
+/**\fn void check_block(const PlumeSchedule& plm, int box, frame_block& b)
+ * \brief Work of a thread in the read-only pass: checks the coordinates of the detections in the box of the frames that have a plume file
+ * \param plm Plume files
+ * \param box Box of the detections
+ * \param b Block of frames
+ */
+void check_block(const PlumeSchedule& plm, int box, frame_block& b){
+	try{
+		int cursor (-1);
+		for (const framerec* temp (b.begin); temp != b.end; temp++){
+			if (plm.find(temp->frame, cursor) == -1){
+				continue;
+			}
+			for (int i(0); i < tag_count; i++){
+				const tag_pos& t = temp->tags[i];
+				if (t.id == box && t.x != -1 && (t.x < 0 || t.x > IMAGE_WIDTH || t.y < 0 || t.y > IMAGE_HEIGHT)){
+					throw Exception(DATA_ERROR, "Invalid image coordinates in frame " + to_string(temp->frame) + ", the dat file was not changed");
+				}
+			}
+		}
+	}catch(...){
+		b.error = current_exception();
+	}
+}
+
+// ==============================================================================
+/**\fn void label_block(const PlumeSchedule& plm, const vector <vector <uint8_t> >& cells, const vector <int>& ids, int box, frame_block& b)
+ * \brief Work of a thread: changes the ID of the detections in the box that are in a zone to the ID of the zone,
+ * the coordinates were checked by check_block
+ * \param plm Plume files
+ * \param cells Number of the zone + 1 (0 for no zone) of each cell of each plume file
+ * \param ids New ID of each zone
+ * \param box Box of the detections
+ * \param b Block of frames
+ */
+void label_block(const PlumeSchedule& plm, const vector <vector <uint8_t> >& cells, const vector <int>& ids, int box, frame_block& b){
+	try{
+		b.labelled.assign(ids.size(), 0);
+		int cursor (-1);
+		for (framerec* temp (b.begin); temp != b.end; temp++){
+			int j = plm.find(temp->frame, cursor);
+			if (j == -1){
+				continue;
+			}
+			const uint8_t* zone = &cells[j][0];
+			for (int i(0); i < tag_count; i++){
+				tag_pos& t = temp->tags[i];
+				// tag detected in correct box
+				if (t.id == box && t.x != -1){
+					int z = zone[min(t.x / 5, REDUCED_W - 1) + min(t.y / 5, REDUCED_H - 1) * REDUCED_W];
+					if (z != 0){
+						t.id = ids[z - 1];
+						b.labelled[z - 1]++;
+					}
+				}
+			}
+		}
+	}catch(...){
+		b.error = current_exception();
+	}
+}
+
+
+// ==============================================================================
 int main(int argc, char* argv[]){
 try{
-	
+
 	string datfile = "";
 	string outfile = "";
 	string plumefile = "";
-	int new_id (0);
+	vector <int> new_ids;
   int box(0);
-	string zone;
-	
+	vector <string> zones;
+	bool in_place (false);
+	int threads (1);
+
 	// process arguments
 	char option;
-	while ((option = getopt(argc, argv, ":p:i:z:o:d:b:")) != -1) {
+	while ((option = getopt(argc, argv, ":p:i:z:o:d:b:Ij:")) != -1) {
 		switch (option)
 		{
 			case '?':
@@ -50,87 +166,167 @@ try{
 				outfile = optarg;
 				break;
 			case 'i':
-				new_id = atoi(optarg);
+				new_ids.push_back(atoi(optarg));
 				break;
       case 'b':
 				box = atoi(optarg);
 				break;
       case 'z': {
-				zone = (string)optarg;
+				zones.push_back((string)optarg);
 				break;
 			}
+			case 'I':
+				in_place = true;
+				break;
+			case 'j':
+				threads = atoi(optarg);
+				break;
 		}
 	}
-	
+
 	// check if essential parameters are there
 	if (argc < 7){
-		string info = "Usage: " + (string)argv[0] + " -d input.dat -p input.plume -z zone -i new_id -o output.dat -b box";
+		string info = "Usage: " + (string)argv[0] + " -d input.dat -p input.plume[,input2.plume,...] -z zone -i new_id [-z zone2 -i new_id2 ...] -b box (-o output.dat | -I) [-j threads]\n"
+			+ "  -z, -i  can be repeated: the detections in the k-th zone get the k-th ID (one ID for all zones is possible)\n"
+			+ "  -I      changes the input dat file itself instead of writing an output\n"
+			+ "  -j      number of threads (default 1)";
 		throw Exception (USE, info);
 	}
-	
+
 	if (datfile == ""){
 		throw Exception(PARAMETER_ERROR, "Input.dat file is missing.");
 	}
-	if (outfile == ""){
+	if (outfile == "" && !in_place){
 		throw Exception(PARAMETER_ERROR, "Name of output.dat file is missing.");
 	}
+	if (outfile != "" && in_place){
+		throw Exception(PARAMETER_ERROR, "Option -I changes the input, it has no output.dat file.");
+	}
 	if (plumefile == ""){
 		throw Exception(PARAMETER_ERROR, "Input.plume file is missing.");
 	}
-	if (!is_valid_ID(new_id, box_list, box_count)){
-		throw Exception(BOX_NOT_FOUND, to_string(new_id));
+	if (zones.empty()){
+		throw Exception(PARAMETER_ERROR,"Parameter of option -z is missing.");
+	}
+	if (new_ids.size() == 1){
+		new_ids.assign(zones.size(), new_ids[0]);
+	}
+	if (new_ids.size() != zones.size()){
+		throw Exception(PARAMETER_ERROR, "One new ID per zone, or one new ID for all zones, is needed.");
+	}
+	for (int z(0); z < new_ids.size(); z++){
+		if (!is_valid_ID(new_ids[z], box_list, box_count)){
+			throw Exception(BOX_NOT_FOUND, to_string(new_ids[z]));
+		}
 	}
   if (!is_valid_ID(box, box_list, box_count)){
 		throw Exception(BOX_NOT_FOUND, to_string(box));
 	}
+	if (threads < 1){
+		throw Exception(PARAMETER_ERROR, "The number of threads (option -j) must be positive.");
+	}
+
 
+	// check whether output exists already, open input datfile, plume file, check coverage of plume file, validity of box,
+	if (!in_place){
+		ifstream test;
+		test.open(outfile.c_str());
+		if (test.is_open()){
+			throw Exception(OUTPUT_EXISTS, outfile);
+		}
+	}
 
-	// check whether output exists already and creates it, open input datfile, plume file, check coverage of plume file, validity of box,   
-	DatFile dat_out;
-  dat_out.create_dat(outfile);
-    
   DatFile dat;
 	dat.open(datfile, 0);
-	
-	Plume plm;
-	plm.read_plume(plumefile);
+
+	PlumeSchedule plm;
+	plm.read(plumefile);
 	if (plm.get_firstframe() > dat.get_last_frame() || plm.get_lastframe() < dat.get_first_frame()){
 		throw Exception (PARAMETER_ERROR, "The frames covered by the plume file are not in the dat file.");
 	}
-	// check if zone code is valid
-  bool zonestate[NUMBER_LINES_COLOR];
-	memset(&zonestate, 0, sizeof(zonestate));
-  if (zone.empty()){
-    throw Exception(PARAMETER_ERROR,"Parameter of option -z is missing.");
-  }else if(plm.exists(zone)== -1){
-    throw Exception(PARAMETER_ERROR, "Zone: " + zone + " does not exist in plume file.");
-  }else{
-    zonestate[plm.exists(zone)-1] = true;
-  }
-	 
-	// read frames from datfile
-	while(!dat.eof()){
-		framerec temp;
-		if (dat.read_frame(temp)){
-			if (temp.frame>=plm.get_firstframe()&& temp.frame<=plm.get_lastframe()){
-				for (int i(0); i < tag_count; i++){
-				
-					// tag detected in correct box
-					if (temp.tags[i].id == box && temp.tags[i].x != -1 ){
-						  position p (temp.tags[i].x, temp.tags[i].y);
-						  int code = plm.get_code(p);
-						  if (code <= NUMBER_LINES_COLOR && code >0 && zonestate[code-1]){
-						    temp.tags[i].id = new_id;
-						  }
-		
-					}
-				}
+	dat.close();
+
+	// check if zone codes are valid, a zone may have another code in each plume file
+	vector <vector <uint8_t> > cells (plm.size());
+	for (int j(0); j < plm.size(); j++){
+		vector <uint8_t> zone_of_code (256, 0);
+		for (int z(0); z < zones.size(); z++){
+			int code = plm[j].exists(zones[z]);
+			if (code == -1){
+				throw Exception(PARAMETER_ERROR, "Zone: " + zones[z] + " does not exist in plume file " + plm.get_filename(j) + ".");
 			}
-      		dat_out.write_frame(&temp);
+			zone_of_code[code] = z + 1;
+		}
+		cells[j].resize(REDUCED_SIZE);
+		uint8_t* bitmap = plm[j].get_bitmap();
+		for (int i(0); i < REDUCED_SIZE; i++){
+			cells[j][i] = zone_of_code[bitmap[i]];
 		}
 	}
-	dat.close();
-	dat_out.close();
+
+	// read-only pass: the input is checked before anything is written
+	int fd;
+	size_t n_frames;
+	framerec* frames = map_frames(datfile, false, fd, n_frames);
+	vector <frame_block> blocks (threads);
+	vector <thread> pool;
+	for (int t(0); t < threads; t++){
+		blocks[t].begin = frames + n_frames * t / threads;
+		blocks[t].end = frames + n_frames * (t + 1) / threads;
+		pool.push_back(thread(check_block, cref(plm), box, ref(blocks[t])));
+	}
+	for (int t(0); t < threads; t++){
+		pool[t].join();
+	}
+	munmap(frames, n_frames * sizeof(framerec));
+	close(fd);
+	for (int t(0); t < threads; t++){
+		if (blocks[t].error){
+			rethrow_exception(blocks[t].error);
+		}
+	}
+
+	// the output is a copy of the input, changed in place
+	string target = datfile;
+	if (!in_place){
+		struct stat src, dst;
+		if (!dat.copy(datfile, outfile) || stat(datfile.c_str(), &src) != 0 || stat(outfile.c_str(), &dst) != 0 || src.st_size != dst.st_size){
+			remove(outfile.c_str());
+			throw Exception(CANNOT_WRITE_FILE, outfile);
+		}
+		target = outfile;
+	}
+	frames = map_frames(target, true, fd, n_frames);
+
+	// one block of frames per thread
+	pool.clear();
+	for (int t(0); t < threads; t++){
+		blocks[t].begin = frames + n_frames * t / threads;
+		blocks[t].end = frames + n_frames * (t + 1) / threads;
+		pool.push_back(thread(label_block, cref(plm), cref(cells), cref(new_ids), box, ref(blocks[t])));
+	}
+	for (int t(0); t < threads; t++){
+		pool[t].join();
+	}
+	bool synced = (msync(frames, n_frames * sizeof(framerec), MS_SYNC) == 0);
+	munmap(frames, n_frames * sizeof(framerec));
+	close(fd);
+	vector <uint64_t> labelled (zones.size(), 0);
+	for (int t(0); t < threads; t++){
+		if (blocks[t].error){
+			rethrow_exception(blocks[t].error);
+		}
+		for (int z(0); z < zones.size(); z++){
+			labelled[z] += blocks[t].labelled[z];
+		}
+	}
+	if (!synced){
+		throw Exception(CANNOT_WRITE_FILE, target);
+	}
+
+	for (int z(0); z < zones.size(); z++){
+		cout<<zones[z]<<": "<<labelled[z]<<" detections labelled "<<new_ids[z]<<endl;
+	}
 	return 0;
 }catch(Exception e){
 	return 1;
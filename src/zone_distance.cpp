@@ -0,0 +1,551 @@
+/*
+ *  zone_distance.cpp
+ *  --> extracts the distance of each ant to a zone of a plume file, using the distance LUT of the zone (computed, or loaded from a LUT file):
+ *		- per frame (default): binary file with one column of distances per ant (NaN when the ant is not detected in the box or dead)
+ *		- per time bin (-w): CSV with, for each bin and ant, the number of frames, the number of frames the ant was detected in the box,
+ *		  the mean and minimal distance and the fraction of the detected frames within a radius of the zone
+ *		The frames are cut into chunks that are read and processed in parallel, each thread reading the dat file with its own DatFile.
+ *		With several plume files (e.g. of successive nest arrangements), each frame uses the LUT of the plume file valid at this frame,
+ *		the ants are not detected at frames without a valid plume file.
+ *
+ *		Binary output: header (distance_header), tags of the ants (uint16, padded to a multiple of 8 bytes),
+ *		time of each frame (double), then the distances of each ant for all frames (float, one column after the other).
+ *		The frames that could not be read from the dat file have a NaN time and NaN distances.
+ *
+ *  Copyright UNIL. All rights reserved.
+ *
+ */
+
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <thread>
+#include <exception>
+#include <getopt.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+
+#include "exception.h"
+#include "utils.h"
+#include "plume.h"
+#include "datfile.h"
+#include "tags3.h"
+#include "trackcvt.h"
+
+using namespace std;
+
+const char DISTANCE_MAGIC[8] = "ATRKDST";	///< identifies the binary distance files
+const uint32_t DISTANCE_VERSION = 1;		///< version of the binary distance format
+const int CHUNK_FRAMES = 16384;				///< frames of a chunk processed by a thread (rounded up to a multiple of the bin length)
+const int BATCH_FRAMES = 1024;				///< frames read at once from the dat file
+
+/// header of the binary distance files (32 bytes)
+struct distance_header{
+	char magic[8];			///< DISTANCE_MAGIC
+	uint32_t version;		///< DISTANCE_VERSION
+	uint32_t code;			///< code of the zone in the (first) plume file
+	uint32_t ants;			///< number of ants (columns)
+	uint32_t firstframe;	///< first frame
+	uint32_t frames;		///< number of frames (rows)
+	uint32_t padding;		///< filling to a multiple of 8 bytes
+};
+
+/// distances of an ant in a time bin
+struct bin_stats{
+	uint32_t frames;		///< frames in which the ant was alive
+	uint32_t detected;		///< frames in which the ant was detected in the box
+	uint32_t within;		///< detected frames within the radius
+	float min;				///< minimal distance
+	double sum;				///< sum of the distances
+};
+
+/// parameters shared by the threads
+struct extraction{
+	string datfile;
+	const PlumeSchedule* schedule;
+	vector <const lut_type*> luts;	///< LUT of the zone of each plume file
+	int box;
+	vector <int> ants;			///< index in tag_list of each column
+	vector <int> death;			///< death frame of each column, 0 if alive
+	uint32_t firstframe;		///< first frame extracted
+	uint32_t frames;			///< number of frames extracted
+	int bin;					///< frames per bin, 0 for the per frame output
+	float radius;				///< radius of the fraction within the zone, in pixels
+	int fd;						///< output file of the per frame output
+	uint64_t times_offset;		///< position of the times in the output
+	uint64_t columns_offset;	///< position of the first column in the output
+};
+
+/// chunk of frames processed by a thread
+struct chunk{
+	uint32_t begin;				///< first frame, relative to the first frame extracted
+	uint32_t end;				///< end (excluded)
+	vector <bin_stats> stats;	///< statistics of each bin (bin * ants + column), for the output per bin
+	vector <double> bin_time;	///< time of the first frame of each bin
+	uint32_t read;				///< number of frames read
+	exception_ptr error;
+};
+
+
+// ==============================================================================
+/**\fn void write_at(int fd, const void* data, size_t size, uint64_t offset)
+ * \brief Writes data at a position of a file
+ * \param fd File descriptor
+ * \param data Data
+ * \param size Size of the data in bytes
+ * \param offset Position in the file
+ */
+void write_at(int fd, const void* data, size_t size, uint64_t offset){
+	const char* p = (const char*) data;
+	while (size > 0){
+		ssize_t n = pwrite(fd, p, size, offset);
+		if (n <= 0){
+			throw Exception(CANNOT_WRITE_FILE, "distance output");
+		}
+		p += n;
+		size -= n;
+		offset += n;
+	}
+}
+
+// ==============================================================================
+/**\fn void extract_chunk(const extraction& e, chunk& c)
+ * \brief Work of a thread: reads the frames of a chunk, writes the distances of each frame or accumulates them per bin
+ * \param e Parameters of the extraction
+ * \param c Chunk
+ */
+void extract_chunk(const extraction& e, chunk& c){
+	try{
+		size_t n_ants = e.ants.size();
+		const float not_available = numeric_limits<float>::quiet_NaN();
+		if (e.bin > 0){
+			size_t bins = (c.end - c.begin + e.bin - 1) / e.bin;
+			bin_stats zero = {0, 0, 0, numeric_limits<float>::infinity(), 0};
+			c.stats.assign(bins * n_ants, zero);
+			c.bin_time.assign(bins, 0);
+		}
+		c.read = 0;
+
+		DatFile dat;
+		dat.open(e.datfile, false);
+		if (!dat.go_to_frame(e.firstframe + c.begin)){
+			dat.close();
+			return;
+		}
+		vector <framerec> buffer (BATCH_FRAMES);
+		vector <double> times (BATCH_FRAMES);
+		vector <float> columns (e.bin > 0 ? 0 : n_ants * BATCH_FRAMES);
+		int cursor (-1);
+		for (uint32_t k (c.begin); k < c.end; ){
+			int wanted = min((uint32_t) BATCH_FRAMES, c.end - k);
+			if (!dat.read_frame(&buffer[0], wanted)){
+				break;
+			}
+			int n = dat.get_count();
+			for (int f(0); f < n; f++){
+				const framerec& r = buffer[f];
+				int j = e.schedule->find(r.frame, cursor);
+				const lut_type* lut = (j == -1) ? NULL : e.luts[j];
+				uint32_t rel = k + f;
+				bin_stats* s = NULL;
+				if (e.bin > 0){
+					size_t b = (rel - c.begin) / e.bin;
+					if ((rel - c.begin) % e.bin == 0){
+						c.bin_time[b] = r.time;
+					}
+					s = &c.stats[b * n_ants];
+				}else{
+					times[f] = r.time;
+				}
+				for (size_t a(0); a < n_ants; a++){
+					int i = e.ants[a];
+					float d = not_available;
+					bool alive = (e.death[a] == 0 || e.death[a] > r.frame);
+					if (alive && lut != NULL && r.tags[i].id == e.box && r.tags[i].x != -1){
+						const tag_pos& t = r.tags[i];
+						if (t.x < 0 || t.x > IMAGE_WIDTH || t.y < 0 || t.y > IMAGE_HEIGHT){
+							throw Exception(DATA_ERROR, "Invalid image coordinates");
+						}
+						d = lut->get_distance(position(t.x, t.y));
+					}
+					if (e.bin > 0){
+						if (alive){
+							s[a].frames++;
+						}
+						if (!isnan(d)){
+							s[a].detected++;
+							s[a].sum += d;
+							s[a].min = min(s[a].min, d);
+							if (d <= e.radius){
+								s[a].within++;
+							}
+						}
+					}else{
+						columns[a * BATCH_FRAMES + f] = d;
+					}
+				}
+			}
+			if (e.bin == 0){
+				write_at(e.fd, &times[0], n * sizeof(double), e.times_offset + (uint64_t) k * sizeof(double));
+				for (size_t a(0); a < n_ants; a++){
+					write_at(e.fd, &columns[a * BATCH_FRAMES], n * sizeof(float), e.columns_offset + ((uint64_t) a * e.frames + k) * sizeof(float));
+				}
+			}
+			k += n;
+			c.read += n;
+			if (n < wanted){
+				break;
+			}
+		}
+		dat.close();
+	}catch(...){
+		c.error = current_exception();
+	}
+}
+
+// ==============================================================================
+/**\fn void fill_unread(const extraction& e, const chunk& c)
+ * \brief Writes NaN as the time and the distances of the frames of a chunk that were not read, in the per frame output
+ * \param e Parameters of the extraction
+ * \param c Chunk
+ */
+void fill_unread(const extraction& e, const chunk& c){
+	const double no_time = numeric_limits<double>::quiet_NaN();
+	const float not_available = numeric_limits<float>::quiet_NaN();
+	vector <double> times (BATCH_FRAMES, no_time);
+	vector <float> column (BATCH_FRAMES, not_available);
+	for (uint32_t k (c.begin + c.read); k < c.end; k += BATCH_FRAMES){
+		size_t n = min((uint32_t) BATCH_FRAMES, c.end - k);
+		write_at(e.fd, &times[0], n * sizeof(double), e.times_offset + (uint64_t) k * sizeof(double));
+		for (size_t a(0); a < e.ants.size(); a++){
+			write_at(e.fd, &column[0], n * sizeof(float), e.columns_offset + ((uint64_t) a * e.frames + k) * sizeof(float));
+		}
+	}
+}
+
+// ==============================================================================
+/**\fn void write_bins(ofstream& g, const extraction& e, const chunk& c)
+ * \brief Writes the statistics of the bins of a chunk, for the ants alive in each bin
+ * \param g Output
+ * \param e Parameters of the extraction
+ * \param c Chunk
+ */
+void write_bins(ofstream& g, const extraction& e, const chunk& c){
+	size_t n_ants = e.ants.size();
+	for (size_t b(0); b < c.bin_time.size(); b++){
+		if (b * e.bin >= c.read){
+			break;
+		}
+		uint32_t frame = e.firstframe + c.begin + b * e.bin;
+		for (size_t a(0); a < n_ants; a++){
+			const bin_stats& s = c.stats[b * n_ants + a];
+			if (s.frames == 0){
+				continue;
+			}
+			g<<frame<<","<<c.bin_time[b]<<","<<tag_list[e.ants[a]]<<","<<s.frames<<","<<s.detected<<",";
+			if (s.detected > 0){
+				g<<s.sum / s.detected<<","<<s.min<<","<<(double) s.within / s.detected<<"\n";
+			}else{
+				g<<"NA,NA,NA\n";
+			}
+		}
+	}
+}
+
+
+// ==============================================================================
+int main(int argc, char* argv[]){
+	int fd (-1);
+try{
+
+	string tagsfile = "";
+	string datfile = "";
+	string outfile = "";
+	string plumefile = "";
+	string zone = "";
+	string lutfile = "";
+	int duration (0);
+	int startframe (-1);
+	int box (0);
+	int bin (0);
+	double radius (0);
+	int threads (1);
+
+	int option;
+	opterr = 0;
+	while ((option = getopt(argc, argv, ":i:t:p:z:l:b:s:d:w:r:j:o:")) != -1){
+		switch (option){
+			case 'i':
+				datfile = optarg;
+				break;
+			case 't':
+				tagsfile = optarg;
+				break;
+			case 'p':
+				plumefile = optarg;
+				break;
+			case 'z':
+				zone = optarg;
+				break;
+			case 'l':
+				lutfile = optarg;
+				break;
+			case 'b':
+				box = atoi(optarg);
+				break;
+			case 's':
+				startframe = atoi(optarg);
+				break;
+			case 'd':
+				duration = atoi(optarg);
+				if (duration <= 0){
+					throw Exception(PARAMETER_ERROR, "The duration (option -d) must be positive.");
+				}
+				break;
+			case 'w':
+				bin = atoi(optarg);
+				if (bin <= 0){
+					throw Exception(PARAMETER_ERROR, "The length of the bins (option -w) must be positive.");
+				}
+				break;
+			case 'r':
+				radius = atof(optarg);
+				if (radius < 0){
+					throw Exception(PARAMETER_ERROR, "The radius (option -r) cannot be negative.");
+				}
+				break;
+			case 'j':
+				threads = atoi(optarg);
+				if (threads < 1){
+					throw Exception(PARAMETER_ERROR, "The number of threads (option -j) must be positive.");
+				}
+				break;
+			case 'o':
+				outfile = optarg;
+				break;
+			case '?':
+				throw Exception(UNKNOWN_OPTION, "-" + string(1, (char)optopt));
+			case ':':
+				throw Exception(ARGUMENT_MISSING, "-" + string(1, (char)optopt));
+		}
+	}
+
+	if (datfile == "" || tagsfile == "" || plumefile == "" || zone == "" || box == 0 || outfile == ""){
+		string info = string (argv[0]) + " -i input.dat -t input.tags -p input.plume[,input2.plume,...] -z zone -b box [-l zone.lut[,zone2.lut,...]] [-s startframe] [-d duration(frames)] [-w bin(frames)] [-r radius(pixels)] [-j threads] -o output\n"
+			+ "  extracts the distance in pixels of each ant detected in the box to a zone (name or code) of the plume file\n"
+			+ "  -p  several plume files separated by commas are used each for the frames of its validity\n"
+			+ "  -l  LUT file of the zone (see zone_lut) of each plume file, in the same order, computed if not given\n"
+			+ "  -s  first frame (default: first frame of the plume files in the dat file)\n"
+			+ "  -d  number of frames (default: until the end of the plume files or of the dat file)\n"
+			+ "  -w  writes statistics per bin of w frames in CSV (frame,time,tag,frames,detected,mean,min,within)\n"
+			+ "      instead of the distances of each frame in binary format\n"
+			+ "  -r  radius for the fraction of the detected frames within the zone (default 0: inside the zone)\n"
+			+ "  -j  number of threads (default 1)";
+		throw Exception (USE, info);
+	}
+
+	FILE* test = fopen(outfile.c_str(), "r");
+	if (test != NULL){
+		fclose(test);
+		throw Exception(OUTPUT_EXISTS, outfile);
+	}
+
+	if (!is_valid_ID(box, box_list, box_count)){
+		throw Exception(BOX_NOT_FOUND, to_string(box));
+	}
+
+	TagsFile tgs;
+	tgs.read_file(tagsfile.c_str());
+
+	PlumeSchedule plm;
+	plm.read(plumefile);
+	vector <int> codes (plm.size());
+	for (int j(0); j < plm.size(); j++){
+		codes[j] = plm[j].exists(zone);
+		if (codes[j] == -1){
+			codes[j] = atoi(zone.c_str());
+		}
+		if (codes[j] < 1 || codes[j] > NUMBER_LINES_COLOR){
+			throw Exception(PARAMETER_ERROR, "Zone: " + zone + " does not exist in plume file " + plm.get_filename(j) + ".");
+		}
+	}
+
+	// frames: validity of the plume files in the dat file
+	DatFile dat;
+	dat.open(datfile, false);
+	int first = max((int) dat.get_first_frame(), plm.get_firstframe());
+	int last = min((int) dat.get_last_frame(), plm.get_lastframe());
+	dat.close();
+	if (first > last){
+		throw Exception (PARAMETER_ERROR, "The frames covered by the plume file are not in the dat file.");
+	}
+	if (startframe != -1){
+		if (startframe < first || startframe > last){
+			throw Exception(PARAMETER_ERROR, "Startframe is not within the range of frames covered by the plume file and the dat file.");
+		}
+		first = startframe;
+	}
+	if (duration > 0 && (int64_t) first + duration - 1 < last){
+		last = first + duration - 1;
+	}
+
+	// LUT file of each plume file, the LUT files are given in the order of the plume files
+	map <string, string> lutfiles;
+	if (lutfile != ""){
+		stringstream ps (plumefile);
+		stringstream ls (lutfile);
+		string name;
+		while (getline(ps, name, ',')){
+			if (name == ""){
+				continue;
+			}
+			string lut;
+			if (!getline(ls, lut, ',') || lut == ""){
+				throw Exception(PARAMETER_ERROR, "The LUT file of the plume file " + name + " is missing.");
+			}
+			lutfiles[name] = lut;
+		}
+	}
+
+	extraction e;
+	e.datfile = datfile;
+	e.schedule = &plm;
+	for (int j(0); j < plm.size(); j++){
+		// no LUT for the plume files that are not used
+		if (plm[j].get_lastframe() < first || plm[j].get_firstframe() > last){
+			e.luts.push_back(NULL);
+			continue;
+		}
+		string name = lutfiles[plm.get_filename(j)];
+		if (name != ""){
+			if (!plm[j].load_LUT(name, codes[j])){
+				throw Exception(CANNOT_READ_FILE, name);
+			}
+		}else if (!plm[j].init_LUT(codes[j])){
+			throw Exception(PARAMETER_ERROR, "Zone: " + zone + " is empty in plume file " + plm.get_filename(j) + ".");
+		}
+		e.luts.push_back(&plm[j].get_LUT(codes[j]));
+	}
+	e.box = box;
+	for (int i(0); i < tag_count; i++){
+		if (tgs.get_state(i) && (tgs.get_death(i) == 0 || tgs.get_death(i) > first)){
+			e.ants.push_back(i);
+			e.death.push_back(tgs.get_death(i));
+		}
+	}
+	e.firstframe = first;
+	e.frames = last - first + 1;
+	e.bin = bin;
+	e.radius = radius;
+	e.fd = -1;
+
+	// chunks, a multiple of the bin length
+	uint32_t size = CHUNK_FRAMES;
+	if (bin > 0){
+		size = ((size + bin - 1) / bin) * bin;
+	}
+	vector <chunk> chunks;
+	for (uint64_t s(0); s < e.frames; s += size){
+		chunk c;
+		c.begin = s;
+		c.end = min((uint64_t) e.frames, s + size);
+		c.read = 0;
+		chunks.push_back(c);
+	}
+
+	ofstream g;
+	if (bin > 0){
+		g.open(outfile.c_str());
+		if (!g.is_open()){
+			throw Exception(CANNOT_OPEN_FILE, outfile);
+		}
+		g.precision(12);
+		g<<"frame,time,tag,frames,detected,mean,min,within\n";
+	}else{
+		fd = ::open(outfile.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+		if (fd == -1){
+			throw Exception(CANNOT_OPEN_FILE, outfile);
+		}
+		e.fd = fd;
+		distance_header h;
+		memset(&h, 0, sizeof(h));
+		memcpy(h.magic, DISTANCE_MAGIC, sizeof(h.magic));
+		h.version = DISTANCE_VERSION;
+		h.code = codes[0];
+		h.ants = e.ants.size();
+		h.firstframe = e.firstframe;
+		h.frames = e.frames;
+		vector <uint16_t> tags ((e.ants.size() + 3) / 4 * 4, 0);
+		for (size_t a(0); a < e.ants.size(); a++){
+			tags[a] = tag_list[e.ants[a]];
+		}
+		write_at(fd, &h, sizeof(h), 0);
+		write_at(fd, &tags[0], tags.size() * sizeof(uint16_t), sizeof(h));
+		e.times_offset = sizeof(h) + tags.size() * sizeof(uint16_t);
+		e.columns_offset = e.times_offset + (uint64_t) e.frames * sizeof(double);
+		if (ftruncate(fd, e.columns_offset + (uint64_t) e.ants.size() * e.frames * sizeof(float)) != 0){
+			throw Exception(CANNOT_WRITE_FILE, outfile);
+		}
+	}
+
+	// the chunks are processed by rounds of one chunk per thread, the bins are written after each round
+	uint64_t read (0);
+	bool complete (true);
+	for (size_t r(0); r < chunks.size() && complete; r += threads){
+		size_t end = min(chunks.size(), r + threads);
+		vector <thread> pool;
+		for (size_t i(r); i < end; i++){
+			pool.push_back(thread(extract_chunk, cref(e), ref(chunks[i])));
+		}
+		for (size_t i(0); i < pool.size(); i++){
+			pool[i].join();
+		}
+		for (size_t i(r); i < end && complete; i++){
+			if (chunks[i].error){
+				rethrow_exception(chunks[i].error);
+			}
+			if (bin > 0){
+				write_bins(g, e, chunks[i]);
+				vector <bin_stats>().swap(chunks[i].stats);
+			}
+			read += chunks[i].read;
+			complete = (chunks[i].read == chunks[i].end - chunks[i].begin);
+		}
+	}
+	if (!complete){
+		cerr<<"Warning: Could only read "<<read<<" frames."<<endl;
+		// the file has the size of all frames, the rows that were not read are not left at zero (a distance of 0 is in the zone)
+		if (bin == 0){
+			for (size_t i(0); i < chunks.size(); i++){
+				fill_unread(e, chunks[i]);
+			}
+		}
+	}
+
+	if (bin > 0){
+		g.close();
+		if (g.fail()){
+			throw Exception(CANNOT_WRITE_FILE, outfile);
+		}
+	}else{
+		close(fd);
+		fd = -1;
+	}
+	cout<<read<<" frames, "<<e.ants.size()<<" ants"<<endl;
+	return 0;
+}catch(Exception e){
+	if (fd != -1){
+		close(fd);
+	}
+	return 1;
+}
+}
@@ -0,0 +1,180 @@
+/*
+ *  zone_lut.cpp
+ *  --> builds and saves the distance LUTs (Plume::init_LUT) of several zones of several plume files in one run, in parallel:
+ *		the LUT of zone code of input.plume is written to outdir/input_code.lut (next to the plume file by default).
+ *		LUT files that are up to date (same cells of the zone, covering the validity of the plume file) are not built again.
+ *
+ *  Copyright UNIL. All rights reserved.
+ *
+ */
+
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <set>
+#include <getopt.h>
+
+#include "exception.h"
+#include "utils.h"
+#include "plume.h"
+
+using namespace std;
+
+// ==============================================================================
+/**\fn string lut_name(const string& plumefile, const string& outdir, int code)
+ * \brief Name of the LUT file of a zone of a plume file
+ * \param plumefile Name of the plume file
+ * \param outdir Output directory, empty for the directory of the plume file
+ * \param code Code of the zone
+ * \return Name of the LUT file
+ */
+string lut_name(const string& plumefile, const string& outdir, int code){
+	string base = plumefile;
+	string::size_type n = base.find_last_of('/');
+	string dir = (n == string::npos) ? "" : base.substr(0, n + 1);
+	if (n != string::npos){
+		base = base.substr(n + 1);
+	}
+	n = base.find_last_of('.');
+	if (n != string::npos && n > 0){
+		base = base.substr(0, n);
+	}
+	if (outdir != ""){
+		dir = outdir + "/";
+	}
+	return dir + base + "_" + to_string(code) + ".lut";
+}
+
+// ==============================================================================
+int main(int argc, char* argv[]){
+try{
+
+	string outdir = "";
+	string zones = "";		// codes or names of the zones, all zones if empty
+	int threads (1);
+	int option;
+	opterr = 0;
+	while ((option = getopt(argc, argv, ":o:z:j:")) != -1){
+		switch (option){
+			case 'o':
+				outdir = optarg;
+				break;
+			case 'z':
+				zones = optarg;
+				break;
+			case 'j':
+				threads = atoi(optarg);
+				if (threads < 1){
+					throw Exception(PARAMETER_ERROR, "The number of threads (option -j) must be positive.");
+				}
+				break;
+			case '?':
+				throw Exception(UNKNOWN_OPTION, "-" + string(1, (char)optopt));
+			case ':':
+				throw Exception(ARGUMENT_MISSING, "-" + string(1, (char)optopt));
+		}
+	}
+
+	if (argc - optind < 1){
+		string info = string (argv[0]) + " [-z zone1,zone2,...] [-o outdir] [-j threads] input1.plume [input2.plume ...]\n"
+			+ "  builds the distance LUT of each zone of each plume file into outdir/input_code.lut (next to the plume file by default),\n"
+			+ "  LUT files that are up to date are kept\n"
+			+ "  -z  codes or names of the zones (default: all named zones)\n"
+			+ "  -o  output directory\n"
+			+ "  -j  number of threads building the LUTs (default 1)";
+		throw Exception (USE, info);
+	}
+
+	// requested zones
+	vector <string> requested;
+	if (zones != ""){
+		stringstream ss (zones);
+		string z;
+		while (getline(ss, z, ',')){
+			if (z != ""){
+				requested.push_back(z);
+			}
+		}
+	}
+
+	// the plume files are read first, then the LUTs of all files are built together
+	vector <Plume*> plumes;
+	vector <lut_task> tasks;
+	set <string> names;		// a LUT file is built by one task only
+	try{
+		for (int i(optind); i < argc; i++){
+			Plume* p = new Plume;
+			plumes.push_back(p);
+			if (!p->read_plume(argv[i])){
+				throw Exception(CANNOT_READ_FILE, argv[i]);
+			}
+			vector <bool> selected (NUMBER_LINES_COLOR + 1, false);
+			if (requested.empty()){
+				for (int code(1); code <= NUMBER_LINES_COLOR; code++){
+					selected[code] = (p->get_zonename(code) != "");
+				}
+			}else{
+				for (int j(0); j < requested.size(); j++){
+					int code = p->exists(requested[j]);
+					if (code == -1){
+						code = atoi(requested[j].c_str());
+					}
+					if (code < 1 || code > NUMBER_LINES_COLOR){
+						cout<<argv[i]<<": no zone "<<requested[j]<<endl;
+						continue;
+					}
+					selected[code] = true;
+				}
+			}
+			for (int code(1); code <= NUMBER_LINES_COLOR; code++){
+				if (selected[code]){
+					lut_task t;
+					t.plume = p;
+					t.code = code;
+					t.filename = lut_name(argv[i], outdir, code);
+					if (!names.insert(t.filename).second){
+						throw Exception(PARAMETER_ERROR, "The LUTs of zone " + to_string(code) + " of two plume files would both be written to " + t.filename + ".");
+					}
+					t.status = 0;
+					tasks.push_back(t);
+				}
+			}
+		}
+
+		build_LUT_files(tasks, threads);
+	}catch(Exception e){
+		for (int i(0); i < plumes.size(); i++){
+			delete plumes[i];
+		}
+		throw;
+	}
+
+	int built (0);
+	for (int i(0); i < tasks.size(); i++){
+		cout<<tasks[i].filename<<": ";
+		switch (tasks[i].status){
+			case LUT_BUILT:
+				cout<<"built"<<endl;
+				built++;
+				break;
+			case LUT_SKIPPED:
+				cout<<"up to date"<<endl;
+				break;
+			case LUT_EMPTY:
+				cout<<"zone "<<tasks[i].code<<" is empty, no LUT"<<endl;
+				break;
+		}
+	}
+	cout<<built<<" of "<<tasks.size()<<" LUTs built"<<endl;
+
+	for (int i(0); i < plumes.size(); i++){
+		delete plumes[i];
+	}
+	return 0;
+}catch(Exception e){
+	return 1;
+}
+}
@@ -0,0 +1,535 @@
+/*
+ *  zone_transitions.cpp
+ *  --> extracts when each ant detected in a box enters and leaves the zones of plume files: one event (frame, tag, zone_from, zone_to)
+ *		per change of the zone of an ant. The zone of an ant only changes when:
+ *		- the ant was detected in the new zone (or outside of all zones) in at least m consecutive detections (minimal dwell),
+ *		  the event is at the first of these detections
+ *		- with a hysteresis of h pixels, the ant is more than h pixels away from its current zone (distance LUT of the zone)
+ *		Frames in which the ant is not detected in the box, or without a valid plume file, do not change its zone.
+ *		The first zone of each ant is given by an event from "unknown".
+ *
+ *		The frames are read by rounds of one chunk per thread: each thread reduces the detections of its chunk to runs of detections
+ *		in the same zone, the runs of the chunks are then followed in order by the zone of each ant (ants in parallel).
+ *		Events are written sorted by frame.
+ *
+ *		Binary output (-B): header (transition_header), then one transition_record per event.
+ *
+ *  Copyright UNIL. All rights reserved.
+ *
+ */
+
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <exception>
+#include <getopt.h>
+#include <stdint.h>
+
+#include "exception.h"
+#include "utils.h"
+#include "plume.h"
+#include "datfile.h"
+#include "tags3.h"
+#include "trackcvt.h"
+
+using namespace std;
+
+const char TRANSITION_MAGIC[8] = "ATRKZTR";	///< identifies the binary transition files
+const uint32_t TRANSITION_VERSION = 1;		///< version of the binary transition format
+const int CHUNK_FRAMES = 16384;				///< frames of a chunk read by a thread
+const int BATCH_FRAMES = 1024;				///< frames read at once from the dat file
+const uint8_t OUTSIDE = 0;					///< zone of an ant outside of all requested zones
+const uint8_t UNKNOWN = 255;				///< zone of an ant before its first detection
+
+/// header of the binary transition files (160 bytes)
+struct transition_header{
+	char magic[8];								///< TRANSITION_MAGIC
+	uint32_t version;							///< TRANSITION_VERSION
+	uint32_t zones;								///< number of zones, numbered from 1
+	char zone[NUMBER_LINES_COLOR][24];			///< name of each zone, 0-terminated
+};
+
+/// change of the zone of an ant (8 bytes)
+struct transition_record{
+	uint32_t frame;			///< first frame in the new zone
+	uint16_t tag;			///< tag of the ant
+	uint8_t from;			///< former zone: number of the zone, OUTSIDE or UNKNOWN
+	uint8_t to;				///< new zone: number of the zone or OUTSIDE
+};
+
+/// consecutive detections of an ant in the same cell class
+struct detection_run{
+	uint32_t frame;			///< frame of the first detection
+	uint32_t count;			///< number of detections
+	uint16_t cell;			///< zone of the cells (low byte) and zones nearer than the hysteresis (high byte, bit k - 1 for zone k)
+};
+
+/// zone of an ant while its detections are followed
+struct ant_state{
+	uint8_t zone;			///< current zone
+	uint8_t candidate;		///< zone in which the ant was detected since candidate_start, UNKNOWN if none
+	uint32_t candidate_start;
+	uint32_t candidate_count;
+};
+
+/// parameters shared by the threads
+struct extraction{
+	string datfile;
+	PlumeSchedule* schedule;
+	vector <vector <uint16_t> > cells;	///< zone and zones nearer than the hysteresis of each cell, for each plume file
+	int box;
+	vector <int> ants;					///< index in tag_list of each ant
+	vector <int> death;					///< death frame of each ant, 0 if alive
+	uint32_t firstframe;				///< first frame, chunks are relative to it
+	uint32_t min_dwell;					///< minimal number of consecutive detections in a new zone
+};
+
+/// chunk of frames read by a thread
+struct chunk{
+	uint32_t begin;							///< first frame, relative to the first frame
+	uint32_t end;							///< end (excluded)
+	vector <vector <detection_run> > runs;	///< runs of each ant
+	uint32_t read;							///< number of frames read
+	exception_ptr error;
+};
+
+
+// ==============================================================================
+/**\fn void read_chunk(const extraction& e, chunk& c)
+ * \brief Work of a thread in the first step of a round: reduces the detections of the ants in a chunk to runs
+ * \param e Parameters of the extraction
+ * \param c Chunk
+ */
+void read_chunk(const extraction& e, chunk& c){
+	try{
+		size_t n_ants = e.ants.size();
+		c.runs.assign(n_ants, vector <detection_run>());
+		c.read = 0;
+
+		DatFile dat;
+		dat.open(e.datfile, false);
+		if (!dat.go_to_frame(e.firstframe + c.begin)){
+			dat.close();
+			return;
+		}
+		vector <framerec> buffer (BATCH_FRAMES);
+		int cursor (-1);
+		for (uint32_t k (c.begin); k < c.end; ){
+			int wanted = min((uint32_t) BATCH_FRAMES, c.end - k);
+			if (!dat.read_frame(&buffer[0], wanted)){
+				break;
+			}
+			int n = dat.get_count();
+			for (int f(0); f < n; f++){
+				const framerec& r = buffer[f];
+				int j = e.schedule->find(r.frame, cursor);
+				if (j == -1){
+					continue;
+				}
+				const uint16_t* cells = &e.cells[j][0];
+				for (size_t a(0); a < n_ants; a++){
+					const tag_pos& t = r.tags[e.ants[a]];
+					if ((e.death[a] != 0 && e.death[a] <= (int) r.frame) || t.id != e.box || t.x == -1){
+						continue;
+					}
+					if (t.x < 0 || t.x > IMAGE_WIDTH || t.y < 0 || t.y > IMAGE_HEIGHT){
+						throw Exception(DATA_ERROR, "Invalid image coordinates");
+					}
+					uint16_t cell = cells[min(t.x / 5, REDUCED_W - 1) + min(t.y / 5, REDUCED_H - 1) * REDUCED_W];
+					vector <detection_run>& runs = c.runs[a];
+					if (!runs.empty() && runs.back().cell == cell){
+						runs.back().count++;
+					}else{
+						detection_run d = {r.frame, 1, cell};
+						runs.push_back(d);
+					}
+				}
+			}
+			k += n;
+			c.read += n;
+			if (n < wanted){
+				break;
+			}
+		}
+		dat.close();
+	}catch(...){
+		c.error = current_exception();
+	}
+}
+
+// ==============================================================================
+/**\fn void follow_ants(const extraction& e, const vector <chunk>& chunks, size_t first, size_t last, vector <ant_state>& states, vector <transition_record>& events)
+ * \brief Work of a thread in the second step of a round: follows the zone of some ants through the runs of the chunks of the round
+ * \param e Parameters of the extraction
+ * \param chunks Chunks of the round, in the order of the frames
+ * \param first First ant
+ * \param last Last ant (excluded)
+ * \param states Zone of each ant, updated
+ * \param events Events of the ants, in the order of the frames for each ant
+ */
+void follow_ants(const extraction& e, const vector <chunk>& chunks, size_t first, size_t last, vector <ant_state>& states, vector <transition_record>& events){
+	for (size_t a(first); a < last; a++){
+		ant_state& s = states[a];
+		for (size_t c(0); c < chunks.size(); c++){
+			const vector <detection_run>& runs = chunks[c].runs[a];
+			for (size_t i(0); i < runs.size(); i++){
+				const detection_run& d = runs[i];
+				uint8_t zone = d.cell & 0xFF;
+				// hysteresis: the ant stays in its zone while it is near it
+				if (s.zone != UNKNOWN && s.zone != OUTSIDE && zone != s.zone && (d.cell >> (7 + s.zone)) & 1){
+					zone = s.zone;
+				}
+				if (zone == s.zone){
+					s.candidate = UNKNOWN;
+					continue;
+				}
+				if (zone == s.candidate){
+					s.candidate_count += d.count;
+				}else{
+					s.candidate = zone;
+					s.candidate_start = d.frame;
+					s.candidate_count = d.count;
+				}
+				if (s.candidate_count >= e.min_dwell){
+					transition_record t = {s.candidate_start, (uint16_t) tag_list[e.ants[a]], s.zone, zone};
+					events.push_back(t);
+					s.zone = zone;
+					s.candidate = UNKNOWN;
+				}
+			}
+		}
+	}
+}
+
+/// order of the events: by frame, then tag
+bool event_order(const transition_record& a, const transition_record& b){
+	if (a.frame != b.frame){
+		return a.frame < b.frame;
+	}
+	return a.tag < b.tag;
+}
+
+
+// ==============================================================================
+int main(int argc, char* argv[]){
+try{
+
+	string tagsfile = "";
+	string datfile = "";
+	string outfile = "";
+	string plumefile = "";
+	string zones = "";
+	int box (0);
+	int startframe (-1);
+	int duration (0);
+	int min_dwell (1);
+	double hysteresis (0);
+	bool binary (false);
+	int threads (1);
+
+	int option;
+	opterr = 0;
+	while ((option = getopt(argc, argv, ":i:t:p:z:b:s:d:m:h:Bj:o:")) != -1){
+		switch (option){
+			case 'i':
+				datfile = optarg;
+				break;
+			case 't':
+				tagsfile = optarg;
+				break;
+			case 'p':
+				plumefile = optarg;
+				break;
+			case 'z':
+				zones = optarg;
+				break;
+			case 'b':
+				box = atoi(optarg);
+				break;
+			case 's':
+				startframe = atoi(optarg);
+				break;
+			case 'd':
+				duration = atoi(optarg);
+				if (duration <= 0){
+					throw Exception(PARAMETER_ERROR, "The duration (option -d) must be positive.");
+				}
+				break;
+			case 'm':
+				min_dwell = atoi(optarg);
+				if (min_dwell < 1){
+					throw Exception(PARAMETER_ERROR, "The minimal dwell (option -m) must be positive.");
+				}
+				break;
+			case 'h':
+				hysteresis = atof(optarg);
+				if (hysteresis < 0){
+					throw Exception(PARAMETER_ERROR, "The hysteresis (option -h) cannot be negative.");
+				}
+				break;
+			case 'B':
+				binary = true;
+				break;
+			case 'j':
+				threads = atoi(optarg);
+				if (threads < 1){
+					throw Exception(PARAMETER_ERROR, "The number of threads (option -j) must be positive.");
+				}
+				break;
+			case 'o':
+				outfile = optarg;
+				break;
+			case '?':
+				throw Exception(UNKNOWN_OPTION, "-" + string(1, (char)optopt));
+			case ':':
+				throw Exception(ARGUMENT_MISSING, "-" + string(1, (char)optopt));
+		}
+	}
+
+	if (datfile == "" || tagsfile == "" || plumefile == "" || box == 0 || outfile == ""){
+		string info = string (argv[0]) + " -i input.dat -t input.tags -p input.plume[,input2.plume,...] -b box [-z zone1,zone2,...] [-s startframe] [-d duration(frames)] [-m min_dwell] [-h hysteresis(pixels)] [-B] [-j threads] -o output\n"
+			+ "  writes the changes of zone of the ants detected in the box (frame,tag,from,to)\n"
+			+ "  -p  several plume files separated by commas are used each for the frames of its validity\n"
+			+ "  -z  names of the zones (default: all named zones of the first plume file)\n"
+			+ "  -s  first frame (default: first frame of the plume files in the dat file)\n"
+			+ "  -d  number of frames (default: until the end of the plume files or of the dat file)\n"
+			+ "  -m  number of consecutive detections in a new zone before the ant changes zone (default 1)\n"
+			+ "  -h  distance to its zone beyond which an ant leaves it (default 0)\n"
+			+ "  -B  write the output in binary format instead of CSV\n"
+			+ "  -j  number of threads (default 1)";
+		throw Exception (USE, info);
+	}
+
+	FILE* test = fopen(outfile.c_str(), "r");
+	if (test != NULL){
+		fclose(test);
+		throw Exception(OUTPUT_EXISTS, outfile);
+	}
+
+	if (!is_valid_ID(box, box_list, box_count)){
+		throw Exception(BOX_NOT_FOUND, to_string(box));
+	}
+
+	TagsFile tgs;
+	tgs.read_file(tagsfile.c_str());
+
+	PlumeSchedule plm;
+	plm.read(plumefile);
+
+	// requested zones, numbered from 1
+	vector <string> zonenames;
+	if (zones != ""){
+		stringstream ss (zones);
+		string z;
+		while (getline(ss, z, ',')){
+			if (z != "" && find(zonenames.begin(), zonenames.end(), z) == zonenames.end()){
+				zonenames.push_back(z);
+			}
+		}
+	}else{
+		for (int code(1); code <= NUMBER_LINES_COLOR; code++){
+			if (plm[0].get_zonename(code) != ""){
+				zonenames.push_back(plm[0].get_zonename(code));
+			}
+		}
+	}
+	if (zonenames.empty() || zonenames.size() > NUMBER_LINES_COLOR){
+		throw Exception(PARAMETER_ERROR, "Between 1 and " + to_string(NUMBER_LINES_COLOR) + " zones are needed.");
+	}
+	for (int z(0); z < zonenames.size(); z++){
+		bool found (false);
+		for (int j(0); j < plm.size(); j++){
+			found = found || (plm[j].exists(zonenames[z]) != -1);
+		}
+		if (!found){
+			throw Exception(PARAMETER_ERROR, "Zone: " + zonenames[z] + " does not exist in the plume files.");
+		}
+	}
+
+	// frames: validity of the plume files in the dat file
+	DatFile dat;
+	dat.open(datfile, false);
+	int first = max((int) dat.get_first_frame(), plm.get_firstframe());
+	int last = min((int) dat.get_last_frame(), plm.get_lastframe());
+	dat.close();
+	if (first > last){
+		throw Exception (PARAMETER_ERROR, "The frames covered by the plume files are not in the dat file.");
+	}
+	if (startframe != -1){
+		if (startframe < first || startframe > last){
+			throw Exception(PARAMETER_ERROR, "Startframe is not within the range of frames covered by the plume files and the dat file.");
+		}
+		first = startframe;
+	}
+	if (duration > 0 && (int64_t) first + duration - 1 < last){
+		last = first + duration - 1;
+	}
+
+	// zone and zones nearer than the hysteresis of each cell of each plume file
+	extraction e;
+	e.datfile = datfile;
+	e.schedule = &plm;
+	e.cells.resize(plm.size());
+	for (int j(0); j < plm.size(); j++){
+		if (plm[j].get_lastframe() < first || plm[j].get_firstframe() > last){
+			e.cells[j].assign(REDUCED_SIZE, OUTSIDE);
+			continue;
+		}
+		vector <uint8_t> zone_of_code (256, OUTSIDE);
+		for (int z(0); z < zonenames.size(); z++){
+			int code = plm[j].exists(zonenames[z]);
+			if (code != -1){
+				zone_of_code[code] = z + 1;
+			}
+		}
+		e.cells[j].resize(REDUCED_SIZE);
+		uint8_t* bitmap = plm[j].get_bitmap();
+		for (int i(0); i < REDUCED_SIZE; i++){
+			e.cells[j][i] = zone_of_code[bitmap[i]];
+		}
+		if (hysteresis > 0){
+			for (int z(0); z < zonenames.size(); z++){
+				int code = plm[j].exists(zonenames[z]);
+				if (code == -1 || !plm[j].init_LUT(code)){
+					continue;
+				}
+				const float* dist = plm[j].get_LUT(code).get_data();
+				for (int i(0); i < REDUCED_SIZE; i++){
+					if (dist[i] <= hysteresis){
+						e.cells[j][i] |= 1 << (8 + z);
+					}
+				}
+				plm[j].clear_LUT(code);
+			}
+		}
+	}
+	e.box = box;
+	for (int i(0); i < tag_count; i++){
+		if (tgs.get_state(i) && (tgs.get_death(i) == 0 || tgs.get_death(i) > first)){
+			e.ants.push_back(i);
+			e.death.push_back(tgs.get_death(i));
+		}
+	}
+	e.firstframe = first;
+	e.min_dwell = min_dwell;
+	uint32_t frames = last - first + 1;
+
+	ofstream g;
+	g.open(outfile.c_str(), binary ? ios::out | ios::binary : ios::out);
+	if (!g.is_open()){
+		throw Exception(CANNOT_OPEN_FILE, outfile);
+	}
+	if (binary){
+		transition_header h;
+		memset(&h, 0, sizeof(h));
+		memcpy(h.magic, TRANSITION_MAGIC, sizeof(h.magic));
+		h.version = TRANSITION_VERSION;
+		h.zones = zonenames.size();
+		for (int z(0); z < zonenames.size(); z++){
+			strncpy(h.zone[z], zonenames[z].c_str(), sizeof(h.zone[z]) - 1);
+		}
+		g.write((char*) &h, sizeof(h));
+	}else{
+		g<<"frame,tag,from,to\n";
+	}
+	// name of a zone in the CSV output
+	vector <string> label (256, "");
+	label[OUTSIDE] = "outside";
+	label[UNKNOWN] = "unknown";
+	for (int z(0); z < zonenames.size(); z++){
+		label[z + 1] = zonenames[z];
+	}
+
+	// rounds of one chunk per thread: runs of the chunks, then zones of the ants. The events are written once no event
+	// can come before them: an event is at the start of a candidate zone, which may be confirmed in a later round
+	ant_state initial = {UNKNOWN, UNKNOWN, 0, 0};
+	vector <ant_state> states (e.ants.size(), initial);
+	vector <transition_record> pending;
+	uint64_t read (0);
+	uint64_t written (0);
+	bool complete (true);
+	for (uint64_t r(0); r < frames && complete; r += (uint64_t) threads * CHUNK_FRAMES){
+		vector <chunk> chunks;
+		for (uint64_t s(r); s < frames && s < r + (uint64_t) threads * CHUNK_FRAMES; s += CHUNK_FRAMES){
+			chunk c;
+			c.begin = s;
+			c.end = min((uint64_t) frames, s + CHUNK_FRAMES);
+			chunks.push_back(c);
+		}
+		vector <thread> pool;
+		for (size_t i(0); i < chunks.size(); i++){
+			pool.push_back(thread(read_chunk, cref(e), ref(chunks[i])));
+		}
+		for (size_t i(0); i < pool.size(); i++){
+			pool[i].join();
+		}
+		for (size_t i(0); i < chunks.size(); i++){
+			if (chunks[i].error){
+				rethrow_exception(chunks[i].error);
+			}
+			read += chunks[i].read;
+			if (chunks[i].read < chunks[i].end - chunks[i].begin){
+				complete = false;
+				// the following chunks were not reached
+				chunks.resize(i + 1);
+			}
+		}
+
+		size_t n_ants = e.ants.size();
+		vector <vector <transition_record> > events (threads);
+		pool.clear();
+		for (int t(0); t < threads; t++){
+			pool.push_back(thread(follow_ants, cref(e), cref(chunks), n_ants * t / threads, n_ants * (t + 1) / threads, ref(states), ref(events[t])));
+		}
+		for (size_t i(0); i < pool.size(); i++){
+			pool[i].join();
+		}
+		for (int t(0); t < threads; t++){
+			pending.insert(pending.end(), events[t].begin(), events[t].end());
+		}
+
+		// the events before the earliest candidate zone are final
+		uint64_t horizon = (uint64_t) first + chunks.back().end;
+		for (size_t a(0); a < n_ants; a++){
+			if (states[a].candidate != UNKNOWN){
+				horizon = min(horizon, (uint64_t) states[a].candidate_start);
+			}
+		}
+		if (!complete || r + (uint64_t) threads * CHUNK_FRAMES >= frames){
+			horizon = UINT64_MAX;
+		}
+		sort(pending.begin(), pending.end(), event_order);
+		size_t n (0);
+		while (n < pending.size() && pending[n].frame < horizon){
+			const transition_record& t = pending[n];
+			if (binary){
+				g.write((char*) &t, sizeof(t));
+			}else{
+				g<<t.frame<<","<<t.tag<<","<<label[t.from]<<","<<label[t.to]<<"\n";
+			}
+			n++;
+		}
+		pending.erase(pending.begin(), pending.begin() + n);
+		written += n;
+	}
+	if (!complete){
+		cerr<<"Warning: Could only read "<<read<<" frames."<<endl;
+	}
+
+	g.close();
+	if (g.fail()){
+		throw Exception(CANNOT_WRITE_FILE, outfile);
+	}
+	cout<<read<<" frames, "<<e.ants.size()<<" ants, "<<written<<" transitions"<<endl;
+	return 0;
+}catch(Exception e){
+	return 1;
+}
+}